@@ -0,0 +1,118 @@
+#include "allocations.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// All forms are replaced, so that none bypasses the count and every delete
+// matches its new. They live apart from the benchmarks so that GCC does not
+// inline them into code it then flags for freeing operator new memory.
+static std::size_t count = 0;
+
+static void* counted_alloc(std::size_t size, std::size_t align) noexcept
+{
+    ++count;
+    size = size == 0 ? 1 : size;
+    if (align <= alignof(std::max_align_t))
+    {
+        return std::malloc(size);
+    }
+    // aligned_alloc wants a multiple of the alignment.
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static void* counted_new(std::size_t size, std::size_t align)
+{
+    if (void* ptr = counted_alloc(size, align))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size)
+{
+    return counted_new(size, alignof(std::max_align_t));
+}
+void* operator new[](std::size_t size)
+{
+    return counted_new(size, alignof(std::max_align_t));
+}
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return counted_new(size, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return counted_new(size, static_cast<std::size_t>(align));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+void* operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+// malloc and aligned_alloc memory are both released with free.
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { ::operator delete(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept
+{
+    ::operator delete(ptr);
+}
+
+namespace clox::bench
+{
+std::size_t allocations() noexcept { return count; }
+
+}  // namespace clox::bench
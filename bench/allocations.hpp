@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+namespace clox::bench
+{
+// Number of allocations the process has made: clox_bench replaces the
+// global operator new so that benchmarks can report allocations per
+// iteration.
+std::size_t allocations() noexcept;
+
+}  // namespace clox::bench
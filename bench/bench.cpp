@@ -0,0 +1,368 @@
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "allocations.hpp"
+#include "compiler.hpp"
+#include "object.hpp"
+#include "output.hpp"
+#include "profiler.hpp"
+#include "scanner.hpp"
+#include "table.hpp"
+#include "vm.hpp"
+#include "workloads.hpp"
+
+namespace
+{
+struct options
+{
+    std::string_view filter;
+    double           min_time = 0.5;
+};
+
+struct result
+{
+    std::size_t iterations  = 0;
+    double      seconds     = 0;
+    std::size_t units       = 0;  // Tokens, bytes or instructions.
+    std::size_t allocations = 0;
+};
+
+// Runs 'body' until 'min_time' elapsed. 'body' returns the number of units
+// it processed in one iteration.
+result measure(double min_time, const std::function<std::size_t()>& body)
+{
+    using clock = std::chrono::steady_clock;
+    result     res;
+    const auto allocs_before = clox::bench::allocations();
+    const auto start         = clock::now();
+    do
+    {
+        res.units += body();
+        ++res.iterations;
+        res.seconds =
+            std::chrono::duration<double>(clock::now() - start).count();
+    } while (res.seconds < min_time);
+    res.allocations = clox::bench::allocations() - allocs_before;
+    return res;
+}
+
+void report(std::string_view name, std::string_view unit, const result& res)
+{
+    const auto iterations = static_cast<double>(res.iterations);
+    std::cout << std::format(
+                     "{{\"benchmark\":\"{}\",\"iterations\":{},"
+                     "\"seconds\":{:.6f},\"{}_per_sec\":{:.1f},"
+                     "\"{}_per_iter\":{:.1f},\"allocations_per_iter\":{:.1f}}}",
+                     name, res.iterations, res.seconds, unit,
+                     static_cast<double>(res.units) / res.seconds, unit,
+                     static_cast<double>(res.units) / iterations,
+                     static_cast<double>(res.allocations) / iterations)
+              << std::endl;
+}
+
+std::vector<clox::chunk> compile_or_die(const std::string& source)
+{
+    clox::compiler comp{source};
+    auto           chunks = comp.compile();
+    if (!chunks)
+    {
+        std::cerr << "workload failed to compile" << std::endl;
+        std::exit(1);
+    }
+    return std::move(*chunks);
+}
+
+void bench_scanner(const options& opts, std::string_view name,
+                   const std::string& source)
+{
+    report(name, "tokens",
+           measure(opts.min_time,
+                   [&]
+                   {
+                       clox::scanner scanner{source};
+                       std::size_t   tokens = 0;
+                       while (scanner.scan_token().type !=
+                              clox::TokenType::EOF_)
+                       {
+                           ++tokens;
+                       }
+                       return tokens;
+                   }));
+}
+
+void bench_compiler(const options& opts, std::string_view name,
+                    const std::string& source)
+{
+    report(name, "bytes",
+           measure(opts.min_time,
+                   [&]
+                   {
+                       clox::compiler comp{source};
+                       comp.compile();
+                       return source.size();
+                   }));
+}
+
+void bench_vm(const options& opts, std::string_view name,
+              const std::string& source, clox::Backend backend)
+{
+    clox::null_sink null;
+    clox::vm        vm{compile_or_die(source)};
+    vm.set_output(null);
+    vm.set_backend(backend);
+
+    // Count dispatched instructions once with an every-instruction profiler
+    // so the timed runs below are not instrumented.
+    std::size_t instructions;
+    {
+        clox::profiler prof{clox::profiler::Mode::INSTRUCTIONS, 1};
+        vm.set_profiler(&prof);
+        prof.start();
+        vm.interpret();
+        instructions = prof.samples();
+        vm.set_profiler(nullptr);
+    }
+    const auto res = measure(opts.min_time,
+                             [&]
+                             {
+                                 vm.interpret();
+                                 return instructions;
+                             });
+    report(name, "instructions", res);
+}
+
+void bench_stack_vm(const options& opts, std::string_view name,
+                    const std::string& source)
+{
+    bench_vm(opts, name, source, clox::Backend::STACK);
+}
+
+void bench_register_vm(const options& opts, std::string_view name,
+                       const std::string& source)
+{
+    bench_vm(opts, name, source, clox::Backend::REGISTER);
+}
+
+// The identifiers of 'source' in order: the names a vm looks up when it
+// runs the script.
+std::vector<std::string> identifiers(const std::string& source)
+{
+    std::vector<std::string> names;
+    clox::scanner            scanner{source};
+    for (auto token = scanner.scan_token(); token.type != clox::TokenType::EOF_;
+         token      = scanner.scan_token())
+    {
+        if (token.type == clox::TokenType::IDENTIFIER)
+        {
+            names.emplace_back(token.lexeme);
+        }
+    }
+    return names;
+}
+
+// Runs 'source' once and reports the pauses of the cycle collector, whose
+// p99 is what a latency-sensitive embedding cares about.
+void bench_gc(std::string_view name, const std::string& source,
+              std::chrono::nanoseconds pause_target)
+{
+    clox::null_sink null;
+    clox::vm        vm{compile_or_die(source)};
+    vm.set_output(null);
+    vm.gc().set_pause_target(pause_target);
+    const auto start = std::chrono::steady_clock::now();
+    vm.interpret();
+    const std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    const auto& stats = vm.gc().stats();
+    const auto  us    = [](std::chrono::nanoseconds pause)
+    { return static_cast<double>(pause.count()) / 1000; };
+    std::cout << std::format(
+                     "{{\"benchmark\":\"{}\",\"seconds\":{:.6f},"
+                     "\"pauses\":{},\"p50_us\":{:.1f},\"p99_us\":{:.1f},"
+                     "\"max_us\":{:.1f},\"freed\":{}}}",
+                     name, seconds.count(), stats.pauses.count,
+                     us(stats.pauses.percentile(0.5)),
+                     us(stats.pauses.percentile(0.99)),
+                     us(stats.pauses.max), stats.freed)
+              << std::endl;
+}
+
+void bench_gc_stop_the_world(const options&, std::string_view name,
+                             const std::string& source)
+{
+    bench_gc(name, source, {});
+}
+
+// Slices of major collections aim at a millisecond.
+void bench_gc_incremental(const options&, std::string_view name,
+                          const std::string& source)
+{
+    bench_gc(name, source, std::chrono::milliseconds{1});
+}
+
+// Keeps lookup results alive.
+volatile std::size_t lookup_sink;
+
+// Looks every identifier up in a clox::table keyed by interned strings, the
+// way the vm does.
+void bench_table(const options& opts, std::string_view name,
+                 const std::string& source)
+{
+    clox::table<std::monostate>     strings;
+    clox::table<std::size_t>        tab;
+    std::vector<const clox::obj_string*> lookups;
+    for (const auto& id : identifiers(source))
+    {
+        const auto* key = strings.find_key(id, clox::hash_string(id));
+        if (key == nullptr)
+        {
+            auto str = std::make_shared<clox::obj_string>(id);
+            strings.insert_or_assign(str, {});
+            tab.insert_or_assign(str, tab.size());
+            key = strings.find_key(id, clox::hash_string(id));
+        }
+        lookups.push_back(key->get());
+    }
+    report(name, "lookups",
+           measure(opts.min_time,
+                   [&]
+                   {
+                       std::size_t sum = 0;
+                       for (const auto* key : lookups)
+                       {
+                           sum += *tab.find(*key);
+                       }
+                       lookup_sink = sum;
+                       return lookups.size();
+                   }));
+}
+
+// The same lookups in the std::unordered_map the vm used before.
+void bench_unordered_map(const options& opts, std::string_view name,
+                         const std::string& source)
+{
+    std::unordered_map<std::string, std::size_t> map;
+    const auto                                   lookups = identifiers(source);
+    for (const auto& id : lookups)
+    {
+        map.try_emplace(id, map.size());
+    }
+    report(name, "lookups",
+           measure(opts.min_time,
+                   [&]
+                   {
+                       std::size_t sum = 0;
+                       for (const auto& key : lookups)
+                       {
+                           sum += map.find(key)->second;
+                       }
+                       lookup_sink = sum;
+                       return lookups.size();
+                   }));
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg{argv[i]};
+        if (arg == "--filter" && i + 1 < argc)
+        {
+            opts.filter = argv[++i];
+        }
+        else if (arg == "--min-time" && i + 1 < argc)
+        {
+            opts.min_time = std::strtod(argv[++i], nullptr);
+        }
+        else
+        {
+            std::cerr << "Usage: clox_bench [--filter <substring>] "
+                         "[--min-time <seconds>]"
+                      << std::endl;
+            return 64;
+        }
+    }
+
+    using bench_fn = void (*)(const options&, std::string_view,
+                              const std::string&);
+    struct entry
+    {
+        std::string_view name;
+        bench_fn         fn;
+        std::string      source;
+    };
+    const entry benchmarks[] = {
+        {"scanner/huge_expression", bench_scanner,
+         clox::bench::huge_expression(20000)},
+        {"scanner/string_concat", bench_scanner,
+         clox::bench::string_concat(20000)},
+        {"compiler/flat_arithmetic", bench_compiler,
+         clox::bench::flat_arithmetic(250)},
+        {"compiler/deep_arithmetic", bench_compiler,
+         clox::bench::deep_arithmetic(120)},
+        {"compiler/string_concat", bench_compiler,
+         clox::bench::string_concat(250)},
+        {"vm/flat_arithmetic", bench_stack_vm,
+         clox::bench::flat_arithmetic(250)},
+        {"vm/deep_arithmetic", bench_stack_vm,
+         clox::bench::deep_arithmetic(120)},
+        {"vm/string_concat", bench_stack_vm, clox::bench::string_concat(250)},
+        {"vm/global_updates", bench_stack_vm,
+         clox::bench::global_updates(250)},
+        {"vm/local_updates", bench_stack_vm, clox::bench::local_updates(250)},
+        {"vm/counted_loop", bench_stack_vm, clox::bench::counted_loop(10000)},
+        {"vm/while_loop", bench_stack_vm, clox::bench::while_loop(10000)},
+        {"vm/recursive_fib", bench_stack_vm, clox::bench::recursive_fib(18)},
+        {"vm/tail_calls", bench_stack_vm, clox::bench::tail_calls(10000)},
+        {"vm/native_calls", bench_stack_vm, clox::bench::native_calls(10000)},
+        {"vm/closure_calls", bench_stack_vm, clox::bench::closure_calls(1000)},
+        {"vm/property_access", bench_stack_vm,
+         clox::bench::property_access(10000)},
+        {"vm/method_calls", bench_stack_vm, clox::bench::method_calls(10000)},
+        {"vm/object_model", bench_stack_vm, clox::bench::object_model(40)},
+        {"vm/map_lookups", bench_stack_vm, clox::bench::map_lookups(10000)},
+        {"vm/array_loop", bench_stack_vm, clox::bench::array_loop(10000)},
+        {"vm/array_kernels", bench_stack_vm,
+         clox::bench::array_kernels(10000)},
+        {"vm/cyclic_garbage", bench_stack_vm,
+         clox::bench::cyclic_garbage(10000)},
+        {"vm/string_slices", bench_stack_vm,
+         clox::bench::string_slices(5000)},
+        {"gc/stop_the_world", bench_gc_stop_the_world,
+         clox::bench::large_heap(4000, 2000)},
+        {"gc/incremental", bench_gc_incremental,
+         clox::bench::large_heap(4000, 2000)},
+        {"table/global_updates", bench_table,
+         clox::bench::global_updates(250)},
+        {"table/object_model", bench_table, clox::bench::object_model(40)},
+        {"unordered_map/global_updates", bench_unordered_map,
+         clox::bench::global_updates(250)},
+        {"unordered_map/object_model", bench_unordered_map,
+         clox::bench::object_model(40)},
+        {"vm_register/flat_arithmetic", bench_register_vm,
+         clox::bench::flat_arithmetic(250)},
+        {"vm_register/deep_arithmetic", bench_register_vm,
+         clox::bench::deep_arithmetic(120)},
+        {"vm_register/string_concat", bench_register_vm,
+         clox::bench::string_concat(250)},
+    };
+    for (const auto& bench : benchmarks)
+    {
+        if (bench.name.find(opts.filter) != std::string_view::npos)
+        {
+            bench.fn(opts, bench.name, bench.source);
+        }
+    }
+    return 0;
+}
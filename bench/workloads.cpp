@@ -0,0 +1,289 @@
+#include "workloads.hpp"
+
+#include <format>
+
+namespace clox::bench
+{
+static constexpr const char* OPERATORS[] = {" + ", " - ", " * ", " / "};
+
+std::string huge_expression(std::size_t lines)
+{
+    std::string source;
+    for (std::size_t i = 0; i < lines; ++i)
+    {
+        source += std::format(
+            "({} * {} - {}) / {} > {} == !nil and \"line{}\" + \"x\"\n", i,
+            i + 1, i % 7, i % 13 + 1, i / 3, i);
+    }
+    return source;
+}
+
+std::string flat_arithmetic(std::size_t terms)
+{
+    std::string source;
+    for (std::size_t i = 0; i < terms; ++i)
+    {
+        if (i != 0)
+        {
+            source += OPERATORS[i % 4];
+        }
+        source += std::format("{}", i + 1);
+    }
+    return source;
+}
+
+std::string deep_arithmetic(std::size_t depth)
+{
+    std::string source(depth, '(');
+    source += "1";
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        source += std::format("{}{})", OPERATORS[i % 4], i + 2);
+    }
+    return source;
+}
+
+std::string string_concat(std::size_t parts)
+{
+    std::string source;
+    for (std::size_t i = 0; i < parts; ++i)
+    {
+        if (i != 0)
+        {
+            source += " + ";
+        }
+        source += std::format("\"s{}\"", i);
+    }
+    return source;
+}
+
+static std::string updates(std::size_t statements)
+{
+    std::string source = "var a = 0; var b = 1; var c = 2; var d = 3;\n";
+    for (std::size_t i = 0; i < statements; ++i)
+    {
+        const char x = static_cast<char>('a' + i % 4);
+        const char y = static_cast<char>('a' + (i + 1) % 4);
+        source += std::format("{} = {} + {};\n", x, x, y);
+    }
+    return source;
+}
+
+std::string global_updates(std::size_t statements)
+{
+    return updates(statements) + "a + b + c + d";
+}
+
+std::string local_updates(std::size_t statements)
+{
+    return "{\n" + updates(statements) + "print a + b + c + d;\n}";
+}
+
+std::string counted_loop(std::size_t iterations)
+{
+    return std::format("var sum = 0;\n"
+                       "for (var i = 0; i < {}; i = i + 1) sum = sum + i;\n"
+                       "sum",
+                       iterations);
+}
+
+std::string recursive_fib(std::size_t n)
+{
+    return std::format("fun fib(n) {{\n"
+                       "  if (n < 2) return n;\n"
+                       "  return fib(n - 2) + fib(n - 1);\n"
+                       "}}\n"
+                       "fib({})",
+                       n);
+}
+
+std::string tail_calls(std::size_t iterations)
+{
+    return std::format("fun count(n, acc) {{\n"
+                       "  if (n == 0) return acc;\n"
+                       "  return count(n - 1, acc + n);\n"
+                       "}}\n"
+                       "count({}, 0)",
+                       iterations);
+}
+
+std::string native_calls(std::size_t iterations)
+{
+    return std::format("var sum = 0;\n"
+                       "for (var i = 0; i < {}; i = i + 1)\n"
+                       "  sum = sum + abs(-i) + min(i, 1);\n"
+                       "sum",
+                       iterations);
+}
+
+std::string closure_calls(std::size_t iterations)
+{
+    return std::format("fun adder(k) {{\n"
+                       "  fun add(x) {{ return x + k; }}\n"
+                       "  return add;\n"
+                       "}}\n"
+                       "fun apply(f, n) {{\n"
+                       "  var sum = 0;\n"
+                       "  for (var i = 0; i < n; i = i + 1) sum = f(sum);\n"
+                       "  return sum;\n"
+                       "}}\n"
+                       "var total = 0;\n"
+                       "for (var i = 0; i < {}; i = i + 1)\n"
+                       "  total = total + apply(adder(i), 10);\n"
+                       "total",
+                       iterations);
+}
+
+std::string property_access(std::size_t iterations)
+{
+    return std::format("class Point {{\n"
+                       "  init(x, y) {{ this.x = x; this.y = y; }}\n"
+                       "}}\n"
+                       "var p = Point(0, 0);\n"
+                       "for (var i = 0; i < {}; i = i + 1)\n"
+                       "  p.x = p.x + p.y + 1;\n"
+                       "p.x",
+                       iterations);
+}
+
+std::string method_calls(std::size_t iterations)
+{
+    return std::format("class Counter {{\n"
+                       "  init() {{ this.n = 0; }}\n"
+                       "  add(k) {{ this.n = this.n + k; return this; }}\n"
+                       "}}\n"
+                       "var c = Counter();\n"
+                       "for (var i = 0; i < {}; i = i + 1) c.add(i).add(1);\n"
+                       "c.n",
+                       iterations);
+}
+
+std::string map_lookups(std::size_t iterations)
+{
+    return std::format("var names = {{}};\n"
+                       "for (var i = 0; i < 64; i = i + 1) {{\n"
+                       "  names[str(i)] = i;\n"
+                       "  names[i] = i;\n"
+                       "}}\n"
+                       "var hits = 0;\n"
+                       "for (var i = 0; i < {}; i = i + 1) {{\n"
+                       "  hits = hits + names[\"17\"] + names[i - i + 42];\n"
+                       "  names[\"x\"] = i;\n"
+                       "}}\n"
+                       "hits",
+                       iterations);
+}
+
+std::string array_loop(std::size_t size)
+{
+    return std::format("var a = array({0});\n"
+                       "for (var i = 0; i < {0}; i = i + 1) a[i] = i;\n"
+                       "var total = 0;\n"
+                       "for (var pass = 0; pass < 10; pass = pass + 1)\n"
+                       "  for (var i = 0; i < {0}; i = i + 1)\n"
+                       "    total = total + a[i] * a[i];\n"
+                       "total",
+                       size);
+}
+
+std::string array_kernels(std::size_t size)
+{
+    return std::format("var a = array({0});\n"
+                       "for (var i = 0; i < {0}; i = i + 1) a[i] = i;\n"
+                       "var total = 0;\n"
+                       "for (var pass = 0; pass < 10; pass = pass + 1)\n"
+                       "  total = total + dot(a, a);\n"
+                       "total",
+                       size);
+}
+
+std::string string_slices(std::size_t words)
+{
+    std::string input;
+    for (std::size_t i = 0; i < words; ++i)
+    {
+        input += std::format("w{:04} ", i % 10000);
+    }
+    return std::format("var rest = \"{}\";\n"
+                       "var count = 0;\n"
+                       "while (len(rest) > 0) {{\n"
+                       "  var word = substr(rest, 0, 5);\n"
+                       "  if (word != \"w0000\") count = count + 1;\n"
+                       "  rest = substr(rest, 6, len(rest) - 6);\n"
+                       "}}\n"
+                       "count",
+                       input);
+}
+
+std::string cyclic_garbage(std::size_t iterations)
+{
+    return std::format("class Node {{}}\n"
+                       "fun pair(i) {{\n"
+                       "  var a = Node(); var b = Node();\n"
+                       "  a.next = b; b.next = a; a.value = i;\n"
+                       "  fun self() {{ return self; }}\n"
+                       "  return a.value;\n"
+                       "}}\n"
+                       "var sum = 0;\n"
+                       "for (var i = 0; i < {}; i = i + 1)\n"
+                       "  sum = sum + pair(i);\n"
+                       "sum",
+                       iterations);
+}
+
+std::string large_heap(std::size_t rings, std::size_t kept)
+{
+    return std::format("class Node {{}}\n"
+                       "var rings = {{}};\n"
+                       "for (var i = 0; i < {}; i = i + 1) {{\n"
+                       "  var first = Node(); var last = first;\n"
+                       "  for (var j = 1; j < 1000; j = j + 1) {{\n"
+                       "    var node = Node(); node.next = last; last = node;\n"
+                       "  }}\n"
+                       "  first.next = last;\n"
+                       "  rings[i] = last;\n"
+                       "  if (i >= {}) delete(rings, i - {});\n"
+                       "}}\n"
+                       "len(rings)",
+                       rings, kept, kept);
+}
+
+std::string object_model(std::size_t classes)
+{
+    static constexpr const char* FIELDS[] = {"x",    "y",     "name", "value",
+                                             "next", "count", "left", "right"};
+    std::string source;
+    for (std::size_t i = 0; i < classes; ++i)
+    {
+        source += std::format("class Node{} {{\n  init(v) {{\n", i);
+        for (std::size_t j = 0; j <= i % 8; ++j)
+        {
+            source += std::format("    this.{} = v;\n", FIELDS[j]);
+        }
+        source += std::format("  }}\n"
+                              "  get{}() {{ return this.{}; }}\n"
+                              "}}\n"
+                              "var node{} = Node{}({});\n",
+                              i, FIELDS[i % 8], i, i, i);
+    }
+    source += "var total = 0;\n";
+    for (std::size_t i = 0; i < classes; ++i)
+    {
+        source += std::format("total = total + node{}.get{}() + node{}.x;\n",
+                              i, i, i);
+    }
+    return source + "total";
+}
+
+std::string while_loop(std::size_t iterations)
+{
+    return std::format("var sum = 0;\n"
+                       "{{\n"
+                       "var i = 0;\n"
+                       "while (i < {}) {{ sum = sum + i; i = i + 1; }}\n"
+                       "}}\n"
+                       "sum",
+                       iterations);
+}
+
+}  // namespace clox::bench
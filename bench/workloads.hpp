@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Generators for synthetic Lox sources used by clox_bench. All of them are
+// deterministic so numbers stay comparable between commits.
+namespace clox::bench
+{
+// Many lines of mixed arithmetic, comparisons and literals. Only meant for
+// the scanner: it is not limited by the per-chunk constant table.
+std::string huge_expression(std::size_t lines);
+
+// A flat arithmetic expression with 'terms' number literals.
+std::string flat_arithmetic(std::size_t terms);
+
+// '(((1 + 2) * 3) - 4) ...' nested 'depth' levels deep.
+std::string deep_arithmetic(std::size_t depth);
+
+// '"s0" + "s1" + ...' with 'parts' string literals.
+std::string string_concat(std::size_t parts);
+
+// 'statements' assignments that read and write a handful of globals.
+std::string global_updates(std::size_t statements);
+
+// The same updates on block-scoped locals.
+std::string local_updates(std::size_t statements);
+
+// A counted for loop summing 'iterations' numbers.
+std::string counted_loop(std::size_t iterations);
+
+// The same sum as a while loop with an explicit condition and increment.
+std::string while_loop(std::size_t iterations);
+
+// Naive recursive fibonacci of 'n': call and return heavy.
+std::string recursive_fib(std::size_t n);
+
+// A loop of 'iterations' calls in tail position.
+std::string tail_calls(std::size_t iterations);
+
+// A counted loop making 'iterations' calls to natives.
+std::string native_calls(std::size_t iterations);
+
+// Creates 'iterations' closures, each called ten times from another function.
+std::string closure_calls(std::size_t iterations);
+
+// A counted loop reading and writing instance fields.
+std::string property_access(std::size_t iterations);
+
+// A counted loop making two method calls per iteration.
+std::string method_calls(std::size_t iterations);
+
+// Reads and writes a map of 64 string and 64 number keys through
+// OP_INDEX_GET/SET.
+std::string map_lookups(std::size_t iterations);
+
+// Fills an array of 'size' numbers, then take its dot product with itself
+// ten times: element by element in Lox, or with the dot() native.
+std::string array_loop(std::size_t size);
+std::string array_kernels(std::size_t size);
+
+// Splits a literal of 'words' words by slicing off the rest of the input
+// after each one, which is linear only if slices do not copy.
+std::string string_slices(std::size_t words);
+
+// Calls a function 'iterations' times that leaves two instances and a
+// closure in reference cycles, for the cycle collector to free.
+std::string cyclic_garbage(std::size_t iterations);
+
+// Builds 'rings' rings of 1000 instances and keeps the last 'kept' of them
+// in a map, so that the heap holds 'kept' thousand objects while old rings
+// keep becoming garbage.
+std::string large_heap(std::size_t rings, std::size_t kept);
+
+// Declares 'classes' classes with up to eight fields and a getter each,
+// then reads every instance. Its identifiers double as a key set for the
+// table benchmarks.
+std::string object_model(std::size_t classes);
+
+}  // namespace clox::bench
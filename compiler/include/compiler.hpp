@@ -10,12 +10,99 @@
 
 namespace clox
 {
+// What the compiler can prove about the value of an expression.
+enum class StaticType
+{
+    UNKNOWN,
+    NUMBER,  // Integer or double.
+    DOUBLE,
+    BOOL,
+    STRING,
+    NIL,
+};
+
 class compiler
 {
+    // Where an instruction naming a captured variable sits, so it can be
+    // switched to its flat form.
+    struct capture_site
+    {
+        std::size_t chunk;  // Index in 'chunks_'.
+        std::size_t offset;
+    };
+
+    // A local variable lives in the frame slot matching its index in
+    // 'function_state::locals'. 'depth' is -1 until its initializer has been
+    // compiled. A captured local that is never assigned is copied into its
+    // closures rather than boxed.
+    struct local
+    {
+        std::string_view          name;
+        int                       depth;
+        bool                      captured = false;
+        bool                      assigned = false;
+        std::vector<capture_site> sites    = {};
+    };
+
+    // A variable of an enclosing function, captured either from the
+    // enclosing frame's slot 'index' or from its own capture 'index'.
+    // 'level' and 'local' locate the variable's declaration.
+    struct upvalue
+    {
+        std::uint8_t index;
+        bool         is_local;
+        std::size_t  level;  // Index in 'functions_'.
+        std::size_t  local;
+    };
+
+    enum class FunctionType
+    {
+        SCRIPT,
+        FUNCTION,
+        METHOD,  // Slot 0 holds the receiver, named 'this'.
+        INITIALIZER,
+    };
+
+    // The function being compiled. Each one fills a chunk of its own;
+    // slot 0 of a function's frame is reserved for the callee.
+    struct function_state
+    {
+        FunctionType       type;
+        std::size_t        chunk;  // Index in 'chunks_'.
+        std::vector<local>   locals      = {};
+        std::vector<upvalue> upvalues    = {};
+        int                  scope_depth = 0;
+        // Offset of the last call or invoke, to spot calls in tail
+        // position.
+        std::optional<std::size_t> last_call = std::nullopt;
+    };
+
+    // The class whose body is being compiled.
+    struct class_state
+    {
+        bool has_superclass = false;
+    };
+
+    // Limit of a counted for loop, in OP_FOR_LOOP operand form.
+    struct loop_bound
+    {
+        std::uint8_t limit;
+        std::uint8_t flags;
+    };
+
     scanner scanner_;
     parser  parser_;
 
-    std::vector<chunk> chunks_;
+    std::vector<chunk>          chunks_;
+    // Innermost function last; the script is at the bottom.
+    std::vector<function_state> functions_;
+    // Innermost class last.
+    std::vector<class_state>    classes_;
+    // Type of the expression compiled last.
+    StaticType last_type_ = StaticType::UNKNOWN;
+    // Whether the prefix expression being parsed may be an assignment
+    // target.
+    bool       can_assign_ = false;
 
     static parse_rule rules_[];
 
@@ -26,7 +113,40 @@ class compiler
   private:
     void              advance();
     void              consume(TokenType type, std::string_view message);
+    bool              check(TokenType type) const;
+    bool              match(TokenType type);
+    void              synchronize();
+    // Only a top-level expression statement may be the script's result.
+    void              declaration(bool top_level = false);
+    void              class_declaration();
+    void              method();
+    void              fun_declaration();
+    void              function(FunctionType type, std::string_view name);
+    void              var_declaration();
+    void              statement(bool top_level = false);
+    void              if_statement();
+    void              while_statement();
+    void              for_statement();
+    std::optional<loop_bound> match_loop_condition(std::size_t  start,
+                                                   std::uint8_t counter);
+    bool              is_counter_increment(std::size_t  start,
+                                           std::uint8_t counter);
+    void              block();
+    void              begin_scope();
+    void              end_scope();
+    void              declare_local(std::string_view name);
+    int               resolve_local(std::size_t level, std::string_view name);
+    int               resolve_upvalue(std::size_t level, std::string_view name);
+    int               add_upvalue(std::size_t level, const upvalue& capture);
+    // Switches the captures of 'var' to their flat forms if it was never
+    // assigned; call once its scope is over.
+    void              finish_local(const local& var);
+    void              return_statement();
+    void              print_statement();
+    void              expression_statement(bool top_level);
     void              expression();
+    void              variable();
+    void              named_variable(std::string_view name, bool can_assign);
     void              number();
     void              string();
     void              unary();
@@ -35,15 +155,43 @@ class compiler
     void              end_compiler();
     void              grouping();
     void              binary();
+    void              emit_numeric_binary(TokenType operator_type);
+    static StaticType binary_type(TokenType operator_type, StaticType left,
+                                  StaticType right);
+    // Whether the generic instruction for the operands converts them to
+    // doubles, so that the double form can replace it.
+    static bool       computes_in_doubles(TokenType  operator_type,
+                                          StaticType left,
+                                          StaticType right);
     void              literal();
+    void              and_();
+    void              or_();
+    void              call();
+    void              dot();
+    void              index();
+    void              map_literal();
+    void              this_();
+    void              super_();
+    std::uint8_t      argument_list();
 
     template <class... Args>
     void      emit_bytes(Args... bytes);
     void      emit_return();
+    void      emit_implicit_return();
     void      emit_constant(ValueType val);
     std::byte make_constant(ValueType val);
+    void      emit_global(OpCode op, std::string_view name);
+    // Returns a new property site of the current chunk for 'name'.
+    std::uint16_t add_property(std::string_view name);
+    void          emit_property(OpCode op, std::uint16_t site);
+    // Returns the offset of the jump's operand, for patch_jump.
+    std::size_t emit_jump(OpCode op);
+    void        patch_jump(std::size_t offset);
+    void        emit_loop(std::size_t loop_start);
 
-    chunk& current_chunk();
+    chunk&          current_chunk();
+    function_state& current_function();
+    local&          declaration_of(const upvalue& capture);
 };
 
 }  // namespace clox
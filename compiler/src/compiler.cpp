@@ -2,26 +2,50 @@
 
 #include <format>
 #include <limits>
+#include <memory>
 
 #include "chunk.hpp"
 #include "debug.hpp"
+#include "object.hpp"
 #include "rules.hpp"
 #include "scanner.hpp"
 
 namespace clox
 {
+// The form of a call instruction that replaces the caller's frame.
+static std::optional<OpCode> tail_call_form(OpCode op)
+{
+    switch (op)
+    {
+        case OpCode::OP_CALL:
+            return OpCode::OP_TAIL_CALL;
+        case OpCode::OP_INVOKE:
+            return OpCode::OP_TAIL_INVOKE;
+        case OpCode::OP_SUPER_INVOKE:
+            return OpCode::OP_TAIL_SUPER_INVOKE;
+        default:
+            return std::nullopt;
+    }
+}
 
 parse_rule compiler::rules_[] = {
-    [static_cast<int>(TokenType::LEFT_PAREN)]  = {&compiler::grouping, nullptr,
-                                                  Precedence::NONE},
+    [static_cast<int>(TokenType::LEFT_PAREN)]  = {&compiler::grouping,
+                                                  &compiler::call,
+                                                  Precedence::CALL},
     [static_cast<int>(TokenType::RIGHT_PAREN)] = {nullptr, nullptr,
                                                   Precedence::NONE},
-    [static_cast<int>(TokenType::LEFT_BRACE)]  = {nullptr, nullptr,
-                                                  Precedence::NONE},
+    [static_cast<int>(TokenType::LEFT_BRACE)]  = {&compiler::map_literal,
+                                                  nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::RIGHT_BRACE)] = {nullptr, nullptr,
                                                   Precedence::NONE},
+    [static_cast<int>(TokenType::LEFT_BRACKET)]  = {nullptr, &compiler::index,
+                                                    Precedence::CALL},
+    [static_cast<int>(TokenType::RIGHT_BRACKET)] = {nullptr, nullptr,
+                                                    Precedence::NONE},
+    [static_cast<int>(TokenType::COLON)] = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::COMMA)] = {nullptr, nullptr, Precedence::NONE},
-    [static_cast<int>(TokenType::DOT)]   = {nullptr, nullptr, Precedence::NONE},
+    [static_cast<int>(TokenType::DOT)]   = {nullptr, &compiler::dot,
+                                            Precedence::CALL},
     [static_cast<int>(TokenType::MINUS)] = {&compiler::unary, &compiler::binary,
                                             Precedence::TERM},
     [static_cast<int>(TokenType::PLUS)]  = {nullptr, &compiler::binary,
@@ -35,7 +59,7 @@ parse_rule compiler::rules_[] = {
     [static_cast<int>(TokenType::BANG)]       = {&compiler::unary, nullptr,
                                                  Precedence::NONE},
     [static_cast<int>(TokenType::BANG_EQUAL)] = {nullptr, &compiler::binary,
-                                                 Precedence::NONE},
+                                                 Precedence::EQUALITY},
     [static_cast<int>(TokenType::EQUAL)] = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::EQUAL_EQUAL)]   = {nullptr, &compiler::binary,
                                                     Precedence::EQUALITY},
@@ -47,13 +71,14 @@ parse_rule compiler::rules_[] = {
                                                     Precedence::COMPARISON},
     [static_cast<int>(TokenType::LESS_EQUAL)]    = {nullptr, &compiler::binary,
                                                     Precedence::COMPARISON},
-    [static_cast<int>(TokenType::IDENTIFIER)]    = {nullptr, nullptr,
-                                                    Precedence::NONE},
+    [static_cast<int>(TokenType::IDENTIFIER)]    = {&compiler::variable,
+                                                    nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::STRING)]        = {&compiler::string, nullptr,
                                                     Precedence::NONE},
     [static_cast<int>(TokenType::NUMBER)]        = {&compiler::number, nullptr,
                                                     Precedence::NONE},
-    [static_cast<int>(TokenType::AND)]   = {nullptr, nullptr, Precedence::NONE},
+    [static_cast<int>(TokenType::AND)]   = {nullptr, &compiler::and_,
+                                            Precedence::AND},
     [static_cast<int>(TokenType::CLASS)] = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::ELSE)]  = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::FALSE)] = {&compiler::literal, nullptr,
@@ -63,12 +88,15 @@ parse_rule compiler::rules_[] = {
     [static_cast<int>(TokenType::IF)]    = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::NIL)]   = {&compiler::literal, nullptr,
                                             Precedence::NONE},
-    [static_cast<int>(TokenType::OR)]    = {nullptr, nullptr, Precedence::NONE},
+    [static_cast<int>(TokenType::OR)]    = {nullptr, &compiler::or_,
+                                            Precedence::OR},
     [static_cast<int>(TokenType::PRINT)] = {nullptr, nullptr, Precedence::NONE},
     [static_cast<int>(TokenType::RETURN)] = {nullptr, nullptr,
                                              Precedence::NONE},
-    [static_cast<int>(TokenType::SUPER)] = {nullptr, nullptr, Precedence::NONE},
-    [static_cast<int>(TokenType::THIS)]  = {nullptr, nullptr, Precedence::NONE},
+    [static_cast<int>(TokenType::SUPER)] = {&compiler::super_, nullptr,
+                                            Precedence::NONE},
+    [static_cast<int>(TokenType::THIS)]  = {&compiler::this_, nullptr,
+                                            Precedence::NONE},
     [static_cast<int>(TokenType::TRUE)]  = {&compiler::literal, nullptr,
                                             Precedence::NONE},
     [static_cast<int>(TokenType::VAR)]   = {nullptr, nullptr, Precedence::NONE},
@@ -82,12 +110,15 @@ compiler::compiler(std::string source) : scanner_(std::move(source)) {}
 std::optional<std::vector<chunk>> compiler::compile()
 {
     chunks_.emplace_back();
+    functions_.push_back({FunctionType::SCRIPT, 0});
     parser_.had_error  = false;
     parser_.panic_mode = false;
 
     advance();
-    expression();
-    consume(TokenType::EOF_, "Expect end of expression.");
+    while (!match(TokenType::EOF_))
+    {
+        declaration(true);
+    }
     end_compiler();
     if (parser_.had_error)
     {
@@ -127,19 +158,733 @@ void compiler::consume(TokenType type, std::string_view message)
     parser_.error_at_current(message);
 }
 
+bool compiler::check(TokenType type) const
+{
+    return parser_.current.type == type;
+}
+
+bool compiler::match(TokenType type)
+{
+    if (!check(type))
+    {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+// Skips tokens until a likely statement boundary so that one error does not
+// cascade into many.
+void compiler::synchronize()
+{
+    parser_.panic_mode = false;
+    while (!check(TokenType::EOF_))
+    {
+        if (parser_.previous.type == TokenType::SEMICOLON)
+        {
+            return;
+        }
+        switch (parser_.current.type)
+        {
+            case TokenType::CLASS:
+            case TokenType::FUN:
+            case TokenType::VAR:
+            case TokenType::FOR:
+            case TokenType::IF:
+            case TokenType::WHILE:
+            case TokenType::PRINT:
+            case TokenType::RETURN:
+                return;
+            default:
+                advance();
+        }
+    }
+}
+
+void compiler::declaration(bool top_level)
+{
+    if (match(TokenType::CLASS))
+    {
+        class_declaration();
+    }
+    else if (match(TokenType::FUN))
+    {
+        fun_declaration();
+    }
+    else if (match(TokenType::VAR))
+    {
+        var_declaration();
+    }
+    else
+    {
+        statement(top_level);
+    }
+    if (parser_.panic_mode)
+    {
+        synchronize();
+    }
+}
+
+void compiler::class_declaration()
+{
+    consume(TokenType::IDENTIFIER, "Expect class name.");
+    const auto name  = parser_.previous.lexeme;
+    auto&      scope = current_function();
+    if (scope.scope_depth > 0)
+    {
+        declare_local(name);
+        scope.locals.back().depth = scope.scope_depth;
+    }
+    emit_bytes(OpCode::OP_CLASS,
+               make_constant(std::make_shared<obj_string>(std::string{name})));
+    if (scope.scope_depth == 0)
+    {
+        emit_global(OpCode::OP_DEFINE_GLOBAL, name);
+    }
+
+    classes_.push_back({});
+    if (match(TokenType::LESS))
+    {
+        consume(TokenType::IDENTIFIER, "Expect superclass name.");
+        if (parser_.previous.lexeme == name)
+        {
+            parser_.error("A class can't inherit from itself.");
+        }
+        named_variable(parser_.previous.lexeme, false);
+        // The superclass stays in a local that methods capture as 'super'.
+        begin_scope();
+        declare_local("super");
+        current_function().locals.back().depth = scope.scope_depth;
+        named_variable(name, false);
+        emit_bytes(OpCode::OP_INHERIT);
+        classes_.back().has_superclass = true;
+    }
+    named_variable(name, false);
+    consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+    while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::EOF_))
+    {
+        method();
+    }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
+    emit_bytes(OpCode::OP_POP);
+    if (classes_.back().has_superclass)
+    {
+        end_scope();
+    }
+    classes_.pop_back();
+}
+
+void compiler::method()
+{
+    consume(TokenType::IDENTIFIER, "Expect method name.");
+    const auto name     = parser_.previous.lexeme;
+    const auto constant =
+        make_constant(std::make_shared<obj_string>(std::string{name}));
+    function(name == "init" ? FunctionType::INITIALIZER : FunctionType::METHOD,
+             name);
+    emit_bytes(OpCode::OP_METHOD, constant);
+}
+
+void compiler::fun_declaration()
+{
+    consume(TokenType::IDENTIFIER, "Expect function name.");
+    const auto name  = parser_.previous.lexeme;
+    auto&      scope = current_function();
+    if (scope.scope_depth > 0)
+    {
+        declare_local(name);
+        // The function may call itself, so it is initialized right away.
+        scope.locals.back().depth = scope.scope_depth;
+    }
+    function(FunctionType::FUNCTION, name);
+    if (current_function().scope_depth == 0)
+    {
+        emit_global(OpCode::OP_DEFINE_GLOBAL, name);
+    }
+}
+
+// Compiles the parameters and body into a chunk of their own and emits the
+// function object as a constant.
+void compiler::function(FunctionType type, std::string_view name)
+{
+    if (chunks_.size() > std::numeric_limits<std::uint16_t>::max())
+    {
+        parser_.error("Too many functions.");
+    }
+    chunks_.emplace_back();
+    functions_.push_back({type, chunks_.size() - 1});
+    // Slot 0 holds the callee, or the receiver of a method.
+    current_function().locals.push_back(
+        {type == FunctionType::FUNCTION ? "" : "this", 0});
+    begin_scope();
+
+    consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
+    int arity = 0;
+    if (!check(TokenType::RIGHT_PAREN))
+    {
+        do
+        {
+            if (++arity > std::numeric_limits<std::uint8_t>::max())
+            {
+                parser_.error_at_current(
+                    "Can't have more than 255 parameters.");
+            }
+            consume(TokenType::IDENTIFIER, "Expect parameter name.");
+            declare_local(parser_.previous.lexeme);
+            auto& scope               = current_function();
+            scope.locals.back().depth = scope.scope_depth;
+        } while (match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+    block();
+    // Returning discards the whole frame and closes its captured variables,
+    // so the scope needs no end_scope.
+    emit_implicit_return();
+    for (const auto& var : current_function().locals)
+    {
+        finish_local(var);
+    }
+#ifdef DEBUG_PRINT_CODE
+    if (!parser_.had_error)
+    {
+        debug::disassemble_chunk(current_chunk(), name);
+    }
+#endif
+
+    const auto chunk    = functions_.back().chunk;
+    const auto upvalues = std::move(functions_.back().upvalues);
+    functions_.pop_back();
+    auto fn = std::make_shared<obj_function>(
+        std::string{name}, static_cast<std::uint8_t>(arity),
+        static_cast<std::uint16_t>(chunk),
+        static_cast<std::uint8_t>(upvalues.size()));
+    last_type_ = StaticType::UNKNOWN;
+    // A function that captures nothing needs no closure object.
+    if (upvalues.empty())
+    {
+        emit_constant(std::move(fn));
+        return;
+    }
+    emit_bytes(OpCode::OP_CLOSURE, make_constant(std::move(fn)));
+    for (const auto& capture : upvalues)
+    {
+        if (capture.is_local)
+        {
+            current_function().locals[capture.index].sites.push_back(
+                {functions_.back().chunk, current_chunk().size()});
+            emit_bytes(OpCode::OP_CAPTURE_LOCAL, capture.index);
+        }
+        else
+        {
+            emit_bytes(OpCode::OP_CAPTURE_UPVALUE, capture.index);
+        }
+    }
+}
+
+void compiler::var_declaration()
+{
+    consume(TokenType::IDENTIFIER, "Expect variable name.");
+    const auto name = parser_.previous.lexeme;
+    if (current_function().scope_depth > 0)
+    {
+        declare_local(name);
+    }
+    if (match(TokenType::EQUAL))
+    {
+        expression();
+    }
+    else
+    {
+        emit_bytes(OpCode::OP_NIL);
+    }
+    consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+    auto& scope = current_function();
+    if (scope.scope_depth > 0)
+    {
+        // The initializer's value already sits in the local's slot.
+        scope.locals.back().depth = scope.scope_depth;
+        return;
+    }
+    emit_global(OpCode::OP_DEFINE_GLOBAL, name);
+}
+
+void compiler::declare_local(std::string_view name)
+{
+    auto& scope = current_function();
+    for (auto it = scope.locals.rbegin();
+         it != scope.locals.rend() && it->depth >= scope.scope_depth; ++it)
+    {
+        if (it->name == name)
+        {
+            parser_.error("Already a variable with this name in this scope.");
+            return;
+        }
+    }
+    if (scope.locals.size() > std::numeric_limits<std::uint8_t>::max())
+    {
+        parser_.error("Too many local variables in function.");
+        return;
+    }
+    scope.locals.push_back({name, -1});
+}
+
+// Returns the frame slot of 'name' in the function at 'level', or -1.
+int compiler::resolve_local(std::size_t level, std::string_view name)
+{
+    const auto& locals = functions_[level].locals;
+    for (auto idx = static_cast<int>(locals.size()) - 1; idx >= 0; --idx)
+    {
+        if (locals[idx].name == name)
+        {
+            if (locals[idx].depth == -1)
+            {
+                parser_.error(
+                    "Can't read local variable in its own initializer.");
+            }
+            return idx;
+        }
+    }
+    return -1;
+}
+
+// Returns the capture index of 'name' in the function at 'level', or -1 if
+// no enclosing function declares it.
+int compiler::resolve_upvalue(std::size_t level, std::string_view name)
+{
+    if (level == 0)
+    {
+        return -1;
+    }
+    const auto local = resolve_local(level - 1, name);
+    if (local >= 0)
+    {
+        functions_[level - 1].locals[local].captured = true;
+        return add_upvalue(level, {static_cast<std::uint8_t>(local), true,
+                                   level - 1, static_cast<std::size_t>(local)});
+    }
+    const auto outer = resolve_upvalue(level - 1, name);
+    if (outer >= 0)
+    {
+        auto capture     = functions_[level - 1].upvalues[outer];
+        capture.index    = static_cast<std::uint8_t>(outer);
+        capture.is_local = false;
+        return add_upvalue(level, capture);
+    }
+    return -1;
+}
+
+int compiler::add_upvalue(std::size_t level, const upvalue& capture)
+{
+    auto& upvalues = functions_[level].upvalues;
+    for (std::size_t idx = 0; idx < upvalues.size(); ++idx)
+    {
+        if (upvalues[idx].index == capture.index &&
+            upvalues[idx].is_local == capture.is_local)
+        {
+            return static_cast<int>(idx);
+        }
+    }
+    if (upvalues.size() > std::numeric_limits<std::uint8_t>::max())
+    {
+        parser_.error("Too many closure variables in function.");
+        return 0;
+    }
+    upvalues.push_back(capture);
+    return static_cast<int>(upvalues.size() - 1);
+}
+
+void compiler::finish_local(const local& var)
+{
+    if (!var.captured || var.assigned)
+    {
+        return;
+    }
+    for (const auto& site : var.sites)
+    {
+        auto&      code = chunks_[site.chunk];
+        const auto op   = static_cast<OpCode>(
+            *code.get_instruction(static_cast<int>(site.offset)));
+        code.patch(site.offset, op == OpCode::OP_CAPTURE_LOCAL
+                                    ? OpCode::OP_CAPTURE_LOCAL_FLAT
+                                    : OpCode::OP_GET_UPVALUE_FLAT);
+    }
+}
+
+void compiler::block()
+{
+    while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::EOF_))
+    {
+        declaration();
+    }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+}
+
+void compiler::begin_scope() { ++current_function().scope_depth; }
+
+// Pops the scope's locals, batching runs of them into one instruction.
+// Boxed captured locals are closed one at a time instead.
+void compiler::end_scope()
+{
+    auto& scope = current_function();
+    --scope.scope_depth;
+    std::size_t count = 0;
+    const auto  flush = [this, &count]
+    {
+        if (count == 1)
+        {
+            emit_bytes(OpCode::OP_POP);
+        }
+        else if (count > 1)
+        {
+            emit_bytes(OpCode::OP_POPN, static_cast<std::uint8_t>(count));
+        }
+        count = 0;
+    };
+    while (!scope.locals.empty() &&
+           scope.locals.back().depth > scope.scope_depth)
+    {
+        const auto& var = scope.locals.back();
+        finish_local(var);
+        if (var.captured && var.assigned)
+        {
+            flush();
+            emit_bytes(OpCode::OP_CLOSE_UPVALUE);
+        }
+        else
+        {
+            ++count;
+        }
+        scope.locals.pop_back();
+    }
+    flush();
+}
+
+void compiler::statement(bool top_level)
+{
+    if (match(TokenType::PRINT))
+    {
+        print_statement();
+    }
+    else if (match(TokenType::IF))
+    {
+        if_statement();
+    }
+    else if (match(TokenType::WHILE))
+    {
+        while_statement();
+    }
+    else if (match(TokenType::FOR))
+    {
+        for_statement();
+    }
+    else if (match(TokenType::RETURN))
+    {
+        return_statement();
+    }
+    else if (match(TokenType::LEFT_BRACE))
+    {
+        begin_scope();
+        block();
+        end_scope();
+    }
+    else
+    {
+        expression_statement(top_level);
+    }
+}
+
+void compiler::if_statement()
+{
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+    expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+
+    const auto then_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    statement();
+    if (match(TokenType::ELSE))
+    {
+        const auto else_jump = emit_jump(OpCode::OP_JUMP);
+        patch_jump(then_jump);
+        statement();
+        patch_jump(else_jump);
+    }
+    else
+    {
+        patch_jump(then_jump);
+    }
+}
+
+void compiler::while_statement()
+{
+    const auto loop_start = current_chunk().size();
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+    expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+
+    const auto exit_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    statement();
+    emit_loop(loop_start);
+    patch_jump(exit_jump);
+}
+
+// 'for (var i = a; i < b; i = i + 1) body', where 'b' is a local or a
+// constant, compiles to one check of the condition followed by the body and
+// an OP_FOR_LOOP that increments, compares and branches in one dispatch.
+// Every other for loop gets the usual condition and increment blocks.
+void compiler::for_statement()
+{
+    begin_scope();
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+    std::optional<std::uint8_t> counter;
+    if (match(TokenType::SEMICOLON))
+    {
+        // No initializer.
+    }
+    else if (match(TokenType::VAR))
+    {
+        var_declaration();
+        counter = static_cast<std::uint8_t>(
+            current_function().locals.size() - 1);
+    }
+    else
+    {
+        expression_statement(false);
+    }
+
+    auto                      loop_start = current_chunk().size();
+    std::optional<std::size_t> exit_jump;
+    std::optional<loop_bound>  bound;
+    if (!match(TokenType::SEMICOLON))
+    {
+        expression();
+        consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+        if (counter)
+        {
+            bound = match_loop_condition(loop_start, *counter);
+        }
+        exit_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    }
+
+    bool fused = false;
+    if (!match(TokenType::RIGHT_PAREN))
+    {
+        const auto body_jump       = emit_jump(OpCode::OP_JUMP);
+        const auto increment_start = current_chunk().size();
+        expression();
+        emit_bytes(OpCode::OP_POP);
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+        if (bound && is_counter_increment(increment_start, *counter))
+        {
+            // Drop the jump and the increment: OP_FOR_LOOP does both.
+            current_chunk().truncate(body_jump - 1);
+            fused = true;
+        }
+        else
+        {
+            emit_loop(loop_start);
+            loop_start = increment_start;
+            patch_jump(body_jump);
+        }
+    }
+
+    const auto body_start = current_chunk().size();
+    statement();
+    if (fused)
+    {
+        emit_bytes(OpCode::OP_FOR_LOOP, *counter, bound->limit, bound->flags);
+        const auto offset = current_chunk().size() - body_start + 2;
+        if (offset > std::numeric_limits<std::uint16_t>::max())
+        {
+            parser_.error("Loop body too large.");
+        }
+        emit_bytes(static_cast<std::uint8_t>((offset >> 8) & 0xff),
+                   static_cast<std::uint8_t>(offset & 0xff));
+    }
+    else
+    {
+        emit_loop(loop_start);
+    }
+    if (exit_jump)
+    {
+        patch_jump(*exit_jump);
+    }
+    end_scope();
+}
+
+// Matches 'counter < limit' and 'counter <= limit' code starting at 'start'.
+std::optional<compiler::loop_bound> compiler::match_loop_condition(
+    std::size_t start, std::uint8_t counter)
+{
+    const auto& code = current_chunk();
+    const auto  at   = [&code, start](std::size_t idx)
+    { return *code.get_instruction(static_cast<int>(start + idx)); };
+    const auto op = [&at](std::size_t idx)
+    { return static_cast<OpCode>(at(idx)); };
+
+    const auto size = code.size() - start;
+    if (size < 5 || op(0) != OpCode::OP_GET_LOCAL || at(1) != counter)
+    {
+        return std::nullopt;
+    }
+    loop_bound bound{at(3), 0};
+    if (op(2) == OpCode::OP_CONSTANT)
+    {
+        bound.flags |= LOOP_LIMIT_CONST;
+    }
+    else if (op(2) != OpCode::OP_GET_LOCAL)
+    {
+        return std::nullopt;
+    }
+    if (size == 5 && op(4) == OpCode::OP_LESS)
+    {
+        return bound;
+    }
+    if (size == 6 && op(4) == OpCode::OP_GREATER && op(5) == OpCode::OP_NOT)
+    {
+        bound.flags |= LOOP_INCLUSIVE;
+        return bound;
+    }
+    return std::nullopt;
+}
+
+// Matches 'counter = counter + 1' followed by its OP_POP.
+bool compiler::is_counter_increment(std::size_t start, std::uint8_t counter)
+{
+    const auto& code = current_chunk();
+    const auto  at   = [&code, start](std::size_t idx)
+    { return *code.get_instruction(static_cast<int>(start + idx)); };
+    if (code.size() - start != 8 ||
+        static_cast<OpCode>(at(0)) != OpCode::OP_GET_LOCAL ||
+        at(1) != counter || static_cast<OpCode>(at(2)) != OpCode::OP_CONSTANT ||
+        static_cast<OpCode>(at(4)) != OpCode::OP_ADD ||
+        static_cast<OpCode>(at(5)) != OpCode::OP_SET_LOCAL ||
+        at(6) != counter || static_cast<OpCode>(at(7)) != OpCode::OP_POP)
+    {
+        return false;
+    }
+    const auto& step = code.get_constant(at(3));
+    return std::holds_alternative<std::int64_t>(step) &&
+           std::get<std::int64_t>(step) == 1;
+}
+
+// 'return f(x);' becomes a tail call: the callee takes over the frame.
+void compiler::return_statement()
+{
+    if (current_function().type == FunctionType::SCRIPT)
+    {
+        parser_.error("Can't return from top-level code.");
+    }
+    if (match(TokenType::SEMICOLON))
+    {
+        emit_implicit_return();
+        return;
+    }
+    if (current_function().type == FunctionType::INITIALIZER)
+    {
+        parser_.error("Can't return a value from an initializer.");
+    }
+    expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+    const auto last_call = current_function().last_call;
+    if (last_call)
+    {
+        const auto op = static_cast<OpCode>(
+            *current_chunk().get_instruction(static_cast<int>(*last_call)));
+        const auto tail = tail_call_form(op);
+        if (tail && *last_call + 1 + operand_size(op) == current_chunk().size())
+        {
+            current_chunk().patch(*last_call, *tail);
+        }
+    }
+    emit_bytes(OpCode::OP_RETURN);
+}
+
+void compiler::print_statement()
+{
+    expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after value.");
+    emit_bytes(OpCode::OP_PRINT);
+}
+
+// An expression that ends the script without a ';' is its result: it stays
+// on the stack for OP_RETURN to print.
+void compiler::expression_statement(bool top_level)
+{
+    expression();
+    if (top_level && check(TokenType::EOF_))
+    {
+        return;
+    }
+    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+    emit_bytes(OpCode::OP_POP);
+}
+
 void compiler::expression() { parse_precedence(Precedence::ASSIGNMENT); }
 
+void compiler::variable()
+{
+    named_variable(parser_.previous.lexeme, can_assign_);
+}
+
+void compiler::named_variable(std::string_view name, bool can_assign)
+{
+    const auto level = functions_.size() - 1;
+    const auto slot  = resolve_local(level, name);
+    const auto up    = slot < 0 ? resolve_upvalue(level, name) : -1;
+    if (can_assign && match(TokenType::EQUAL))
+    {
+        expression();
+        if (slot >= 0)
+        {
+            current_function().locals[slot].assigned = true;
+            emit_bytes(OpCode::OP_SET_LOCAL, static_cast<std::uint8_t>(slot));
+        }
+        else if (up >= 0)
+        {
+            declaration_of(current_function().upvalues[up]).assigned = true;
+            emit_bytes(OpCode::OP_SET_UPVALUE, static_cast<std::uint8_t>(up));
+        }
+        else
+        {
+            emit_global(OpCode::OP_SET_GLOBAL, name);
+        }
+        return;
+    }
+    if (slot >= 0)
+    {
+        emit_bytes(OpCode::OP_GET_LOCAL, static_cast<std::uint8_t>(slot));
+    }
+    else if (up >= 0)
+    {
+        auto& var = declaration_of(current_function().upvalues[up]);
+        var.sites.push_back({current_function().chunk, current_chunk().size()});
+        emit_bytes(OpCode::OP_GET_UPVALUE, static_cast<std::uint8_t>(up));
+    }
+    else
+    {
+        emit_global(OpCode::OP_GET_GLOBAL, name);
+    }
+    last_type_ = StaticType::UNKNOWN;
+}
+
 void compiler::number()
 {
-    const auto value = std::strtod(parser_.previous.lexeme.data(), nullptr);
+    const auto value =
+        make_number(std::strtod(parser_.previous.lexeme.data(), nullptr));
+    last_type_ = std::holds_alternative<double>(value) ? StaticType::DOUBLE
+                                                        : StaticType::NUMBER;
     emit_constant(value);
 }
 
+// Literals are slices of the source, which they keep alive with the
+// program, so no characters are copied.
 void compiler::string()
 {
     emit_constant(std::make_shared<obj_string>(
-        std::string{parser_.previous.lexeme.data() + 1,
-                    parser_.previous.lexeme.size() - 2}));
+        scanner_.source(), parser_.previous.lexeme.substr(
+                               1, parser_.previous.lexeme.size() - 2)));
+    last_type_ = StaticType::STRING;
 }
 
 void compiler::unary()
@@ -153,10 +898,18 @@ void compiler::unary()
     switch (operator_type)
     {
         case clox::TokenType::MINUS:
+            if (last_type_ == StaticType::DOUBLE)
+            {
+                emit_bytes(OpCode::OP_NEGATE_F64);
+                break;
+            }
+            // Negation either yields a number or raises a runtime error.
             emit_bytes(OpCode::OP_NEGATE);
+            last_type_ = StaticType::NUMBER;
             break;
         case clox::TokenType::BANG:
             emit_bytes(OpCode::OP_NOT);
+            last_type_ = StaticType::BOOL;
             break;
         default:
             return;  // Unreachable.
@@ -172,13 +925,21 @@ void compiler::parse_precedence(Precedence precedence)
         parser_.error("Expect expression.");
         return;
     }
+    const bool can_assign = precedence <= Precedence::ASSIGNMENT;
+    can_assign_           = can_assign;
     std::invoke(prefix_rule, this);
     while (precedence <= get_rule(parser_.current.type)->precedence)
     {
         advance();
         const auto infix_rule = get_rule(parser_.previous.type)->infix;
+        // Restored for '.': operands parsed since may have changed it.
+        can_assign_ = can_assign;
         std::invoke(infix_rule, this);
     }
+    if (can_assign && match(TokenType::EQUAL))
+    {
+        parser_.error("Invalid assignment target.");
+    }
 }
 
 const parse_rule* compiler::get_rule(TokenType type) const
@@ -197,9 +958,18 @@ void compiler::grouping()
 void compiler::binary()
 {
     const auto operator_type = parser_.previous.type;
+    const auto left_type     = last_type_;
     auto*      rule          = get_rule(operator_type);
     parse_precedence(
         static_cast<Precedence>(static_cast<int>(rule->precedence) + 1));
+    const auto right_type = last_type_;
+
+    last_type_ = binary_type(operator_type, left_type, right_type);
+    if (computes_in_doubles(operator_type, left_type, right_type))
+    {
+        emit_numeric_binary(operator_type);
+        return;
+    }
 
     switch (operator_type)
     {
@@ -238,18 +1008,268 @@ void compiler::binary()
     }
 }
 
+StaticType compiler::binary_type(TokenType operator_type, StaticType left,
+                                 StaticType right)
+{
+    // Arithmetic involving a double always produces a double.
+    const auto number =
+        left == StaticType::DOUBLE || right == StaticType::DOUBLE
+            ? StaticType::DOUBLE
+            : StaticType::NUMBER;
+    switch (operator_type)
+    {
+        case TokenType::PLUS:
+            // Only number + number and string + string get past the runtime
+            // check, so one known side decides the result.
+            if (left == StaticType::NUMBER || right == StaticType::NUMBER ||
+                number == StaticType::DOUBLE)
+            {
+                return number;
+            }
+            if (left == StaticType::STRING || right == StaticType::STRING)
+            {
+                return StaticType::STRING;
+            }
+            return StaticType::UNKNOWN;
+        case TokenType::MINUS:
+        case TokenType::STAR:
+            return number;
+        case TokenType::SLASH:
+            return StaticType::DOUBLE;
+        default:
+            return StaticType::BOOL;
+    }
+}
+
+// Integer operands keep their integer paths unless a double joins them,
+// which converts both, or they are divided, which always yields a double.
+bool compiler::computes_in_doubles(TokenType operator_type, StaticType left,
+                                   StaticType right)
+{
+    const auto numeric = [](StaticType type)
+    { return type == StaticType::NUMBER || type == StaticType::DOUBLE; };
+    if (!numeric(left) || !numeric(right))
+    {
+        return false;
+    }
+    return left == StaticType::DOUBLE || right == StaticType::DOUBLE ||
+           operator_type == TokenType::SLASH;
+}
+
+// Both operands are proven numbers: no runtime type checks needed.
+void compiler::emit_numeric_binary(TokenType operator_type)
+{
+    switch (operator_type)
+    {
+        case TokenType::BANG_EQUAL:
+            emit_bytes(OpCode::OP_EQUAL_F64, OpCode::OP_NOT);
+            break;
+        case TokenType::EQUAL_EQUAL:
+            emit_bytes(OpCode::OP_EQUAL_F64);
+            break;
+        case TokenType::GREATER:
+            emit_bytes(OpCode::OP_GREATER_F64);
+            break;
+        case TokenType::GREATER_EQUAL:
+            emit_bytes(OpCode::OP_LESS_F64, OpCode::OP_NOT);
+            break;
+        case TokenType::LESS:
+            emit_bytes(OpCode::OP_LESS_F64);
+            break;
+        case TokenType::LESS_EQUAL:
+            emit_bytes(OpCode::OP_GREATER_F64, OpCode::OP_NOT);
+            break;
+        case TokenType::PLUS:
+            emit_bytes(OpCode::OP_ADD_F64);
+            break;
+        case TokenType::MINUS:
+            emit_bytes(OpCode::OP_SUBTRACT_F64);
+            break;
+        case TokenType::STAR:
+            emit_bytes(OpCode::OP_MULTIPLY_F64);
+            break;
+        case TokenType::SLASH:
+            emit_bytes(OpCode::OP_DIVIDE_F64);
+            break;
+        default:
+            return;  // Unreachable.
+    }
+}
+
+// Leaves the left operand as the result when it is falsey, without
+// converting anything to a boolean.
+void compiler::and_()
+{
+    const auto left_type = last_type_;
+    const auto end_jump  = emit_jump(OpCode::OP_JUMP_IF_FALSE_OR_POP);
+    parse_precedence(Precedence::AND);
+    patch_jump(end_jump);
+    if (last_type_ != left_type)
+    {
+        last_type_ = StaticType::UNKNOWN;
+    }
+}
+
+void compiler::or_()
+{
+    const auto left_type = last_type_;
+    const auto end_jump  = emit_jump(OpCode::OP_JUMP_IF_TRUE_OR_POP);
+    parse_precedence(Precedence::OR);
+    patch_jump(end_jump);
+    if (last_type_ != left_type)
+    {
+        last_type_ = StaticType::UNKNOWN;
+    }
+}
+
+// 'a.b(...)' compiles to one OP_INVOKE rather than a property read that
+// would create a bound method, followed by a call.
+void compiler::dot()
+{
+    consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+    const auto site = add_property(parser_.previous.lexeme);
+    if (can_assign_ && match(TokenType::EQUAL))
+    {
+        expression();
+        emit_property(OpCode::OP_SET_PROPERTY, site);
+    }
+    else if (match(TokenType::LEFT_PAREN))
+    {
+        const auto argc = argument_list();
+        current_function().last_call = current_chunk().size();
+        emit_property(OpCode::OP_INVOKE, site);
+        emit_bytes(argc);
+    }
+    else
+    {
+        emit_property(OpCode::OP_GET_PROPERTY, site);
+    }
+    last_type_ = StaticType::UNKNOWN;
+}
+
+void compiler::index()
+{
+    const bool can_assign = can_assign_;
+    expression();
+    consume(TokenType::RIGHT_BRACKET, "Expect ']' after index.");
+    if (can_assign && match(TokenType::EQUAL))
+    {
+        expression();
+        emit_bytes(OpCode::OP_INDEX_SET);
+    }
+    else
+    {
+        emit_bytes(OpCode::OP_INDEX_GET);
+    }
+    last_type_ = StaticType::UNKNOWN;
+}
+
+// '{key: value, ...}'. A '{' that starts a statement is a block instead.
+void compiler::map_literal()
+{
+    int count = 0;
+    if (!check(TokenType::RIGHT_BRACE))
+    {
+        do
+        {
+            expression();
+            consume(TokenType::COLON, "Expect ':' after map key.");
+            expression();
+            if (count == std::numeric_limits<std::uint8_t>::max())
+            {
+                parser_.error("Can't have more than 255 entries in a map.");
+            }
+            ++count;
+        } while (match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after map entries.");
+    emit_bytes(OpCode::OP_MAP, static_cast<std::uint8_t>(count));
+    last_type_ = StaticType::UNKNOWN;
+}
+
+void compiler::this_()
+{
+    if (classes_.empty())
+    {
+        parser_.error("Can't use 'this' outside of a class.");
+        return;
+    }
+    named_variable("this", false);
+    last_type_ = StaticType::UNKNOWN;
+}
+
+void compiler::super_()
+{
+    if (classes_.empty())
+    {
+        parser_.error("Can't use 'super' outside of a class.");
+    }
+    else if (!classes_.back().has_superclass)
+    {
+        parser_.error("Can't use 'super' in a class with no superclass.");
+    }
+    consume(TokenType::DOT, "Expect '.' after 'super'.");
+    consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+    const auto site = add_property(parser_.previous.lexeme);
+    named_variable("this", false);
+    if (match(TokenType::LEFT_PAREN))
+    {
+        const auto argc = argument_list();
+        named_variable("super", false);
+        current_function().last_call = current_chunk().size();
+        emit_property(OpCode::OP_SUPER_INVOKE, site);
+        emit_bytes(argc);
+    }
+    else
+    {
+        named_variable("super", false);
+        emit_property(OpCode::OP_GET_SUPER, site);
+    }
+    last_type_ = StaticType::UNKNOWN;
+}
+
+void compiler::call()
+{
+    const auto argc = argument_list();
+    emit_bytes(OpCode::OP_CALL, argc);
+    current_function().last_call = current_chunk().size() - 2;
+    last_type_                   = StaticType::UNKNOWN;
+}
+
+std::uint8_t compiler::argument_list()
+{
+    int argc = 0;
+    if (!check(TokenType::RIGHT_PAREN))
+    {
+        do
+        {
+            expression();
+            if (argc == std::numeric_limits<std::uint8_t>::max())
+            {
+                parser_.error("Can't have more than 255 arguments.");
+            }
+            ++argc;
+        } while (match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    return static_cast<std::uint8_t>(argc);
+}
+
 void compiler::literal()
 {
     switch (parser_.previous.type)
     {
         case TokenType::FALSE:
             emit_bytes(OpCode::OP_FALSE);
+            last_type_ = StaticType::BOOL;
             break;
         case TokenType::NIL:
             emit_bytes(OpCode::OP_NIL);
+            last_type_ = StaticType::NIL;
             break;
         case TokenType::TRUE:
             emit_bytes(OpCode::OP_TRUE);
+            last_type_ = StaticType::BOOL;
             break;
         default:
             return;  // Unreachable.
@@ -259,7 +1279,7 @@ void compiler::literal()
 template <class... Args>
 void compiler::emit_bytes(Args... bytes)
 {
-    (current_chunk().write_chunk(bytes, parser_.current.line), ...);
+    (current_chunk().write_chunk(bytes, parser_.previous.line), ...);
 }
 
 void compiler::emit_return()
@@ -267,6 +1287,19 @@ void compiler::emit_return()
     emit_bytes(static_cast<std::byte>(OpCode::OP_RETURN));
 }
 
+// Initializers return the receiver, other functions nil.
+void compiler::emit_implicit_return()
+{
+    if (current_function().type == FunctionType::INITIALIZER)
+    {
+        emit_bytes(OpCode::OP_GET_LOCAL, std::uint8_t{0}, OpCode::OP_RETURN);
+    }
+    else
+    {
+        emit_bytes(OpCode::OP_NIL, OpCode::OP_RETURN);
+    }
+}
+
 void compiler::emit_constant(ValueType val)
 {
     emit_bytes(static_cast<std::byte>(OpCode::OP_CONSTANT), make_constant(val));
@@ -283,6 +1316,76 @@ std::byte compiler::make_constant(ValueType val)
     return static_cast<std::byte>(constant);
 }
 
-chunk& compiler::current_chunk() { return chunks_.back(); }
+std::uint16_t compiler::add_property(std::string_view name)
+{
+    const auto site = current_chunk().add_property(name);
+    if (site > std::numeric_limits<std::uint16_t>::max())
+    {
+        parser_.error("Too many property accesses in one function.");
+    }
+    return static_cast<std::uint16_t>(site);
+}
+
+void compiler::emit_property(OpCode op, std::uint16_t site)
+{
+    emit_bytes(op, static_cast<std::uint8_t>(site >> 8),
+               static_cast<std::uint8_t>(site & 0xff));
+}
+
+void compiler::emit_global(OpCode op, std::string_view name)
+{
+    const auto idx = current_chunk().add_global(name);
+    if (idx > std::numeric_limits<std::uint16_t>::max())
+    {
+        parser_.error("Too many global variables in one chunk.");
+        return;
+    }
+    emit_bytes(op, static_cast<std::uint8_t>(idx >> 8),
+               static_cast<std::uint8_t>(idx & 0xff));
+}
+
+std::size_t compiler::emit_jump(OpCode op)
+{
+    emit_bytes(op, std::uint8_t{0xff}, std::uint8_t{0xff});
+    return current_chunk().size() - 2;
+}
+
+void compiler::patch_jump(std::size_t offset)
+{
+    // -2 to adjust for the jump offset itself.
+    const auto jump = current_chunk().size() - offset - 2;
+    if (jump > std::numeric_limits<std::uint16_t>::max())
+    {
+        parser_.error("Too much code to jump over.");
+    }
+    current_chunk().patch_short(offset, static_cast<std::uint16_t>(jump));
+}
+
+void compiler::emit_loop(std::size_t loop_start)
+{
+    emit_bytes(OpCode::OP_LOOP);
+    const auto offset = current_chunk().size() - loop_start + 2;
+    if (offset > std::numeric_limits<std::uint16_t>::max())
+    {
+        parser_.error("Loop body too large.");
+    }
+    emit_bytes(static_cast<std::uint8_t>((offset >> 8) & 0xff),
+               static_cast<std::uint8_t>(offset & 0xff));
+}
+
+chunk& compiler::current_chunk()
+{
+    return chunks_[functions_.back().chunk];
+}
+
+compiler::function_state& compiler::current_function()
+{
+    return functions_.back();
+}
+
+compiler::local& compiler::declaration_of(const upvalue& capture)
+{
+    return functions_[capture.level].locals[capture.local];
+}
 
 }  // namespace clox
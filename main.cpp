@@ -1,16 +1,67 @@
+#include <charconv>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 #include "chunk.hpp"
 #include "compiler.hpp"
 #include "debug.hpp"
+#include "profiler.hpp"
 #include "vm.hpp"
 
-static void repl()
+struct options
+{
+    std::optional<clox::Backend> backend;
+    std::size_t                  heap_limit   = 0;
+    bool                         heap_profile = false;
+    bool                         trace        = false;
+    std::filesystem::path        profile_output;
+    std::filesystem::path        script;
+};
+
+static void configure(clox::vm& vm, const options& opts)
+{
+    if (opts.backend)
+    {
+        vm.set_backend(*opts.backend);
+    }
+    vm.memory().set_limit(opts.heap_limit);
+}
+
+// Prints the last instructions the vm executed, when asked to.
+static void report_trace(const clox::vm& vm, const options& opts)
+{
+#ifdef DEBUG_TRACE_EXECUTION
+    if (opts.trace)
+    {
+        vm.trace().decode(vm.chunks());
+    }
+#else
+    (void)vm;
+    (void)opts;
+#endif
+}
+
+// Says when a program asked for the register backend ran on the stack VM.
+static void report_fallback(const clox::vm& vm, const options& opts)
+{
+    if (opts.backend == clox::Backend::REGISTER && !vm.lowered())
+    {
+        std::cerr << "note: the register backend does not support this "
+                     "program; it ran on the stack VM"
+                  << std::endl;
+    }
+}
+
+static void repl(const options& opts)
 {
     std::string line;
+    // One vm for the whole session so that globals survive between lines.
+    clox::vm    vm{{}};
+    configure(vm, opts);
     for (;;)
     {
         std::cout << "> ";
@@ -24,13 +75,16 @@ static void repl()
         auto           chunks = comp.compile();
         if (chunks)
         {
-            clox::vm vm{std::move(*chunks)};
+            vm.load(std::move(*chunks));
             vm.interpret();
+            report_trace(vm, opts);
+            report_fallback(vm, opts);
         }
     }
 }
-static int run_file(const std::filesystem::path& path)
+static int run_file(const options& opts, clox::profiler* prof = nullptr)
 {
+    const auto&   path = opts.script;
     std::string   source;
     std::ifstream file(path);
     if (!file.is_open())
@@ -40,29 +94,140 @@ static int run_file(const std::filesystem::path& path)
         return 74;
     }
     std::getline(file, source, '\0');
-    /*    clox::InterpretResult result = interpret(source);
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    if (!chunks)
+    {
+        return 65;
+    }
+    clox::heap_profiler heap_prof;
+    clox::vm            vm{std::move(*chunks)};
+    configure(vm, opts);
+    vm.set_profiler(prof);
+    if (opts.heap_profile)
+    {
+        vm.set_heap_profiler(&heap_prof);
+    }
+    if (prof)
+    {
+        prof->start();
+    }
+    const auto result = vm.interpret();
+    if (prof)
+    {
+        prof->stop();
+    }
+    report_trace(vm, opts);
+    report_fallback(vm, opts);
+    if (opts.heap_profile)
+    {
+        std::cerr << std::format("== heap profile ({} bytes, peak {}) ==",
+                                 heap_prof.bytes(), vm.memory().peak())
+                  << std::endl;
+        heap_prof.write(std::cerr);
+    }
+    if (result == clox::InterpretResult::INTERPRET_RUNTIME_ERROR)
+    {
+        return 70;
+    }
+    return 0;
+}
 
-       if (result == clox::InterpretResult::INTERPRET_COMPILE_ERROR)
-           return 65;
-       if (result == clox::InterpretResult::INTERPRET_RUNTIME_ERROR)
-           return 70; */
-    return -1;
+static int profile_file(const options& opts)
+{
+    clox::profiler prof{clox::profiler::Mode::TIMER, 1000};
+    const auto     code = run_file(opts, &prof);
+    std::ofstream  out(opts.profile_output);
+    if (!out.is_open())
+    {
+        std::cerr << std::format("Could not open file \"{}\"",
+                                 opts.profile_output.c_str())
+                  << std::endl;
+        return 74;
+    }
+    prof.write_folded(out);
+    std::cerr << std::format("== profile ({} samples) ==", prof.samples())
+              << std::endl;
+    prof.write_lines(std::cerr);
+    return code;
+}
+
+static int usage()
+{
+    std::cerr << "Usage: clox [--backend stack|register] "
+                 "[--profile <folded-output>] [--heap-limit <bytes>] "
+                 "[--heap-profile] [--trace] [path]"
+              << std::endl;
+    return 64;
 }
 
 int main(int argc, char** argv)
 {
-    if (argc == 1)
+    options opts;
+    for (int i = 1; i < argc; ++i)
     {
-        repl();
+        const std::string_view arg{argv[i]};
+        if (arg == "--backend" && i + 1 < argc)
+        {
+            const std::string_view backend{argv[++i]};
+            if (backend == "stack")
+            {
+                opts.backend = clox::Backend::STACK;
+            }
+            else if (backend == "register")
+            {
+                opts.backend = clox::Backend::REGISTER;
+            }
+            else
+            {
+                return usage();
+            }
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            opts.profile_output = argv[++i];
+        }
+        else if (arg == "--heap-limit" && i + 1 < argc)
+        {
+            const std::string_view bytes{argv[++i]};
+            const auto [end, error] = std::from_chars(
+                bytes.data(), bytes.data() + bytes.size(), opts.heap_limit);
+            if (error != std::errc{} || end != bytes.data() + bytes.size())
+            {
+                return usage();
+            }
+        }
+        else if (arg == "--heap-profile")
+        {
+            opts.heap_profile = true;
+        }
+#ifdef DEBUG_TRACE_EXECUTION
+        else if (arg == "--trace")
+        {
+            opts.trace = true;
+        }
+#endif
+        else if (opts.script.empty() && !arg.starts_with("--"))
+        {
+            opts.script = arg;
+        }
+        else
+        {
+            return usage();
+        }
     }
-    else if (argc == 2)
+    if (opts.script.empty())
     {
-        run_file(argv[1]);
+        if (!opts.profile_output.empty() || opts.heap_profile)
+        {
+            return usage();
+        }
+        repl(opts);
+        return 0;
     }
-    else
+    if (!opts.profile_output.empty())
     {
-        std::cerr << "Usage: clox [path]" << std::endl;
-        return 64;
+        return profile_file(opts);
     }
-    return 0;
+    return run_file(opts);
 }
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Profile-guided optimized Release build:
+#  1. build an instrumented clox and clox_bench,
+#  2. run them on the bundled workloads to collect profiles,
+#  3. rebuild the same tree with the profiles and LTO.
+set -e
+
+project_dir=$(pwd)
+build_dir="$project_dir/build-pgo"
+profile_dir="$build_dir/pgo"
+
+configure() {
+    cmake -S "$project_dir" -B "$build_dir" -G "Ninja" \
+        -DCMAKE_BUILD_TYPE=Release -DCLOX_SANITIZE=OFF -DCLOX_LTO=ON \
+        -DCLOX_PGO_DIR="$profile_dir" -DCLOX_PGO="$1"
+}
+
+rm -rf "$profile_dir"
+configure GENERATE
+cmake --build "$build_dir" --clean-first
+
+# Training run.
+"$build_dir/bench/clox_bench" --min-time 0.2 > /dev/null
+for workload in "$project_dir"/bench/workloads/*.lox; do
+    "$build_dir/clox" "$workload" > /dev/null
+done
+
+if ls "$profile_dir"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$profile_dir/clox.profdata" "$profile_dir"/*.profraw
+fi
+
+configure USE
+cmake --build "$build_dir" --clean-first
+echo "PGO build is in $build_dir"
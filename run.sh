@@ -12,7 +12,7 @@ cd "$build_dir"
 # Check if the executable exists
 if [ -f "$executable_name" ]; then
   # Run the executable
-  ./"$executable_name"
+  ./"$executable_name" "$@"
 else
   echo "Executable '$executable_name' not found in '$build_dir'."
 fi
@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -12,6 +13,9 @@ enum class TokenType
     RIGHT_PAREN,
     LEFT_BRACE,
     RIGHT_BRACE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
+    COLON,
     COMMA,
     DOT,
     MINUS,
@@ -70,14 +74,20 @@ struct token
 
 class scanner
 {
-    const std::string           source_;
-    std::string::const_iterator start_;
-    std::string::const_iterator current_;
-    int                         line_ = 1;
+    // Shared so that string literals can view it instead of copying.
+    const std::shared_ptr<const std::string> source_;
+    std::string::const_iterator              start_;
+    std::string::const_iterator              current_;
+    int                                      line_ = 1;
 
   public:
     explicit scanner(std::string source);
     token scan_token();
+    // Every token's lexeme points into it.
+    const std::shared_ptr<const std::string>& source() const noexcept
+    {
+        return source_;
+    }
 
   private:
     token     make_token(TokenType type) const;
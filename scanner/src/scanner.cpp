@@ -3,9 +3,9 @@
 namespace clox
 {
 scanner::scanner(std::string source)
-    : source_(std::move(source)),
-      start_(source_.begin()),
-      current_(source_.begin())
+    : source_(std::make_shared<const std::string>(std::move(source))),
+      start_(source_->begin()),
+      current_(source_->begin())
 {
 }
 
@@ -37,6 +37,12 @@ token scanner::scan_token()
             return make_token(TokenType::LEFT_BRACE);
         case '}':
             return make_token(TokenType::RIGHT_BRACE);
+        case '[':
+            return make_token(TokenType::LEFT_BRACKET);
+        case ']':
+            return make_token(TokenType::RIGHT_BRACKET);
+        case ':':
+            return make_token(TokenType::COLON);
         case ';':
             return make_token(TokenType::SEMICOLON);
         case ',':
@@ -194,7 +200,7 @@ token scanner::identifier()
 TokenType scanner::check_keyword(std::string_view tail, TokenType token,
                                  int start)
 {
-    for (int i = 0; i < tail.size(); ++i)
+    for (int i = 0; i < static_cast<int>(tail.size()); ++i)
     {
         if (start_[start + i] != tail[i])
         {
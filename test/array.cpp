@@ -0,0 +1,82 @@
+#include "array.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace clox;
+
+// Exactly representable values, so that every summation order agrees.
+static std::vector<double> series(std::size_t size, double offset)
+{
+    std::vector<double> values(size);
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        values[idx] = offset + static_cast<double>(idx % 7) -
+                      static_cast<double>(idx % 3) * 0.5;
+    }
+    return values;
+}
+
+TEST_CASE("simd::kernels match scalar loops", "[array]")
+{
+    // Covers the unrolled body, the single-vector loop and the scalar tail.
+    for (std::size_t size = 0; size < 41; ++size)
+    {
+        const auto xs = series(size, 1);
+        const auto ys = series(size, -2);
+        double     sum = 0;
+        double     dot = 0;
+        for (std::size_t idx = 0; idx < size; ++idx)
+        {
+            sum += xs[idx];
+            dot += xs[idx] * ys[idx];
+        }
+        CHECK(simd::sum(xs) == sum);
+        CHECK(simd::dot(xs, ys) == dot);
+
+        std::vector<double> out(size);
+        simd::add(xs, ys, out);
+        for (std::size_t idx = 0; idx < size; ++idx)
+        {
+            CHECK(out[idx] == xs[idx] + ys[idx]);
+        }
+        simd::scale(xs, -0.5, out);
+        for (std::size_t idx = 0; idx < size; ++idx)
+        {
+            CHECK(out[idx] == xs[idx] * -0.5);
+        }
+    }
+}
+
+TEST_CASE("simd::min and max find extremes in any position", "[array]")
+{
+    CHECK(simd::min(std::vector{2.0}) == 2.0);
+    CHECK(simd::max(std::vector{2.0}) == 2.0);
+    for (std::size_t size = 2; size < 20; ++size)
+    {
+        for (std::size_t pos = 0; pos < size; ++pos)
+        {
+            std::vector<double> values(size, 1.0);
+            values[pos] = -3.5;
+            CHECK(simd::min(values) == -3.5);
+            CHECK(simd::max(values) == 1.0);
+            values[pos] = 8;
+            CHECK(simd::min(values) == 1.0);
+            CHECK(simd::max(values) == 8);
+        }
+    }
+}
+
+TEST_CASE("array::prints its elements", "[array]")
+{
+    obj_array   array{std::vector{1.0, 2.5}};
+    std::string out;
+    array.print(out);
+    CHECK(out == "['1', '2.5']");
+    out.clear();
+    obj_array{0}.print(out);
+    CHECK(out == "[]");
+}
@@ -1,6 +1,11 @@
 #include "chunk.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object.hpp"
 
 using namespace clox;
 
@@ -31,3 +36,39 @@ TEST_CASE("chunk::add_constant and chunk::get_op_code", "[chunk]")
     REQUIRE(c.size() == 0);
     REQUIRE(constant_index == 0);
 }
+
+TEST_CASE("chunk::link rewrites global operands", "[chunk]")
+{
+    chunk c;
+    REQUIRE(c.add_global("x") == 0);
+    REQUIRE(c.add_global("y") == 1);
+    REQUIRE(c.add_global("x") == 0);
+    c.write_chunk(OpCode::OP_GET_GLOBAL, 1);
+    c.write_chunk(static_cast<std::uint8_t>(0), 1);
+    c.write_chunk(static_cast<std::uint8_t>(1), 1);
+
+    const auto names = std::make_shared<std::vector<std::string>>(
+        std::vector<std::string>{"y", "?", "?", "?", "?", "?", "?", "x"});
+    c.link({7, 0x1234}, names);
+    CHECK(*c.get_instruction(1) == 0x12);
+    CHECK(*c.get_instruction(2) == 0x34);
+    CHECK(c.global_name(7) == "x");
+    // The table is shared, not copied.
+    names->emplace_back("z");
+    CHECK(c.global_name(8) == "z");
+    CHECK(c.globals() == std::vector<std::string>{"x", "y"});
+}
+
+TEST_CASE("chunk::link moves functions to the vm's chunk indices", "[chunk]")
+{
+    chunk      c;
+    const auto fn = std::make_shared<obj_function>("f", 1, 2);
+    c.add_constant(fn);
+    c.link({}, nullptr, 5);
+    const auto& linked = static_cast<const obj_function&>(
+        *std::get<std::shared_ptr<obj>>(c.get_constant(0)));
+    CHECK(linked.chunk() == 7);
+    CHECK(linked.name() == "f");
+    // The compiler's object is left alone.
+    CHECK(fn->chunk() == 2);
+}
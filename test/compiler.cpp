@@ -2,7 +2,11 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include "chunk.hpp"
 #include "object.hpp"
@@ -14,7 +18,8 @@ TEST_CASE("compiler::single", "[compiler]")
     const auto TEST = GENERATE(std::make_pair("+", OpCode::OP_ADD),
                                std::make_pair("-", OpCode::OP_SUBTRACT),
                                std::make_pair("*", OpCode::OP_MULTIPLY),
-                               std::make_pair("/", OpCode::OP_DIVIDE));
+                               // Always yields a double.
+                               std::make_pair("/", OpCode::OP_DIVIDE_F64));
 
     clox::compiler comp{"1" + std::string(TEST.first) + "2"};
     const auto     chunks_opt = comp.compile();
@@ -22,8 +27,8 @@ TEST_CASE("compiler::single", "[compiler]")
     const auto chunks = chunks_opt.value();
     REQUIRE(chunks.size() == 1);
     const auto chunk = std::move(chunks[0]);
-    CHECK(std::get<double>(chunk.get_constant(0)) == 1.);
-    CHECK(std::get<double>(chunk.get_constant(1)) == 2.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(0)) == 1);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(1)) == 2);
     CHECK(*chunk.get_instruction(0) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(2) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(4) == static_cast<int>(TEST.second));
@@ -32,13 +37,19 @@ TEST_CASE("compiler::single", "[compiler]")
 
 TEST_CASE("compiler::precedence", "[compiler]")
 {
-    const auto LOWER_PREC = GENERATE(std::make_pair("+", OpCode::OP_ADD),
-                                     std::make_pair("-", OpCode::OP_SUBTRACT));
-
-    const auto HIGHER_PREC = GENERATE(std::make_pair("*", OpCode::OP_MULTIPLY),
-                                      std::make_pair("/", OpCode::OP_DIVIDE));
-
-    clox::compiler comp{"1" + std::string(LOWER_PREC.first) + "2" +
+    const auto LOWER_PREC = GENERATE(
+        std::make_tuple("+", OpCode::OP_ADD, OpCode::OP_ADD_F64),
+        std::make_tuple("-", OpCode::OP_SUBTRACT, OpCode::OP_SUBTRACT_F64));
+
+    const auto HIGHER_PREC =
+        GENERATE(std::make_pair("*", OpCode::OP_MULTIPLY),
+                 std::make_pair("/", OpCode::OP_DIVIDE_F64));
+    // A quotient is a double, so the integer on the left is converted.
+    const auto lower = HIGHER_PREC.second == OpCode::OP_DIVIDE_F64
+                           ? std::get<2>(LOWER_PREC)
+                           : std::get<1>(LOWER_PREC);
+
+    clox::compiler comp{"1" + std::string(std::get<0>(LOWER_PREC)) + "2" +
                         std::string(HIGHER_PREC.first) + "3"};
 
     const auto chunks_opt = comp.compile();
@@ -46,14 +57,14 @@ TEST_CASE("compiler::precedence", "[compiler]")
     const auto chunks = chunks_opt.value();
     REQUIRE(chunks.size() == 1);
     const auto chunk = std::move(chunks[0]);
-    CHECK(std::get<double>(chunk.get_constant(0)) == 1.);
-    CHECK(std::get<double>(chunk.get_constant(1)) == 2.);
-    CHECK(std::get<double>(chunk.get_constant(2)) == 3.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(0)) == 1);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(1)) == 2);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(2)) == 3);
     CHECK(*chunk.get_instruction(0) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(2) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(4) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(6) == static_cast<int>(HIGHER_PREC.second));
-    CHECK(*chunk.get_instruction(7) == static_cast<int>(LOWER_PREC.second));
+    CHECK(*chunk.get_instruction(7) == static_cast<int>(lower));
     CHECK(*chunk.get_instruction(8) == static_cast<int>(OpCode::OP_RETURN));
 }
 
@@ -62,8 +73,9 @@ TEST_CASE("compiler::parenthesis", "[compiler]")
     const auto LOWER_PREC = GENERATE(std::make_pair("+", OpCode::OP_ADD),
                                      std::make_pair("-", OpCode::OP_SUBTRACT));
 
-    const auto HIGHER_PREC = GENERATE(std::make_pair("*", OpCode::OP_MULTIPLY),
-                                      std::make_pair("/", OpCode::OP_DIVIDE));
+    const auto HIGHER_PREC =
+        GENERATE(std::make_pair("*", OpCode::OP_MULTIPLY),
+                 std::make_pair("/", OpCode::OP_DIVIDE_F64));
 
     clox::compiler comp{"(4214" + std::string(LOWER_PREC.first) + "9549)" +
                         std::string(HIGHER_PREC.first) + "2135"};
@@ -72,9 +84,9 @@ TEST_CASE("compiler::parenthesis", "[compiler]")
     const auto chunks = chunks_opt.value();
     REQUIRE(chunks.size() == 1);
     const auto chunk = std::move(chunks[0]);
-    CHECK(std::get<double>(chunk.get_constant(0)) == 4214.);
-    CHECK(std::get<double>(chunk.get_constant(1)) == 9549.);
-    CHECK(std::get<double>(chunk.get_constant(2)) == 2135.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(0)) == 4214);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(1)) == 9549);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(2)) == 2135);
     CHECK(*chunk.get_instruction(0) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(2) == static_cast<int>(OpCode::OP_CONSTANT));
     CHECK(*chunk.get_instruction(4) == static_cast<int>(LOWER_PREC.second));
@@ -100,17 +112,17 @@ TEST_CASE("compiler::logical", "[compiler]")
     const auto chunk = std::move(chunks[0]);
 
     CHECK(*chunk.get_instruction(0) == static_cast<int>(OpCode::OP_CONSTANT));
-    CHECK(std::get<double>(chunk.get_constant(0)) == 5.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(0)) == 5);
     CHECK(*chunk.get_instruction(2) == static_cast<int>(OpCode::OP_CONSTANT));
-    CHECK(std::get<double>(chunk.get_constant(1)) == 4.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(1)) == 4);
 
     CHECK(*chunk.get_instruction(4) == static_cast<int>(OpCode::OP_SUBTRACT));
 
     CHECK(*chunk.get_instruction(5) == static_cast<int>(OpCode::OP_CONSTANT));
-    CHECK(std::get<double>(chunk.get_constant(2)) == 3.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(2)) == 3);
 
     CHECK(*chunk.get_instruction(7) == static_cast<int>(OpCode::OP_CONSTANT));
-    CHECK(std::get<double>(chunk.get_constant(3)) == 2.);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(3)) == 2);
 
     CHECK(*chunk.get_instruction(9) == static_cast<int>(OpCode::OP_MULTIPLY));
 
@@ -155,3 +167,327 @@ TEST_CASE("compiler::string", "[compiler]")
 
     CHECK(*chunk.get_instruction(8) == static_cast<int>(OpCode::OP_RETURN));
 }
+
+// Opcodes of 'chunk' in order, without their operands.
+static std::vector<OpCode> opcodes(const chunk& chunk)
+{
+    std::vector<OpCode> result;
+    for (std::size_t offset = 0; offset < chunk.size();)
+    {
+        result.push_back(static_cast<OpCode>(
+            *chunk.get_instruction(static_cast<int>(offset))));
+        offset += 1 + static_cast<std::size_t>(operand_size(result.back()));
+    }
+    return result;
+}
+
+TEST_CASE("compiler::integral literals", "[compiler]")
+{
+    clox::compiler comp{"1.5 + 2.0 + 18014398509481984"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunk = chunks_opt.value()[0];
+    CHECK(std::get<double>(chunk.get_constant(0)) == 1.5);
+    CHECK(std::get<std::int64_t>(chunk.get_constant(1)) == 2);
+    // Beyond 2^53: kept as a double.
+    CHECK(std::holds_alternative<double>(chunk.get_constant(2)));
+}
+
+TEST_CASE("compiler::numeric operands skip type checks", "[compiler]")
+{
+    using enum OpCode;
+    const auto TEST = GENERATE(
+        std::make_pair("1.5 != 2.5", std::vector{OP_CONSTANT, OP_CONSTANT,
+                                             OP_EQUAL_F64, OP_NOT, OP_RETURN}),
+        std::make_pair("1.5 >= 2.5", std::vector{OP_CONSTANT, OP_CONSTANT,
+                                             OP_LESS_F64, OP_NOT, OP_RETURN}),
+        std::make_pair("1.5 <= 2.5",
+                       std::vector{OP_CONSTANT, OP_CONSTANT, OP_GREATER_F64,
+                                   OP_NOT, OP_RETURN}),
+        std::make_pair("-(1.5) == 2 / 4",
+                       std::vector{OP_CONSTANT, OP_NEGATE_F64, OP_CONSTANT,
+                                   OP_CONSTANT, OP_DIVIDE_F64, OP_EQUAL_F64,
+                                   OP_RETURN}),
+        // An integer operand is converted like the generic form does.
+        std::make_pair("1.5 * 2", std::vector{OP_CONSTANT, OP_CONSTANT,
+                                          OP_MULTIPLY_F64, OP_RETURN}),
+        std::make_pair("1 < 2.5", std::vector{OP_CONSTANT, OP_CONSTANT,
+                                          OP_LESS_F64, OP_RETURN}));
+
+    clox::compiler comp{TEST.first};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    CHECK(opcodes(chunks_opt.value()[0]) == TEST.second);
+}
+
+TEST_CASE("compiler::unknown operands stay generic", "[compiler]")
+{
+    using enum OpCode;
+    const auto TEST = GENERATE(
+        std::make_pair("1 + nil", OP_ADD),
+        std::make_pair("nil - 1", OP_SUBTRACT),
+        std::make_pair(R"(1 < "a")", OP_LESS),
+        std::make_pair("true == false", OP_EQUAL),
+        // Integer arithmetic may leave the integer range at run time.
+        std::make_pair("1 + 2", OP_ADD),
+        std::make_pair("3 * 4", OP_MULTIPLY),
+        std::make_pair("3 == 4", OP_EQUAL),
+        std::make_pair("-nil", OP_NEGATE));
+
+    clox::compiler comp{TEST.first};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto ops = opcodes(chunks_opt.value()[0]);
+    REQUIRE(ops.size() >= 2);
+    CHECK(ops[ops.size() - 2] == TEST.second);
+}
+
+TEST_CASE("compiler::globals are indexed", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"var a = 1; var b; b = a; print b;"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunk = chunks_opt.value()[0];
+    CHECK(opcodes(chunk) ==
+          std::vector{OP_CONSTANT, OP_DEFINE_GLOBAL, OP_NIL, OP_DEFINE_GLOBAL,
+                      OP_GET_GLOBAL, OP_SET_GLOBAL, OP_POP, OP_GET_GLOBAL,
+                      OP_PRINT, OP_RETURN});
+    CHECK(chunk.globals() == std::vector<std::string>{"a", "b"});
+    // OP_SET_GLOBAL 'b'
+    CHECK(*chunk.get_instruction(13) == 0);
+    CHECK(*chunk.get_instruction(14) == 1);
+}
+
+TEST_CASE("compiler::statement errors", "[compiler]")
+{
+    clox::compiler comp{
+        GENERATE("1 = 2", "var 1;", "var a = 1", "print 1", "a + b = c;")};
+    CHECK_FALSE(comp.compile().has_value());
+}
+
+TEST_CASE("compiler::locals live in stack slots", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"{ var a = 1; { var b = a; var c; b = c; } print a; }"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunk = chunks_opt.value()[0];
+    CHECK(opcodes(chunk) ==
+          std::vector{OP_CONSTANT, OP_GET_LOCAL, OP_NIL, OP_GET_LOCAL,
+                      OP_SET_LOCAL, OP_POP, OP_POPN, OP_GET_LOCAL, OP_PRINT,
+                      OP_POP, OP_RETURN});
+    CHECK(chunk.globals().empty());
+    // OP_SET_LOCAL 1, OP_POPN 2
+    CHECK(*chunk.get_instruction(8) == 1);
+    CHECK(*chunk.get_instruction(11) == 2);
+}
+
+TEST_CASE("compiler::local errors", "[compiler]")
+{
+    clox::compiler comp{
+        GENERATE("{ var a = 1; var a = 2; }", "{ var a = a; }", "{ var a;")};
+    CHECK_FALSE(comp.compile().has_value());
+}
+
+TEST_CASE("compiler::counted for loops are fused", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{
+        GENERATE("for (var i = 0; i < 10; i = i + 1) print i;",
+                 "{ var n = 10;"
+                 "  for (var i = 0; i <= n; i = i + 1) print i; }")};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto ops = opcodes(chunks_opt.value()[0]);
+    CHECK(std::ranges::count(ops, OP_FOR_LOOP) == 1);
+    CHECK(std::ranges::count(ops, OP_LOOP) == 0);
+}
+
+TEST_CASE("compiler::other loops are not fused", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{
+        GENERATE("for (var i = 0; i < 10; i = i + 2) print i;",
+                 "for (var i = 0; i > 10; i = i + 1) print i;",
+                 "for (var i = 0; 10 > i; i = i + 1) print i;",
+                 "var i; for (i = 0; i < 10; i = i + 1) print i;",
+                 "for (var i = 0; i < 10;) i = i + 1;",
+                 "while (false) print 1;")};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto ops = opcodes(chunks_opt.value()[0]);
+    CHECK(std::ranges::count(ops, OP_FOR_LOOP) == 0);
+    CHECK(std::ranges::count(ops, OP_LOOP) >= 1);
+}
+
+TEST_CASE("compiler::control flow errors", "[compiler]")
+{
+    clox::compiler comp{GENERATE("if true print 1;", "while (true print 1;",
+                                 "for (var i = 0; i < 1; i = i + 1 print i;",
+                                 "if (true) var a = 1;", "1 and")};
+    CHECK_FALSE(comp.compile().has_value());
+}
+
+TEST_CASE("compiler::functions get their own chunk", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"fun add(a, b) { return a + b; } add(1, 2)"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunks = chunks_opt.value();
+    REQUIRE(chunks.size() == 2);
+    CHECK(opcodes(chunks[0]) ==
+          std::vector{OP_CONSTANT, OP_DEFINE_GLOBAL, OP_GET_GLOBAL, OP_CONSTANT,
+                      OP_CONSTANT, OP_CALL, OP_RETURN});
+    // Slot 0 is the callee, the parameters follow.
+    CHECK(opcodes(chunks[1]) == std::vector{OP_GET_LOCAL, OP_GET_LOCAL, OP_ADD,
+                                            OP_RETURN, OP_NIL, OP_RETURN});
+    CHECK(*chunks[1].get_instruction(1) == 1);
+    CHECK(*chunks[1].get_instruction(3) == 2);
+
+    const auto& fn = static_cast<const obj_function&>(
+        *std::get<std::shared_ptr<obj>>(chunks[0].get_constant(0)));
+    CHECK(fn.name() == "add");
+    CHECK(fn.arity() == 2);
+    CHECK(fn.chunk() == 1);
+}
+
+TEST_CASE("compiler::calls in tail position", "[compiler]")
+{
+    using enum OpCode;
+    const auto test = GENERATE(
+        std::make_pair("fun f(n) { return g(n); }", OP_TAIL_CALL),
+        std::make_pair("fun f(n) { return n and g(n); }", OP_TAIL_CALL),
+        std::make_pair("fun f(n) { return 1 + g(n); }", OP_CALL),
+        std::make_pair("fun f(n) { g(n); }", OP_CALL),
+        std::make_pair("fun f(n) { return g(n)(); }", OP_TAIL_CALL));
+    clox::compiler comp{test.first};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto ops = opcodes(chunks_opt.value()[1]);
+    CHECK(std::ranges::count(ops, OP_TAIL_CALL) ==
+          (test.second == OP_TAIL_CALL ? 1 : 0));
+}
+
+TEST_CASE("compiler::captures are flat unless assigned", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"fun f(a, b) { fun g() { return a + b; } b = 1; }"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunks = chunks_opt.value();
+    REQUIRE(chunks.size() == 3);
+    CHECK(opcodes(chunks[1]) ==
+          std::vector{OP_CLOSURE, OP_CAPTURE_LOCAL_FLAT, OP_CAPTURE_LOCAL,
+                      OP_CONSTANT, OP_SET_LOCAL, OP_POP, OP_NIL, OP_RETURN});
+    CHECK(opcodes(chunks[2]) ==
+          std::vector{OP_GET_UPVALUE_FLAT, OP_GET_UPVALUE, OP_ADD, OP_RETURN,
+                      OP_NIL, OP_RETURN});
+}
+
+TEST_CASE("compiler::boxed locals are closed at scope end", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"{ var a; var b; var c; var d;"
+                        "  fun f() { b = 1; return d; } }"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto ops = opcodes(chunks_opt.value()[0]);
+    // From the top: f, the flat d and c are popped together, only the
+    // assigned b needs closing.
+    CHECK(std::vector(ops.end() - 4, ops.end()) ==
+          std::vector{OP_POPN, OP_CLOSE_UPVALUE, OP_POP, OP_RETURN});
+}
+
+TEST_CASE("compiler::each property access has its own site", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"var a; a.x = a.x; a.x"};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& code = chunks_opt.value()[0];
+    CHECK(opcodes(code) ==
+          std::vector{OP_NIL, OP_DEFINE_GLOBAL, OP_GET_GLOBAL, OP_GET_GLOBAL,
+                      OP_GET_PROPERTY, OP_SET_PROPERTY, OP_POP, OP_GET_GLOBAL,
+                      OP_GET_PROPERTY, OP_RETURN});
+    for (std::size_t idx = 0; idx < 3; ++idx)
+    {
+        CHECK(code.property(idx).name->str() == "x");
+    }
+}
+
+TEST_CASE("compiler::method calls are invokes", "[compiler]")
+{
+    using enum OpCode;
+    const auto test = GENERATE(
+        std::make_pair("a.f(1);", OP_INVOKE),
+        std::make_pair("fun g() { return a.f(1); }", OP_TAIL_INVOKE),
+        std::make_pair("class B < A { f() { super.f(1); } }", OP_SUPER_INVOKE),
+        std::make_pair("class B < A { f() { return super.f(1); } }",
+                       OP_TAIL_SUPER_INVOKE));
+    clox::compiler comp{std::string{"class A {} var a;"} + test.first};
+    const auto     chunks_opt = comp.compile();
+    REQUIRE(chunks_opt.has_value());
+    const auto& chunks = chunks_opt.value();
+    const auto  ops    = opcodes(chunks.back());
+    CHECK(std::ranges::count(ops, test.second) == 1);
+    CHECK(std::ranges::count(ops, OP_GET_PROPERTY) == 0);
+    CHECK(std::ranges::count(ops, OP_GET_SUPER) == 0);
+}
+
+TEST_CASE("compiler::class errors", "[compiler]")
+{
+    clox::compiler comp{GENERATE(
+        "this;", "fun f() { return this; }", "super.f();",
+        "class A { f() { return super.f(); } }", "class A < A {}",
+        "class A { init() { return 1; } }", "class A { f }", "a.1;",
+        "var a; 1 + a.x = 2;", "class A { f() { super; } }")};
+    CHECK_FALSE(comp.compile().has_value());
+}
+
+TEST_CASE("compiler::string literals view the source", "[compiler]")
+{
+    clox::compiler comp{"\"abc\" + \"\""};
+    const auto     code = comp.compile();
+    REQUIRE(code.has_value());
+    for (std::size_t idx = 0; idx < 2; ++idx)
+    {
+        const auto& str = static_cast<const obj_string&>(
+            *std::get<std::shared_ptr<obj>>(code->back().get_constant(idx)));
+        CHECK(str.is_slice());
+    }
+    // The literals outlive the compiler.
+    const auto& abc = static_cast<const obj_string&>(
+        *std::get<std::shared_ptr<obj>>(code->back().get_constant(0)));
+    CHECK(abc.str() == "abc");
+}
+
+TEST_CASE("compiler::maps and indexing", "[compiler]")
+{
+    using enum OpCode;
+    clox::compiler comp{"var m = {\"a\": 1, 2: m}; m[\"a\"] = m[2];"};
+    const auto     code = comp.compile();
+    REQUIRE(code.has_value());
+    CHECK(opcodes(code->back()) ==
+          std::vector{OP_CONSTANT, OP_CONSTANT, OP_CONSTANT, OP_GET_GLOBAL,
+                      OP_MAP, OP_DEFINE_GLOBAL, OP_GET_GLOBAL, OP_CONSTANT,
+                      OP_GET_GLOBAL, OP_CONSTANT, OP_INDEX_GET, OP_INDEX_SET,
+                      OP_POP, OP_RETURN});
+}
+
+TEST_CASE("compiler::map errors", "[compiler]")
+{
+    clox::compiler comp{GENERATE("var m = {1};", "var m = {1: 2,};",
+                                 "var m = {1: 2;", "m[1;", "m[] = 1;",
+                                 "1 + m[1] = 2;")};
+    CHECK_FALSE(comp.compile().has_value());
+}
+
+TEST_CASE("compiler::function errors", "[compiler]")
+{
+    clox::compiler comp{GENERATE("return 1;", "fun f(a, a) {}", "fun f( {}",
+                                 "fun f() return 1;", "f(1,);",
+                                 "fun f() { var x = x; }")};
+    CHECK_FALSE(comp.compile().has_value());
+}
@@ -0,0 +1,271 @@
+#include "gc.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "class.hpp"
+#include "compiler.hpp"
+#include "map.hpp"
+#include "vm.hpp"
+
+using namespace clox;
+
+// An instance whose field 'self' refers to itself.
+static std::shared_ptr<obj_instance> self_cycle(
+    const std::shared_ptr<obj_class>& klass)
+{
+    auto instance = std::make_shared<obj_instance>(klass);
+    instance->add_field(
+        klass->root()->add(std::make_shared<obj_string>("self")), instance);
+    return instance;
+}
+
+static std::unique_ptr<clox::vm> run(
+    std::string source, std::chrono::nanoseconds pause_target = {})
+{
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    auto vm = std::make_unique<clox::vm>(std::move(*chunks));
+    vm->gc().set_pause_target(pause_target);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    return vm;
+}
+
+TEST_CASE("collector::frees unreachable cycles", "[gc]")
+{
+    collector gc;
+    auto      klass    = std::make_shared<obj_class>("Node");
+    auto      instance = self_cycle(klass);
+    auto      map      = std::make_shared<obj_map>();
+    map->set(1.0, map);
+    gc.track(klass);
+    gc.track(instance);
+    gc.track(map);
+    const std::weak_ptr<obj> weak_instance = instance;
+    const std::weak_ptr<obj> weak_map      = map;
+    instance.reset();
+    map.reset();
+    REQUIRE_FALSE(weak_instance.expired());
+
+    gc.collect();
+    REQUIRE(weak_instance.expired());
+    REQUIRE(weak_map.expired());
+    REQUIRE(gc.stats().freed == 2);
+    REQUIRE(gc.stats().major.count == 1);
+    // Held from outside, like a value on the vm's stack.
+    REQUIRE(gc.old_size() == 1);
+}
+
+TEST_CASE("collector::keeps what live objects reach", "[gc]")
+{
+    collector gc;
+    auto      klass = std::make_shared<obj_class>("Node");
+    auto      inner = self_cycle(klass);
+    auto      outer = std::make_shared<obj_map>();
+    outer->set(1.0, inner);
+    gc.track(klass);
+    gc.track(inner);
+    gc.track(outer);
+    const std::weak_ptr<obj> weak_inner = inner;
+    inner.reset();
+
+    gc.collect();
+    REQUIRE_FALSE(weak_inner.expired());
+    REQUIRE(gc.stats().freed == 0);
+    outer.reset();
+    gc.collect();
+    REQUIRE(weak_inner.expired());
+}
+
+TEST_CASE("collector::promotes survivors of minor collections", "[gc]")
+{
+    collector gc;
+    gc.set_young_limit(4);
+    auto klass = std::make_shared<obj_class>("Node");
+    gc.track(klass);
+    std::weak_ptr<obj> last;
+    for (int idx = 0; idx < 3; ++idx)
+    {
+        // The third one is still referenced when it fills the nursery.
+        const auto node = self_cycle(klass);
+        last            = node;
+        gc.track(node);
+    }
+    REQUIRE(gc.stats().minor.count == 1);
+    REQUIRE(gc.stats().freed == 2);
+    REQUIRE(gc.young_size() == 0);
+    REQUIRE(gc.old_size() == 2);
+
+    // Minor collections leave the old generation alone.
+    gc.collect_young();
+    REQUIRE_FALSE(last.expired());
+    gc.collect();
+    REQUIRE(last.expired());
+    REQUIRE(gc.stats().freed == 3);
+
+    // An old object referencing a young one keeps it alive.
+    auto old = std::make_shared<obj_map>();
+    gc.track(old);
+    gc.collect();
+    auto young = self_cycle(klass);
+    old->set(1.0, young);
+    const std::weak_ptr<obj> weak_young = young;
+    gc.track(young);
+    young.reset();
+    gc.collect_young();
+    REQUIRE_FALSE(weak_young.expired());
+    REQUIRE(gc.old_size() == 3);
+
+    const auto& minor = gc.stats().minor;
+    REQUIRE(minor.count == 3);
+    REQUIRE(minor.max.count() > 0);
+    REQUIRE(minor.max <= minor.total);
+}
+
+TEST_CASE("collector::collects the old generation in slices", "[gc]")
+{
+    using namespace std::chrono_literals;
+    collector gc;
+    gc.set_young_limit(64);
+    // The smallest slices: 128 objects and what they reach, up to 256.
+    gc.set_pause_target(1ns);
+    auto klass = std::make_shared<obj_class>("Node");
+    gc.track(klass);
+    const auto next = klass->root()->add(std::make_shared<obj_string>("n"));
+    std::vector<std::shared_ptr<obj_instance>> live;
+    std::vector<std::shared_ptr<obj_instance>> dead;
+    for (int idx = 0; idx < 1000; ++idx)
+    {
+        live.push_back(self_cycle(klass));
+        gc.track(live.back());
+        dead.push_back(self_cycle(klass));
+        gc.track(dead.back());
+    }
+    // A cycle larger than a slice's first 128 objects.
+    std::vector<std::shared_ptr<obj_instance>> ring;
+    for (int idx = 0; idx < 200; ++idx)
+    {
+        ring.push_back(std::make_shared<obj_instance>(klass));
+        gc.track(ring.back());
+    }
+    for (std::size_t idx = 0; idx < ring.size(); ++idx)
+    {
+        ring[idx]->add_field(next, ring[(idx + 1) % ring.size()]);
+    }
+    const std::weak_ptr<obj> weak_ring = ring.front();
+    dead.clear();
+    ring.clear();
+    REQUIRE(gc.stats().freed == 0);
+
+    // The garbage is old, so it is only found by the slices of the major
+    // collections that growing the old generation starts.
+    for (int idx = 0; idx < 100000 && gc.stats().freed < 1200; ++idx)
+    {
+        live.push_back(self_cycle(klass));
+        gc.track(live.back());
+    }
+    REQUIRE(gc.stats().freed == 1200);
+    REQUIRE(weak_ring.expired());
+    for (const auto& node : live)
+    {
+        REQUIRE(node->fields().front() == ValueType{node});
+    }
+    const auto& stats = gc.stats();
+    REQUIRE(stats.major.count > 10);
+    REQUIRE(stats.pauses.count == stats.minor.count);
+}
+
+TEST_CASE("collector::keeps up with promotion in slices", "[gc]")
+{
+    using namespace std::chrono_literals;
+    collector gc;
+    // Each minor collection promotes more than the smallest slice visits.
+    gc.set_young_limit(1024);
+    gc.set_pause_target(1ns);
+    auto klass = std::make_shared<obj_class>("Node");
+    gc.track(klass);
+    std::deque<std::shared_ptr<obj_instance>> window;
+    std::size_t                               most = 0;
+    for (int idx = 0; idx < 200000; ++idx)
+    {
+        window.push_back(self_cycle(klass));
+        gc.track(window.back());
+        if (window.size() > 4000)
+        {
+            window.pop_front();
+        }
+        most = std::max(most, gc.old_size());
+    }
+    // Stop-the-world collections keep it near 5000.
+    REQUIRE(most < 20000);
+    REQUIRE(gc.stats().freed > 150000);
+}
+
+TEST_CASE("gc_pauses::percentile", "[gc]")
+{
+    using namespace std::chrono_literals;
+    gc_pauses pauses;
+    for (int us = 1; us <= 100; ++us)
+    {
+        pauses.record(std::chrono::microseconds{us});
+    }
+    REQUIRE(pauses.max == 100us);
+    REQUIRE(pauses.percentile(1) == 100us);
+    REQUIRE(pauses.percentile(0.99) >= 99us);
+    REQUIRE(pauses.percentile(0.99) <= 100us);
+    REQUIRE(pauses.percentile(0.5) >= 50us);
+    REQUIRE(pauses.percentile(0.5) < 62500ns);
+    REQUIRE(pauses.percentile(0.01) >= 1us);
+    REQUIRE(pauses.percentile(0.01) < 1250ns);
+}
+
+TEST_CASE("vm::collects cycles the script drops", "[gc]")
+{
+    using namespace std::chrono_literals;
+    const auto pause_target =
+        GENERATE(std::chrono::nanoseconds{}, std::chrono::nanoseconds{1us});
+    const auto vm = run("class Node {}\n"
+                        "fun pair() {\n"
+                        "  var a = Node(); var b = Node();\n"
+                        "  a.next = b; b.next = a;\n"
+                        "  fun self() { return self; }\n"
+                        "}\n"
+                        "for (var i = 0; i < 2000; i = i + 1) pair();\n"
+                        "var keep = Node(); keep.me = keep;",
+                        pause_target);
+    const auto& stats = vm->gc().stats();
+    REQUIRE(stats.minor.count > 0);
+    vm->gc().collect();
+    // Two instances and a closure per call.
+    REQUIRE(stats.freed == 6000);
+}
+
+static std::weak_ptr<obj> kept;
+
+TEST_CASE("vm::frees cycles when destroyed", "[gc]")
+{
+    auto vm = run("class Node {}\n"
+                  "var node = Node(); node.me = node;\n");
+    vm->define_native("keep",
+                      [](std::span<const ValueType> args, std::string&)
+                      {
+                          kept = std::get<std::shared_ptr<obj>>(args[0]);
+                          return ValueType{nil{}};
+                      },
+                      1);
+    clox::compiler comp{"keep(node);"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    vm->load(std::move(*chunks));
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    REQUIRE_FALSE(kept.expired());
+    vm.reset();
+    REQUIRE(kept.expired());
+}
@@ -0,0 +1,177 @@
+#include "heap.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "array.hpp"
+#include "compiler.hpp"
+#include "map.hpp"
+#include "output.hpp"
+#include "vm.hpp"
+
+using namespace clox;
+
+static std::unique_ptr<clox::vm> load(std::string source)
+{
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    return std::make_unique<clox::vm>(std::move(*chunks));
+}
+
+TEST_CASE("heap::charges the objects made while it is current", "[heap]")
+{
+    const heap_ref memory{new heap};
+    {
+        const heap::scope running{memory.get()};
+        auto              array = make_object<obj_array>(1000);
+        REQUIRE(memory->bytes() > 1000 * sizeof(double));
+        REQUIRE(memory->allocations() == 2);
+        array.reset();
+        REQUIRE(memory->bytes() == 0);
+        REQUIRE(memory->peak() > 1000 * sizeof(double));
+    }
+    REQUIRE(heap::current() == nullptr);
+    make_object<obj_array>(1000);
+    REQUIRE(memory->allocations() == 2);
+}
+
+TEST_CASE("heap::throws past its limit", "[heap]")
+{
+    const heap_ref    memory{new heap};
+    const heap::scope running{memory.get()};
+    memory->set_limit(4096);
+    const auto small = make_object<obj_string>("fits");
+    REQUIRE_THROWS_AS(make_object<obj_array>(1000), heap_exhausted);
+    // The failed allocation is not charged.
+    const auto bytes = memory->bytes();
+    REQUIRE(bytes > 0);
+    REQUIRE(bytes <= 4096);
+}
+
+static ValueType held;
+
+TEST_CASE("heap::outlives its vm while objects use it", "[heap]")
+{
+    auto vm = load("hold(array(10));");
+    vm->define_native("hold",
+                      [](std::span<const ValueType> args, std::string&)
+                      {
+                          held = args[0];
+                          return ValueType{nil{}};
+                      },
+                      1);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    const heap_ref memory{&vm->memory()};
+    vm.reset();
+    REQUIRE(memory->bytes() > 10 * sizeof(double));
+    held = nil{};
+    REQUIRE(memory->bytes() == 0);
+}
+
+TEST_CASE("heap::is freed by the last object that outlives its vm",
+          "[heap]")
+{
+    auto vm = load("var m = {}; m[\"k\"] = \"v\"; hold(m);");
+    vm->define_native("hold",
+                      [](std::span<const ValueType> args, std::string&)
+                      {
+                          held = args[0];
+                          return ValueType{nil{}};
+                      },
+                      1);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    vm.reset();
+    // The map's allocators are the only references to the heap left: it
+    // grows on it, and the control block frees it with the map.
+    auto& map = static_cast<obj_map&>(*std::get<std::shared_ptr<obj>>(held));
+    for (int key = 0; key < 1000; ++key)
+    {
+        map.set(static_cast<double>(key), ValueType{nil{}});
+    }
+    REQUIRE(map.find(999.0) != nullptr);
+    held = nil{};
+}
+
+TEST_CASE("vm::stops a program at the heap limit", "[heap]")
+{
+    auto        vm = load("var s = \"x\";\n"
+                          "for (var i = 0; i < 64; i = i + 1) s = s + s;\n");
+    memory_sink out;
+    vm->set_output(out);
+    vm->memory().set_limit(1 << 20);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    REQUIRE(vm->memory().peak() <= 1 << 20);
+    // The error leaves the program's globals usable.
+    vm->memory().set_limit(0);
+    clox::compiler comp{"s = nil;"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    vm->load(std::move(*chunks));
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    REQUIRE(vm->memory().bytes() < 1 << 10);
+}
+
+TEST_CASE("vm::leaves an instance intact when a field does not fit",
+          "[heap]")
+{
+    auto        vm = load("class C {} var o = C(); o.a = 1;");
+    memory_sink out;
+    vm->set_output(out);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    const auto run = [&](std::string source)
+    {
+        clox::compiler comp{std::move(source)};
+        auto           chunks = comp.compile();
+        REQUIRE(chunks.has_value());
+        vm->load(std::move(*chunks));
+        return vm->interpret();
+    };
+    vm->memory().set_limit(vm->memory().bytes() + 8);
+    REQUIRE(run("o.b = 2;") == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    vm->memory().set_limit(0);
+    REQUIRE(run("print o.a;") == InterpretResult::INTERPRET_OK);
+    REQUIRE(run("print o.b;") == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    REQUIRE(run("o.b = 2; print o.b;") == InterpretResult::INTERPRET_OK);
+    REQUIRE(out.str() == "'1'\n'2'\n");
+}
+
+TEST_CASE("vm::collects cycles before failing an allocation", "[heap]")
+{
+    auto vm = load("class Node {}\n"
+                   "for (var i = 0; i < 10000; i = i + 1) {\n"
+                   "  var node = Node(); node.self = node;\n"
+                   "}\n");
+    // Only the limit starts a collection.
+    vm->gc().set_young_limit(1 << 20);
+    vm->memory().set_limit(1 << 18);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    REQUIRE(vm->gc().stats().freed > 0);
+    REQUIRE(vm->memory().peak() <= 1 << 18);
+}
+
+TEST_CASE("heap_profiler::attributes allocations to lines", "[heap]")
+{
+    auto vm = load("var keep = array(100);\n"
+                   "var n = 0;\n"
+                   "for (var i = 0; i < 10; i = i + 1) {\n"
+                   "  var a = array(100);\n"
+                   "  var s = \"a\" + str(i);\n"
+                   "}\n");
+    heap_profiler prof;
+    vm->set_heap_profiler(&prof);
+    REQUIRE(vm->interpret() == InterpretResult::INTERPRET_OK);
+    REQUIRE(prof.line(1).allocations == 2);
+    REQUIRE(prof.line(1).bytes > 100 * sizeof(double));
+    REQUIRE(prof.line(2).allocations == 0);
+    REQUIRE(prof.line(4).allocations == 20);
+    REQUIRE(prof.line(4).bytes >= 10 * prof.line(1).bytes);
+    // str() and the concatenation.
+    REQUIRE(prof.line(5).allocations == 20);
+
+    std::ostringstream out;
+    prof.write(out);
+    REQUIRE(out.str().starts_with("line      4"));
+}
@@ -0,0 +1,105 @@
+#include "map.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "object.hpp"
+#include "value.hpp"
+
+using namespace clox;
+
+static ValueType str(std::string chars)
+{
+    return std::make_shared<obj_string>(std::move(chars));
+}
+
+static ValueType get(const obj_map& map, const ValueType& key)
+{
+    const auto* value = map.find(key);
+    return value != nullptr ? *value : ValueType{nil{}};
+}
+
+TEST_CASE("map::set, find and erase", "[map]")
+{
+    obj_map map;
+    CHECK(map.find(str("a")) == nullptr);
+    CHECK(map.set(str("a"), std::int64_t{1}));
+    CHECK_FALSE(map.set(str("a"), std::int64_t{2}));
+    CHECK(get(map, str("a")) == ValueType{std::int64_t{2}});
+    CHECK(map.set(std::int64_t{1}, str("one")));
+    // Numbers are keys by value, whatever their representation.
+    CHECK(map.find(1.0) == map.find(std::int64_t{1}));
+    CHECK_FALSE(map.set(1.0, true));
+    CHECK(map.set(0.0, true));
+    CHECK(map.find(-0.0) != nullptr);
+    // A number never matches a string of its digits.
+    CHECK(map.find(str("1")) == nullptr);
+    CHECK(map.size() == 3);
+    CHECK(map.erase(std::int64_t{0}));
+    CHECK_FALSE(map.erase(0.0));
+    CHECK(map.erase(str("a")));
+    CHECK(map.size() == 1);
+    CHECK(get(map, 1.0) == ValueType{true});
+}
+
+TEST_CASE("map::valid keys", "[map]")
+{
+    CHECK(obj_map::valid_key(str("")));
+    CHECK(obj_map::valid_key(1.5));
+    CHECK(obj_map::valid_key(std::int64_t{-3}));
+    CHECK_FALSE(obj_map::valid_key(std::numeric_limits<double>::quiet_NaN()));
+    CHECK_FALSE(obj_map::valid_key(nil{}));
+    CHECK_FALSE(obj_map::valid_key(true));
+    CHECK_FALSE(obj_map::valid_key(std::make_shared<obj_map>()));
+}
+
+TEST_CASE("map::grows and shifts entries back on erase", "[map]")
+{
+    obj_map map;
+    for (std::int64_t idx = 0; idx < 1000; ++idx)
+    {
+        map.set(idx, idx * 2);
+        map.set(str(std::format("k{}", idx)), idx);
+        CHECK(map.size() * 8 <= map.capacity() * 7);
+    }
+    CHECK((map.capacity() & (map.capacity() - 1)) == 0);
+    // Erasing every other key must leave the rest reachable.
+    for (std::int64_t idx = 0; idx < 1000; idx += 2)
+    {
+        CHECK(map.erase(idx));
+        CHECK(map.erase(str(std::format("k{}", idx))));
+    }
+    CHECK(map.size() == 1000);
+    for (std::int64_t idx = 0; idx < 1000; ++idx)
+    {
+        const bool kept = idx % 2 == 1;
+        CHECK((map.find(idx) != nullptr) == kept);
+        CHECK(get(map, str(std::format("k{}", idx))) ==
+              (kept ? ValueType{idx} : ValueType{nil{}}));
+    }
+    // Churn reuses the emptied slots instead of growing.
+    const auto capacity = map.capacity();
+    for (std::int64_t idx = 0; idx < 10000; ++idx)
+    {
+        map.set(-1 - idx, idx);
+        map.erase(-1 - idx);
+    }
+    CHECK(map.capacity() == capacity);
+}
+
+TEST_CASE("map::prints its entries", "[map]")
+{
+    obj_map     map;
+    std::string out;
+    map.print(out);
+    CHECK(out == "{}");
+    map.set(str("a"), std::int64_t{1});
+    out.clear();
+    map.print(out);
+    CHECK(out == "{\"a\": '1'}");
+}
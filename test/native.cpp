@@ -0,0 +1,111 @@
+#include "native.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <numeric>
+#include <string>
+
+#include "compiler.hpp"
+#include "output.hpp"
+#include "vm.hpp"
+
+using namespace clox;
+
+static InterpretResult run(std::string source, std::string& out,
+                           void (*setup)(clox::vm&) = nullptr)
+{
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink sink;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(sink);
+    if (setup != nullptr)
+    {
+        setup(vm);
+    }
+    const auto result = vm.interpret();
+    out               = sink.str();
+    return result;
+}
+
+TEST_CASE("native::builtins", "[native]")
+{
+    const auto test = GENERATE(
+        std::make_pair("sqrt(16)", "'4'\n"),
+        std::make_pair("floor(2.5) + floor(-0.5)", "'1'\n"),
+        std::make_pair("abs(-3) + abs(1.5)", "'4.5'\n"),
+        std::make_pair("min(2, 1.5)", "'1.5'\n"),
+        std::make_pair("max(2, 1.5)", "'2'\n"),
+        std::make_pair("len(\"abc\" + \"de\")", "'5'\n"),
+        std::make_pair("str(1.5) + str(true) + str(nil) + str(\"s\")",
+                       "\"1.5truenils\"\n"),
+        std::make_pair("clock() > 0", "'true'\n"),
+        std::make_pair("var s = \"key=value\"; print substr(s, 4, 5);"
+                       "substr(substr(s, 0, 3), 1, 2) + substr(s, 9, 0)",
+                       "\"value\"\n\"ey\"\n"),
+        std::make_pair("var a = array(5); for (var i = 0; i < 5; i = i + 1)"
+                       "  a[i] = i; var b = add(a, scale(a, 2));"
+                       "print b; print sum(b); print dot(a, a);"
+                       "print min(b) + max(b); len(a)",
+                       "['0', '3', '6', '9', '12']\n'30'\n'30'\n'12'\n'5'\n"),
+        std::make_pair("var m = {1: 2}; print has(m, 1.0); print delete(m, 1);"
+                       "has(m, 1) or delete(m, 1) or len(m)",
+                       "'true'\n'true'\n'0'\n"),
+        std::make_pair("clock", "<native fn clock>\n"));
+    std::string out;
+    REQUIRE(run(test.first, out) == InterpretResult::INTERPRET_OK);
+    CHECK(out == test.second);
+}
+
+TEST_CASE("native::elapsed time", "[native]")
+{
+    std::string out;
+    REQUIRE(run("var start = clock(); var x = 0;"
+                "for (var i = 0; i < 1000; i = i + 1) x = x + i;"
+                "clock() - start >= 0",
+                out) == InterpretResult::INTERPRET_OK);
+    CHECK(out == "'true'\n");
+}
+
+TEST_CASE("native::errors", "[native]")
+{
+    std::string out;
+    CHECK(run(GENERATE("sqrt(\"a\");", "len(1);", "sqrt();", "min(1);",
+                       "fun f() { return abs(nil); } f();", "has(1, 1);",
+                       "has({}, nil);", "len(nil);", "array(-1);",
+                       "array(1.5);", "sum(1);", "dot(array(1), array(2));",
+                       "add(array(1), 1);", "scale(array(1), nil);",
+                       "min(array(0));", "max(1, 2, 3);",
+                       "substr(1, 0, 0);", "substr(\"ab\", 1, 2);",
+                       "substr(\"ab\", -1, 1);", "substr(\"ab\", 0.5, 1);"),
+              out) == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+static ValueType sum_native(std::span<const ValueType> args, std::string&)
+{
+    return std::accumulate(args.begin(), args.end(), ValueType{std::int64_t{0}},
+                           [](const ValueType& a, const ValueType& b)
+                           { return add_numbers(a, b); });
+}
+
+TEST_CASE("native::host functions", "[native]")
+{
+    std::string out;
+    REQUIRE(run("fun twice(x) { return sum(x, x); } print sum();"
+                "sum(1, 2, twice(3), 4.5)",
+                out, [](clox::vm& vm) { vm.define_native("sum", sum_native); })
+            == InterpretResult::INTERPRET_OK);
+    CHECK(out == "'0'\n'13.5'\n");
+    // Natives can be redefined.
+    REQUIRE(run("sqrt(2)", out,
+                [](clox::vm& vm)
+                {
+                    vm.define_native(
+                        "sqrt",
+                        [](std::span<const ValueType>, std::string&)
+                        { return ValueType{nil{}}; },
+                        1);
+                }) == InterpretResult::INTERPRET_OK);
+    CHECK(out == "nil\n");
+}
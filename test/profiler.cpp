@@ -0,0 +1,65 @@
+#include "profiler.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <sstream>
+
+#include "compiler.hpp"
+#include "vm.hpp"
+
+using namespace clox;
+
+TEST_CASE("profiler::samples every instruction", "[profiler]")
+{
+    clox::compiler comp{"1 +\n2 *\n3"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+
+    profiler prof{profiler::Mode::INSTRUCTIONS, 1};
+    clox::vm vm{std::move(*chunks)};
+    vm.set_profiler(&prof);
+    prof.start();
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    prof.stop();
+
+    // CONSTANT x3, MULTIPLY, ADD, RETURN.
+    CHECK(prof.samples() == 6);
+    CHECK(prof.line_samples(1) == 1);
+    CHECK(prof.line_samples(2) == 1);
+    CHECK(prof.line_samples(3) == 4);
+}
+
+TEST_CASE("profiler::folded output", "[profiler]")
+{
+    profiler prof;
+    prof.start();
+    const profile_frame a[] = {{0, 3}};
+    const profile_frame b[] = {{0, 3}, {1, 7}};
+    prof.sample(a);
+    prof.sample(a);
+    prof.sample(b);
+    prof.stop();
+
+    std::ostringstream out;
+    prof.write_folded(out);
+    CHECK(out.str() == "script:3 2\nscript:3;chunk1:7 1\n");
+}
+
+TEST_CASE("profiler::samples call stacks", "[profiler]")
+{
+    clox::compiler comp{"fun f() {\nreturn 1;\n}\nf();"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+
+    profiler prof{profiler::Mode::INSTRUCTIONS, 1};
+    clox::vm vm{std::move(*chunks)};
+    vm.set_profiler(&prof);
+    prof.start();
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    prof.stop();
+
+    // The function is defined once its body ends on line 3 and called on
+    // line 4; GET_GLOBAL, CALL, POP and RETURN run there.
+    std::ostringstream out;
+    prof.write_folded(out);
+    CHECK(out.str() == "script:3 2\nscript:4 4\nscript:4;f:2 2\n");
+}
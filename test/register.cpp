@@ -0,0 +1,141 @@
+#include "register.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <algorithm>
+
+#include "compiler.hpp"
+#include "output.hpp"
+#include "vm.hpp"
+
+using namespace clox;
+
+static chunk compile(std::string source)
+{
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    return std::move((*chunks)[0]);
+}
+
+TEST_CASE("reg_chunk::lower folds constants into operands", "[register]")
+{
+    const auto code = reg_chunk::lower(compile("1 + 2 * 3"));
+    REQUIRE(code.has_value());
+    REQUIRE(code->size() == 3);
+    CHECK(code->registers() == 2);
+
+    const auto* ins = code->code();
+    CHECK(ins[0].op == RegOpCode::MULTIPLY);
+    CHECK(ins[0].a == 1);
+    CHECK(ins[0].flags == (reg_instr::B_CONST | reg_instr::C_CONST));
+    CHECK(std::get<std::int64_t>(code->constant(ins[0].b)) == 2);
+    CHECK(std::get<std::int64_t>(code->constant(ins[0].c)) == 3);
+
+    CHECK(ins[1].op == RegOpCode::ADD);
+    CHECK(ins[1].a == 0);
+    CHECK(ins[1].flags == reg_instr::B_CONST);
+    CHECK(ins[1].c == 1);
+
+    CHECK(ins[2].op == RegOpCode::RETURN);
+    CHECK(ins[2].flags == 0);
+    CHECK(ins[2].b == 0);
+}
+
+TEST_CASE("reg_chunk::lower literals", "[register]")
+{
+    const auto code = reg_chunk::lower(compile("!nil == true"));
+    REQUIRE(code.has_value());
+    REQUIRE(code->size() == 3);
+    CHECK(code->code()[0].op == RegOpCode::NOT);
+    CHECK(code->code()[1].op == RegOpCode::EQUAL);
+    CHECK(std::get<bool>(code->constant(code->code()[1].c)) == true);
+}
+
+TEST_CASE("vm::register backend matches stack backend", "[register]")
+{
+    const auto source = GENERATE(
+        "1 + 2 * 3", "(4214 - 9549) / 2135", "-(1 + 2) * -3",
+        "!(5 - 4 > 3 * 2 == !nil)", "1 < 2", "2 <= 2", "3 >= 4",
+        R"("st" + "ri" + "ng")", R"("a" == "a")", "nil == false", "42",
+        "-true", R"(1 + "a")", "1 > nil");
+
+    std::string out[2];
+    int         result[2];
+    for (const auto backend : {Backend::STACK, Backend::REGISTER})
+    {
+        memory_sink sink;
+        clox::vm    vm{{compile(source)}};
+        vm.set_output(sink);
+        vm.set_backend(backend);
+        const auto idx = static_cast<int>(backend);
+        result[idx]    = static_cast<int>(vm.interpret());
+        out[idx]       = sink.str();
+    }
+    CHECK(result[0] == result[1]);
+    CHECK(out[0] == out[1]);
+}
+
+TEST_CASE("reg_chunk::lower fuses counted loops", "[register]")
+{
+    const auto code = reg_chunk::lower(
+        compile("for (var i = 0; i < 10; i = i + 1) print i;"));
+    REQUIRE(code.has_value());
+    const auto* begin = code->code();
+    const auto* end   = begin + code->size();
+    const auto* loop  = std::find_if(begin, end, [](const reg_instr& ins)
+                                     { return ins.op == RegOpCode::FOR_LOOP; });
+    REQUIRE(loop != end);
+    CHECK(loop->a == 0);
+    CHECK(loop->flags == reg_instr::B_CONST);
+    CHECK(begin[loop->c].op == RegOpCode::PRINT);
+}
+
+TEST_CASE("vm::register backend runs statements and loops", "[register]")
+{
+    const auto source = GENERATE(
+        "var a = 1; var b = a + 2; print a * b;",
+        "var s = 0; for (var i = 0; i < 100; i = i + 1) s = s + i; print s;",
+        "for (var i = 1; i <= 3; i = i + 1) { var sq = i * i; print sq; }",
+        "var i = 0; while (i < 5) { i = i + 1; if (i == 3) print i; }",
+        "{ var a = 1; var b = a; a = 2; print b; print a; a = a; print a; }",
+        "var x = 2; if (x > 1) print \"big\"; else print \"small\"; print x;",
+        "print nil or 1; print false and 2; print 1 and 2 or 3;",
+        "var n = 0; for (var i = 10; i > 0; i = i - 2) { n = n + 1; } n;",
+        "{ var lim = 4; for (var i = 0; i < lim; i = i + 1) print i; }",
+        "for (var i = 0; i < 3;) { print i; i = i + 1; }",
+        "var t = \"\"; for (var i = 0; i < 3; i = i + 1) t = t + \"ab\"; t;",
+        "print undefined;", "undefined = 1;",
+        "for (var i = 0; i < \"x\"; i = i + 1) print i;",
+        "{ var a = 1; { var b = a + 1; print b; } print -a; }");
+
+    std::string out[2];
+    int         result[2];
+    for (const auto backend : {Backend::STACK, Backend::REGISTER})
+    {
+        memory_sink sink;
+        clox::vm    vm{{compile(source)}};
+        vm.set_output(sink);
+        vm.set_backend(backend);
+        const auto idx = static_cast<int>(backend);
+        result[idx]    = static_cast<int>(vm.interpret());
+        out[idx]       = sink.str();
+        CHECK(vm.lowered() == (backend == Backend::REGISTER));
+    }
+    CHECK(result[0] == result[1]);
+    CHECK(out[0] == out[1]);
+}
+
+TEST_CASE("vm::register backend falls back for calls", "[register]")
+{
+    clox::compiler comp{"fun f(n) { return n + 1; } print f(1);"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink sink;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(sink);
+    vm.set_backend(Backend::REGISTER);
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    CHECK_FALSE(vm.lowered());
+    CHECK(sink.str() == "'2'\n");
+}
@@ -12,6 +12,9 @@ TEST_CASE("scanner::single", "[scanner]")
                  std::make_pair(")", TokenType::RIGHT_PAREN),
                  std::make_pair("{", TokenType::LEFT_BRACE),
                  std::make_pair("}", TokenType::RIGHT_BRACE),
+                 std::make_pair("[", TokenType::LEFT_BRACKET),
+                 std::make_pair("]", TokenType::RIGHT_BRACKET),
+                 std::make_pair(":", TokenType::COLON),
                  std::make_pair(",", TokenType::COMMA),
                  std::make_pair(".", TokenType::DOT),
                  std::make_pair("-", TokenType::MINUS),
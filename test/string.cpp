@@ -0,0 +1,46 @@
+#include "object.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace clox;
+
+TEST_CASE("string::substr shares the buffer", "[string]")
+{
+    auto       parent = std::make_shared<obj_string>("hello, world");
+    const auto slice  = obj_string::substr(parent, 7, 5);
+    CHECK(slice->str() == "world");
+    CHECK(slice->is_slice());
+    CHECK(slice->str().data() == parent->str().data() + 7);
+    // Slices of slices view the original buffer.
+    const auto inner = obj_string::substr(slice, 1, 3);
+    CHECK(inner->str() == "orl");
+    CHECK(inner->str().data() == parent->str().data() + 8);
+    // The slice keeps the characters alive.
+    parent.reset();
+    CHECK(inner->str() == "orl");
+}
+
+TEST_CASE("string::short slices of long buffers copy", "[string]")
+{
+    const auto parent =
+        std::make_shared<obj_string>(std::string(1000, 'x') + "needle");
+    const auto slice = obj_string::substr(parent, 1000, 6);
+    CHECK(slice->str() == "needle");
+    CHECK_FALSE(slice->is_slice());
+    CHECK(obj_string::substr(parent, 0, 126)->is_slice());
+}
+
+TEST_CASE("string::slices equal owned strings", "[string]")
+{
+    const auto source = std::make_shared<const std::string>("var s = \"ab\";");
+    const obj_string slice{source, std::string_view{*source}.substr(9, 2)};
+    const obj_string owned{"ab"};
+    CHECK(slice == owned);
+    CHECK(slice.hash() == owned.hash());
+    const auto sum = slice + owned;
+    CHECK(sum->str() == "abab");
+    CHECK_FALSE(sum->is_slice());
+}
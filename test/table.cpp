@@ -0,0 +1,106 @@
+#include "table.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <format>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "object.hpp"
+
+using namespace clox;
+
+static std::shared_ptr<obj_string> key(std::string chars)
+{
+    return std::make_shared<obj_string>(std::move(chars));
+}
+
+TEST_CASE("table::insert, find and erase", "[table]")
+{
+    table<int> tab;
+    const auto x = key("x");
+    CHECK(tab.find(*x) == nullptr);
+    CHECK(tab.insert_or_assign(x, 1));
+    CHECK_FALSE(tab.insert_or_assign(x, 2));
+    REQUIRE(tab.find(*x) != nullptr);
+    CHECK(*tab.find(*x) == 2);
+    // Equal contents match even without interning.
+    CHECK(tab.find(*key("x")) == tab.find(*x));
+    CHECK(tab.find(*key("y")) == nullptr);
+    CHECK(tab.size() == 1);
+    CHECK(tab.erase(*key("x")));
+    CHECK_FALSE(tab.erase(*x));
+    CHECK(tab.find(*x) == nullptr);
+    CHECK(tab.size() == 0);
+}
+
+TEST_CASE("table::grows in powers of two", "[table]")
+{
+    table<std::size_t>                       tab;
+    std::vector<std::shared_ptr<obj_string>> keys;
+    for (std::size_t idx = 0; idx < 1000; ++idx)
+    {
+        keys.push_back(key(std::format("name{}", idx)));
+        tab.insert_or_assign(keys.back(), idx);
+        CHECK(tab.size() * 4 <= tab.capacity() * 3);
+    }
+    CHECK((tab.capacity() & (tab.capacity() - 1)) == 0);
+    for (std::size_t idx = 0; idx < keys.size(); ++idx)
+    {
+        REQUIRE(tab.find(*keys[idx]) != nullptr);
+        CHECK(*tab.find(*keys[idx]) == idx);
+    }
+    std::size_t visited = 0;
+    tab.for_each([&visited](const auto&, const auto&) { ++visited; });
+    CHECK(visited == keys.size());
+}
+
+TEST_CASE("table::tombstones keep probe sequences intact", "[table]")
+{
+    // With a capacity of 8, these keys collide on their first slot.
+    table<int>                               tab;
+    std::vector<std::shared_ptr<obj_string>> colliding;
+    for (int idx = 0; colliding.size() < 4; ++idx)
+    {
+        auto candidate = key(std::format("k{}", idx));
+        if ((candidate->hash() & 7) == 0)
+        {
+            colliding.push_back(std::move(candidate));
+        }
+    }
+    for (const auto& name : colliding)
+    {
+        tab.insert_or_assign(name, 0);
+    }
+    REQUIRE(tab.capacity() == 8);
+    tab.erase(*colliding[0]);
+    tab.erase(*colliding[1]);
+    CHECK(tab.find(*colliding[3]) != nullptr);
+    // Reinserting reuses a tombstone instead of growing.
+    CHECK(tab.insert_or_assign(colliding[1], 1));
+    CHECK(tab.find(*colliding[0]) == nullptr);
+    CHECK(*tab.find(*colliding[1]) == 1);
+    CHECK(tab.size() == 3);
+    // Churn through many keys: tombstones are dropped on rehash instead of
+    // doubling the capacity forever.
+    for (int idx = 0; idx < 1000; ++idx)
+    {
+        const auto name = key(std::format("churn{}", idx));
+        tab.insert_or_assign(name, idx);
+        tab.erase(*name);
+    }
+    CHECK(tab.capacity() == 8);
+    CHECK(tab.size() == 3);
+}
+
+TEST_CASE("table::find_key interns strings", "[table]")
+{
+    table<std::monostate> strings;
+    const auto            init = key("init");
+    strings.insert_or_assign(init, {});
+    const auto* found = strings.find_key("init", hash_string("init"));
+    REQUIRE(found != nullptr);
+    CHECK(found->get() == init.get());
+    CHECK(strings.find_key("ini", hash_string("ini")) == nullptr);
+}
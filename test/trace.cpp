@@ -0,0 +1,79 @@
+#include "trace.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+#include "compiler.hpp"
+
+using namespace clox;
+
+TEST_CASE("tracer::capacity", "[trace]")
+{
+    tracer t{100};
+    CHECK(t.capacity() == 128);
+    CHECK(t.size() == 0);
+}
+
+TEST_CASE("tracer::wraps around", "[trace]")
+{
+    tracer t{4};
+    for (std::uint32_t i = 0; i < 10; ++i)
+    {
+        t.record(0, i, OpCode::OP_NIL, i, tracer::EMPTY_STACK);
+    }
+    REQUIRE(t.total() == 10);
+    REQUIRE(t.size() == 4);
+    const auto records = t.snapshot();
+    REQUIRE(records.size() == 4);
+    for (std::uint32_t i = 0; i < 4; ++i)
+    {
+        CHECK(records[i].offset == 6 + i);
+        CHECK(records[i].stack_depth == 6 + i);
+    }
+}
+
+TEST_CASE("tracer::save and load", "[trace]")
+{
+    tracer t{8};
+    for (std::uint32_t i = 0; i < 11; ++i)
+    {
+        t.record(1, i, OpCode::OP_ADD, 2, 0);
+    }
+    const auto path =
+        std::filesystem::temp_directory_path() / "clox_trace_test.bin";
+    REQUIRE(t.save(path));
+
+    tracer loaded{1};
+    REQUIRE(loaded.load(path));
+    std::filesystem::remove(path);
+
+    const auto expected = t.snapshot();
+    const auto actual   = loaded.snapshot();
+    REQUIRE(actual.size() == expected.size());
+    for (std::size_t i = 0; i < actual.size(); ++i)
+    {
+        CHECK(actual[i].offset == expected[i].offset);
+        CHECK(actual[i].chunk == 1);
+        CHECK(actual[i].opcode == OpCode::OP_ADD);
+    }
+}
+
+TEST_CASE("tracer::decodes the recorded opcode", "[trace]")
+{
+    clox::compiler comp{"1 + 2"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    // Quickened after the record was taken.
+    (*chunks)[0].patch(4, OpCode::OP_ADD_NUM);
+    tracer t{4};
+    t.record(0, 4, OpCode::OP_ADD, 2, 4);
+
+    std::ostringstream out;
+    auto* const        previous = std::cout.rdbuf(out.rdbuf());
+    t.decode(*chunks);
+    std::cout.rdbuf(previous);
+    CHECK(out.str().find("OP_ADD\n") != std::string::npos);
+    CHECK(out.str().find("OP_ADD_NUM") == std::string::npos);
+}
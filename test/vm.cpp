@@ -0,0 +1,583 @@
+#include "vm.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <string>
+
+#include "compiler.hpp"
+#include "object.hpp"
+#include "output.hpp"
+
+using namespace clox;
+
+static std::string run(std::string source)
+{
+    clox::compiler comp{std::move(source)};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    return out.str();
+}
+
+TEST_CASE("vm::prints result", "[vm]")
+{
+    const auto test = GENERATE(std::make_pair("1 + 2 * 3", "'7'\n"),
+                               std::make_pair("-(4 / 8)", "'-0.5'\n"),
+                               std::make_pair("!nil", "'true'\n"),
+                               std::make_pair("nil", "nil\n"),
+                               std::make_pair(R"("a" + "b")", "\"ab\"\n"),
+                               std::make_pair(R"("a" == "a")", "'true'\n"),
+                               std::make_pair("1 != 2", "'true'\n"),
+                               std::make_pair("2 >= 2", "'true'\n"),
+                               std::make_pair("3 <= 2", "'false'\n"),
+                               std::make_pair("-(1) + 1 == 0", "'true'\n"),
+                               std::make_pair("1.5 * 2 == 3", "'true'\n"),
+                               std::make_pair("7 / 2", "'3.5'\n"));
+    CHECK(run(test.first) == test.second);
+}
+
+TEST_CASE("vm::integers are indistinguishable from doubles", "[vm]")
+{
+    const auto test = GENERATE(
+        std::make_pair("999999 + 0", "'999999'\n"),
+        std::make_pair("999999 + 1", "'1e+06'\n"),
+        std::make_pair("-999999 - 1", "'-1e+06'\n"),
+        std::make_pair("-0", "'-0'\n"), std::make_pair("0 * -5", "'-0'\n"),
+        std::make_pair("0 - 0", "'0'\n"),
+        // Leaving the exact range continues in double arithmetic.
+        std::make_pair("9007199254740992 + 1 == 9007199254740992", "'true'\n"),
+        std::make_pair("4294967296 * 4294967296", "'1.84467e+19'\n"),
+        std::make_pair("3037000500 * 3037000500 > 9007199254740992",
+                       "'true'\n"),
+        std::make_pair("1 == 1.0", "'true'\n"),
+        std::make_pair("2 < 2.5", "'true'\n"));
+    CHECK(run(test.first) == test.second);
+}
+
+TEST_CASE("vm::mixes integers and doubles in double instructions", "[vm]")
+{
+    const auto test = GENERATE(std::make_pair("1.5 * 2", "'3'\n"),
+                               std::make_pair("2 - 0.5", "'1.5'\n"),
+                               std::make_pair("7 / 2", "'3.5'\n"),
+                               std::make_pair("1 + 2.5 == 3.5", "'true'\n"),
+                               std::make_pair("3 != 2.5", "'true'\n"),
+                               std::make_pair("3 < 2.5", "'false'\n"),
+                               std::make_pair("-(0.5) * 4 >= -2", "'true'\n"),
+                               std::make_pair("(1 + 2) * 0.5", "'1.5'\n"));
+    CHECK(run(test.first) == test.second);
+}
+
+TEST_CASE("vm::integer arithmetic promotes to double", "[vm]")
+{
+    const ValueType max = MAX_EXACT_INT;
+    const ValueType min = -MAX_EXACT_INT;
+    const ValueType two = std::int64_t{2};
+
+    CHECK(std::get<std::int64_t>(add_numbers(two, two)) == 4);
+    CHECK(std::get<std::int64_t>(negate_number(max)) == -MAX_EXACT_INT);
+    CHECK(std::holds_alternative<double>(add_numbers(max, two)));
+    CHECK(std::holds_alternative<double>(subtract_numbers(min, two)));
+    CHECK(std::holds_alternative<double>(multiply_numbers(max, max)));
+    CHECK(std::holds_alternative<double>(divide_numbers(two, two)));
+    CHECK(std::signbit(std::get<double>(negate_number(std::int64_t{0}))));
+    CHECK(std::holds_alternative<double>(make_number(-0.)));
+    CHECK(std::holds_alternative<std::int64_t>(make_number(-2.)));
+}
+
+TEST_CASE("vm::global variables", "[vm]")
+{
+    CHECK(run("var a = 1; var b = a + 1; print a; b = a = b * 10; a + b") ==
+          "'1'\n'40'\n");
+    CHECK(run("var a; print a; var a = 2; a") == "nil\n'2'\n");
+    // A script without a trailing expression has no result.
+    CHECK(run("var s = \"x\"; s = s + s;").empty());
+}
+
+TEST_CASE("vm::block scoped locals", "[vm]")
+{
+    CHECK(run("var a = \"global\";"
+              "{ var a = 1; { var b = a + 1; print b; } a = a * 10; print a; }"
+              "a") == "'2'\n'10'\n\"global\"\n");
+    // Shadowing in sibling scopes reuses the same slots.
+    CHECK(run("{ var x = 1; var y = 2; print x + y; }"
+              "{ var z = 3; print z; }"
+              "{ var a; var b; var c; var d = 4; print d; } 5") ==
+          "'3'\n'3'\n'4'\n'5'\n");
+}
+
+TEST_CASE("vm::if and while", "[vm]")
+{
+    CHECK(run("if (1 < 2) print 1; else print 2;"
+              "if (nil) print 3; else print 4;"
+              "if (false) print 5;") == "'1'\n'4'\n");
+    CHECK(run("var i = 0; var s = 0;"
+              "while (i < 5) { s = s + i; i = i + 1; } s") == "'10'\n");
+}
+
+TEST_CASE("vm::for loops", "[vm]")
+{
+    // Fused counted loops, with constant and local limits.
+    CHECK(run("var s = 0; for (var i = 0; i < 4; i = i + 1) s = s + i; s") ==
+          "'6'\n");
+    CHECK(run("var s = 0; { var n = 4;"
+              "for (var i = 1; i <= n; i = i + 1) { var q = i * i; s = s + q; }"
+              "} s") == "'30'\n");
+    CHECK(run("for (var i = 0.5; i < 2; i = i + 1) print i;") ==
+          "'0.5'\n'1.5'\n");
+    CHECK(run("for (var i = 5; i < 1; i = i + 1) print i; 0") == "'0'\n");
+    // The body may change the counter.
+    CHECK(run("for (var i = 0; i < 10; i = i + 1) { print i; i = i + 4; }") ==
+          "'0'\n'5'\n");
+    // Generic loops.
+    CHECK(run("for (var i = 3; i > 0; i = i - 1) print i;") ==
+          "'3'\n'2'\n'1'\n");
+    CHECK(run("var i = 0; for (; i < 2;) i = i + 1; i") == "'2'\n");
+}
+
+TEST_CASE("vm::and and or return an operand", "[vm]")
+{
+    const auto test = GENERATE(std::make_pair("1 and 2", "'2'\n"),
+                               std::make_pair("nil and 2", "nil\n"),
+                               std::make_pair("false or \"x\"", "\"x\"\n"),
+                               std::make_pair("1 or 2", "'1'\n"),
+                               std::make_pair("nil or false", "'false'\n"),
+                               std::make_pair("1 < 2 and 3 < 4", "'true'\n"),
+                               std::make_pair("false and 1 or 2", "'2'\n"));
+    CHECK(run(test.first) == test.second);
+    // The right operand is not evaluated when the left one decides.
+    CHECK(run("var a = 0; false and (a = 1); true or (a = 2); a") == "'0'\n");
+}
+
+TEST_CASE("vm::runtime errors in loops", "[vm]")
+{
+    clox::compiler comp{
+        GENERATE("for (var i = \"a\"; i < 3; i = i + 1) {}",
+                 "{ var n = nil; for (var i = 0; i < n; i = i + 1) {} }",
+                 "var i = 0; while (i < 3) i = i + nil;")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::functions", "[vm]")
+{
+    CHECK(run("fun fib(n) { if (n < 2) return n;"
+              "  return fib(n - 2) + fib(n - 1); }"
+              "fib(15)") == "'610'\n");
+    CHECK(run("fun f(a, b) { var c = a * b; { var d = c + 1; return d; } }"
+              "print f(2, 3); f") == "'7'\n<fn f>\n");
+    // Locals are frame relative, also in functions declared in a block.
+    CHECK(run("{ var x = 10; fun g(y) { var z = 1; return y + z; }"
+              "  print g(x); print x; }") == "'11'\n'10'\n");
+    CHECK(run("fun none() {} fun early() { return; } none() == early()") ==
+          "'true'\n");
+    // Counted loops inside a function.
+    CHECK(run("fun sum(n) { var s = 0;"
+              "  for (var i = 1; i <= n; i = i + 1) s = s + i; return s; }"
+              "sum(10)") == "'55'\n");
+}
+
+TEST_CASE("vm::tail calls run in constant frames", "[vm]")
+{
+    // Far deeper than the frame array.
+    CHECK(run("fun count(n, acc) { if (n == 0) return acc;"
+              "  return count(n - 1, acc + 1); }"
+              "count(100000, 0)") == "'100000'\n");
+    CHECK(run("fun even(n) { if (n == 0) return true; return odd(n - 1); }"
+              "fun odd(n) { if (n == 0) return false; return even(n - 1); }"
+              "even(10001)") == "'false'\n");
+}
+
+TEST_CASE("vm::closures", "[vm]")
+{
+    // Each counter owns its variable, shared by both of its closures.
+    CHECK(run("fun counter() { var n = 0;"
+              "  fun inc() { n = n + 1; return n; } return inc; }"
+              "var a = counter(); var b = counter();"
+              "a(); a(); b(); a()") == "'3'\n");
+    CHECK(run("fun pair() { var n = 0; fun get() { return n; }"
+              "  fun set(v) { n = v; } set(5); return get; }"
+              "pair()()") == "'5'\n");
+    // Flat captures copy the value; boxed ones see later assignments.
+    CHECK(run("{ var x = 1; fun get() { return x; } print get(); }"
+              "{ var y = 1; fun get() { return y; } y = 2; print get(); }") ==
+          "'1'\n'2'\n");
+    // A variable outlives its block and each loop pass gets a fresh one.
+    CHECK(run("var fs; { var i = 0; while (i < 3) { var j = i;"
+              "  fun f() { return j; } if (i == 1) fs = f; i = i + 1; } }"
+              "fs()") == "'1'\n");
+    // Captures pass through functions that never use them.
+    CHECK(run("fun outer() { var x = \"x\"; fun middle() {"
+              "  fun inner() { return x; } return inner; }"
+              "  x = x + \"!\"; return middle(); }"
+              "outer()()") == "\"x!\"\n");
+    // Closures may call themselves and be tail called.
+    CHECK(run("{ var step = 2; fun down(n) { if (n <= 0) return n;"
+              "  return down(n - step); } print down(100001); }") ==
+          "'-1'\n");
+}
+
+TEST_CASE("vm::classes", "[vm]")
+{
+    CHECK(run("class P { init(x, y) { this.x = x; this.y = y; }"
+              "  sum() { return this.x + this.y; } }"
+              "var p = P(1, 2); print p.sum(); p.x = 10; print p.sum();"
+              "print p; P") == "'3'\n'12'\nP instance\nP\n");
+    // Fields shadow methods; bound methods keep their receiver.
+    CHECK(run("class A { f() { return 1; } } var a = A(); var f = a.f;"
+              "a.f = 2; print a.f; f()") == "'2'\n'1'\n");
+    CHECK(run("class A { name() { return \"a\"; } hi() { return \"A\"; } }"
+              "class B < A { hi() { return super.hi() + this.name(); } }"
+              "B().hi()") == "\"Aa\"\n");
+    // Initializers return the receiver, also on an early return.
+    CHECK(run("class C { init(n) { this.n = n; if (n > 0) return;"
+              "  this.n = 1; } } var c = C(5); print c.init(0) == c; c.n") ==
+          "'true'\n'1'\n");
+    // 'this' is captured like any other variable.
+    CHECK(run("class D { init() { fun get() { return this; }"
+              "  this.get = get; } } var d = D(); d.get() == d") ==
+          "'true'\n");
+    CHECK(run("class E {} var e = E(); e.x = e.y = 3; e.x + e.y") == "'6'\n");
+}
+
+TEST_CASE("vm::property sites cache instance shapes", "[vm]")
+{
+    clox::compiler comp{"class P { init(a, b) { this.x = a; this.y = b; } }"
+                        "class Q { init() { this.y = 0; this.x = 1; } }"
+                        "fun get(p) { return p.x; } var sum = 0;"
+                        "for (var i = 0; i < 3; i = i + 1)"
+                        "  sum = sum + get(P(i, 0)) + get(Q());"
+                        "sum"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    CHECK(out.str() == "'6'\n");
+    // Every P shares one shape, and so does every Q.
+    const auto& get = vm.chunks()[3].property(0);
+    CHECK(get.cached == 2);
+    // The initializers' sites remember the shape transitions they make.
+    const auto& set_x = vm.chunks()[1].property(0);
+    REQUIRE(set_x.cached == 1);
+    CHECK(set_x.cache[0].to != nullptr);
+    CHECK(set_x.cache[0].slot == 0);
+}
+
+TEST_CASE("vm::megamorphic property sites stay correct", "[vm]")
+{
+    CHECK(run("class A {} fun get(o) { return o.v; } var sum = 0;"
+              "for (var i = 0; i < 6; i = i + 1) { var a = A();"
+              "  if (i > 0) a.p0 = 0; if (i > 1) a.p1 = 0; if (i > 2) a.p2 = 0;"
+              "  if (i > 3) a.p3 = 0; if (i > 4) a.p4 = 0;"
+              "  a.v = i; sum = sum + get(a); }"
+              "sum") == "'15'\n");
+}
+
+TEST_CASE("vm::invoke", "[vm]")
+{
+    // A field holding a function shadows the method of the same name.
+    CHECK(run("class A { f() { return \"method\"; } }"
+              "fun g() { return \"field\"; } var a = A(); print a.f();"
+              "a.f = g; a.f()") == "\"method\"\n\"field\"\n");
+    CHECK(run("class A { f(x) { return x + 1; } }"
+              "class B < A { f(x) { return super.f(x) * 2; } }"
+              "B().f(1)") == "'4'\n");
+    // Invokes in tail position replace the caller's frame.
+    CHECK(run("class C { down(n) { if (n == 0) return 0;"
+              "  return this.down(n - 1); } }"
+              "C().down(100000)") == "'0'\n");
+    CHECK(run("class A { down(n) { if (n == 0) return 0;"
+              "  return this.down(n - 1); } }"
+              "class B < A { down(n) { return super.down(n); } }"
+              "B().down(100000)") == "'0'\n");
+}
+
+TEST_CASE("vm::invoke sites cache methods", "[vm]")
+{
+    clox::compiler comp{"class A { f() { return 1; } } var a = A(); var n = 0;"
+                        "for (var i = 0; i < 3; i = i + 1) n = n + a.f();"
+                        "n"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    CHECK(out.str() == "'3'\n");
+    const auto& site = vm.chunks()[0].property(0);
+    CHECK(site.name->str() == "f");
+    REQUIRE(site.cached == 1);
+    CHECK(site.cache[0].method != nullptr);
+}
+
+TEST_CASE("vm::class errors", "[vm]")
+{
+    clox::compiler comp{GENERATE(
+        "var x = 1; x.y;", "var x = 1; x.y = 2;", "class A {} A().y;",
+        "class A {} A(1);", "class A { init(a) {} } A();",
+        "var B = 1; class A < B {}",
+        "class A {} class B < A { f() { return super.g(); } } B().f();",
+        "class A {} class B < A { f() { return super.g; } } B().f();",
+        "var a = 1; a.f();", "class A {} A().f();",
+        "class A { f(x) {} } A().f();")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::maps", "[vm]")
+{
+    CHECK(run("var m = {\"a\": 1, 2: \"two\"}; print m[\"a\"]; print m[2.0];"
+              "m[\"a\"] = m[\"a\"] + 1; print m; m[\"b\"]") ==
+          "'1'\n\"two\"\n{\"a\": '2', '2': \"two\"}\nnil\n");
+    // A '{' that starts a statement is a block.
+    CHECK(run("{} ({})") == "{}\n");
+    // Keys built at runtime find the entries of literal keys.
+    CHECK(run("var m = {}; m[\"ab\"] = 1; var k = \"a\" + \"b\";"
+              "m[k] = m[k] + 1; print len(m); m[\"ab\"]") == "'1'\n'2'\n");
+    CHECK(run("class C { init() { this.m = {}; } } var c = C();"
+              "c.m[\"x\"] = 3; c.m[\"x\"]") == "'3'\n");
+    CHECK(run("var m = {}; for (var i = 0; i < 100; i = i + 1) m[i] = i * i;"
+              "for (var i = 0; i < 100; i = i + 2) delete(m, i);"
+              "var sum = 0; for (var i = 0; i < 100; i = i + 1)"
+              "  if (has(m, i)) sum = sum + m[i];"
+              "sum") == "'166650'\n");
+}
+
+TEST_CASE("vm::map errors", "[vm]")
+{
+    clox::compiler comp{GENERATE("var m = {nil: 1};", "var m = {}; m[true];",
+                                 "var m = {}; m[{}] = 1;", "var a = 1; a[0];",
+                                 "var a = \"s\"; a[0] = 1;",
+                                 "var m = {}; m[0 / 0] = 1;")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::arrays", "[vm]")
+{
+    CHECK(run("var a = array(3); a[0] = 1.5; a[2.0] = a[0] * 2; print a[1];"
+              "a") == "'0'\n['1.5', '0', '3']\n");
+    CHECK(run("var a = array(1000); for (var i = 0; i < 1000; i = i + 1)"
+              "  a[i] = i; sum(a)") == "'499500'\n");
+}
+
+TEST_CASE("vm::array errors", "[vm]")
+{
+    clox::compiler comp{GENERATE("var a = array(2); a[2];",
+                                 "var a = array(2); a[-1] = 0;",
+                                 "var a = array(2); a[0.5];",
+                                 "var a = array(2); a[\"0\"];",
+                                 "var a = array(2); a[0] = \"x\";")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::call errors", "[vm]")
+{
+    clox::compiler comp{
+        GENERATE("fun f(a) {} f();", "fun f() {} f(1);", "var x = 1; x();",
+                 "\"f\"();", "fun f(n) { return 1 + f(n); } f(1);",
+                 "fun f() { return 1 + nil; } fun g() { f(); } g();")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::undefined global is a runtime error", "[vm]")
+{
+    clox::compiler comp{GENERATE("print x;", "x = 1;", "var y = x;")};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    memory_sink out;
+    clox::vm    vm{std::move(*chunks)};
+    vm.set_output(out);
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST_CASE("vm::load keeps globals", "[vm]")
+{
+    memory_sink out;
+    clox::vm    vm{{}};
+    vm.set_output(out);
+    for (const auto* line : {"var b = 2;", "var a = 1;", "a = a + b;", "a"})
+    {
+        clox::compiler comp{line};
+        auto           chunks = comp.compile();
+        REQUIRE(chunks.has_value());
+        vm.load(std::move(*chunks));
+        REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    }
+    CHECK(out.str() == "'3'\n");
+}
+
+TEST_CASE("vm::load keeps functions callable", "[vm]")
+{
+    memory_sink out;
+    clox::vm    vm{{}};
+    vm.set_output(out);
+    for (const auto* line : {"fun twice(x) { return x * 2; }",
+                             "fun quad(x) { return twice(twice(x)); }",
+                             "quad(3)"})
+    {
+        clox::compiler comp{line};
+        auto           chunks = comp.compile();
+        REQUIRE(chunks.has_value());
+        vm.load(std::move(*chunks));
+        REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    }
+    CHECK(out.str() == "'12'\n");
+}
+
+TEST_CASE("vm::too many globals is an error", "[vm]")
+{
+    const auto declare = [](int first, int count)
+    {
+        std::string source;
+        for (int idx = first; idx < first + count; ++idx)
+        {
+            source += std::format("var g{};\n", idx);
+        }
+        clox::compiler comp{std::move(source)};
+        auto           chunks = comp.compile();
+        REQUIRE(chunks.has_value());
+        return std::move(*chunks);
+    };
+    memory_sink out;
+    clox::vm    vm{declare(0, 40000)};
+    vm.set_output(out);
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    vm.load(declare(40000, 40000));
+    CHECK(vm.interpret() == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    // The globals defined so far keep their slots.
+    clox::compiler comp{"g39999 = 7; g39999"};
+    auto           chunks = comp.compile();
+    REQUIRE(chunks.has_value());
+    vm.load(std::move(*chunks));
+    REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+    CHECK(out.str() == "'7'\n");
+}
+
+TEST_CASE("fd_sink::buffers until flush", "[vm]")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    {
+        fd_sink sink{fds[1]};
+        sink.write("hello ");
+        sink.write("world");
+        char buf[16];
+        // Nothing reached the pipe yet.
+        REQUIRE(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+        CHECK(read(fds[0], buf, sizeof(buf)) == -1);
+        sink.flush();
+        const auto n = read(fds[0], buf, sizeof(buf));
+        REQUIRE(n == 11);
+        CHECK(std::string(buf, n) == "hello world");
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE("fd_sink::keeps standard output in order with std::cout", "[vm]")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    std::cout.flush();
+    const int saved = dup(STDOUT_FILENO);
+    REQUIRE(dup2(fds[1], STDOUT_FILENO) == STDOUT_FILENO);
+    {
+        fd_sink sink{STDOUT_FILENO};
+        std::cout << "> ";
+        sink.write("1\n");
+        sink.flush();
+        std::cout << "> " << std::flush;
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    char       buf[16];
+    const auto n = read(fds[0], buf, sizeof(buf));
+    REQUIRE(n == 6);
+    CHECK(std::string(buf, n) == "> 1\n> ");
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE("vm::quickens instructions after first execution", "[vm]")
+{
+    // Assembled by hand: the compiler already emits the unchecked forms for
+    // operands it can type, so only untyped code reaches the generic ones.
+    // 1 + 2 < 4 == ("a" + "b" == "ab")
+    chunk code;
+    const auto constant = [&code](ValueType val)
+    {
+        code.write_chunk(OpCode::OP_CONSTANT, 1);
+        code.write_chunk(
+            static_cast<std::uint8_t>(code.add_constant(std::move(val))), 1);
+    };
+    constant(1.);
+    constant(2.);
+    code.write_chunk(OpCode::OP_ADD, 1);
+    constant(4.);
+    code.write_chunk(OpCode::OP_LESS, 1);
+    constant(std::make_shared<obj_string>("a"));
+    constant(std::make_shared<obj_string>("b"));
+    code.write_chunk(OpCode::OP_ADD, 1);
+    constant(std::make_shared<obj_string>("ab"));
+    code.write_chunk(OpCode::OP_EQUAL, 1);
+    code.write_chunk(OpCode::OP_EQUAL, 1);
+    code.write_chunk(OpCode::OP_RETURN, 1);
+
+    memory_sink sink;
+    clox::vm    vm{{std::move(code)}};
+    vm.set_output(sink);
+
+    const auto& quickened = vm.chunks()[0];
+    const auto  op        = [&quickened](int offset)
+    { return static_cast<OpCode>(*quickened.get_instruction(offset)); };
+    CHECK(op(4) == OpCode::OP_ADD);
+    CHECK(op(7) == OpCode::OP_LESS);
+    CHECK(op(12) == OpCode::OP_ADD);
+    CHECK(op(15) == OpCode::OP_EQUAL);
+    CHECK(op(16) == OpCode::OP_EQUAL);
+
+    for (int run = 0; run < 2; ++run)
+    {
+        REQUIRE(vm.interpret() == InterpretResult::INTERPRET_OK);
+        CHECK(op(4) == OpCode::OP_ADD_NUM);
+        CHECK(op(7) == OpCode::OP_LESS_NUM);
+        CHECK(op(12) == OpCode::OP_ADD_STR);
+        // String and bool operands: stays generic.
+        CHECK(op(15) == OpCode::OP_EQUAL);
+        CHECK(op(16) == OpCode::OP_EQUAL);
+    }
+    CHECK(sink.str() == "'true'\n'true'\n");
+}
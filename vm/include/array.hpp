@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "object.hpp"
+
+namespace clox
+{
+// Bulk kernels over contiguous doubles, written with the compiler's generic
+// vector types so that they use SSE2/AVX or NEON. On x86-64 an AVX2 variant
+// is picked at load time where the CPU has it. Sums accumulate in several
+// lanes, so their rounding can differ from a sequential loop.
+namespace simd
+{
+double sum(std::span<const double> xs);
+// 'xs' and 'ys' have the same size.
+double dot(std::span<const double> xs, std::span<const double> ys);
+// 'xs', 'ys' and 'out' have the same size.
+void   add(std::span<const double> xs, std::span<const double> ys,
+           std::span<double> out);
+void   scale(std::span<const double> xs, double factor, std::span<double> out);
+// 'xs' is not empty. The result is unspecified if it holds a NaN.
+double min(std::span<const double> xs);
+double max(std::span<const double> xs);
+}  // namespace simd
+
+// A fixed-size array of unboxed doubles, for numeric data that the natives
+// above process in one call.
+class obj_array : public obj
+{
+    std::vector<double, heap_allocator<double>> values_;
+
+  public:
+    static constexpr std::size_t MAX_SIZE = std::size_t{1} << 28;
+
+    explicit obj_array(std::size_t size);
+    explicit obj_array(std::span<const double> values);
+    ObjType type() const override;
+    void    print(std::string& out) const override;
+    bool    operator==(const obj& other) const override;
+    std::span<double>       values() noexcept { return values_; }
+    std::span<const double> values() const noexcept { return values_; }
+};
+
+}  // namespace clox
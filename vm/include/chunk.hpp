@@ -1,6 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "value.hpp"
@@ -23,22 +27,269 @@ enum class OpCode : std::uint8_t
     OP_NOT,
     OP_NEGATE,
     OP_RETURN,
+    OP_POP,
+    OP_PRINT,
+    // Have a two-byte big-endian operand: the index of the variable's name
+    // in the chunk's 'globals_' table, or its vm slot once linked, see
+    // chunk::link.
+    OP_DEFINE_GLOBAL,
+    OP_GET_GLOBAL,
+    OP_SET_GLOBAL,
+    // Operand is the stack slot of the local variable.
+    OP_GET_LOCAL,
+    OP_SET_LOCAL,
+    OP_POPN,  // Operand is the number of values to pop.
+    // Have a two-byte big-endian operand: the distance from the end of the
+    // instruction to the target, forwards for jumps and backwards for
+    // OP_LOOP.
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,         // Pops the condition.
+    OP_JUMP_IF_FALSE_OR_POP,  // Keeps the operand of 'and' when jumping.
+    OP_JUMP_IF_TRUE_OR_POP,   // Keeps the operand of 'or' when jumping.
+    OP_LOOP,
+    // Fused 'i = i + 1; if (i < limit) loop' that closes a counted for loop.
+    // Operands: the counter's slot, the limit (a slot or a constant index),
+    // LOOP_* flags and the backward distance to the loop body.
+    OP_FOR_LOOP,
+    // Operand is the argument count; the callee sits below the arguments.
+    OP_CALL,
+    OP_TAIL_CALL,  // A call in tail position: replaces the caller's frame.
+    // Operand is the function's constant index. Pushes a closure whose
+    // captures are appended by the OP_CAPTURE_* instructions that follow.
+    OP_CLOSURE,
+    // Operands are frame slots or capture indexes. Captured variables that
+    // are never assigned are copied into the closure ('_FLAT'); the others
+    // are shared through an upvalue box.
+    OP_CAPTURE_LOCAL,
+    OP_CAPTURE_LOCAL_FLAT,
+    OP_CAPTURE_UPVALUE,  // Copies the running closure's capture.
+    OP_GET_UPVALUE,
+    OP_GET_UPVALUE_FLAT,
+    OP_SET_UPVALUE,
+    OP_CLOSE_UPVALUE,  // Moves the top slot into its box and pops it.
+    // Operand is the class name's constant index.
+    OP_CLASS,
+    OP_INHERIT,  // Copies the superclass's methods into the class on top.
+    OP_METHOD,   // Operand is the name's constant index.
+    // Have a two-byte big-endian operand: the index of the instruction's
+    // site in the chunk's 'properties_' table, which holds its inline cache.
+    OP_GET_PROPERTY,
+    OP_SET_PROPERTY,
+    OP_GET_SUPER,  // Binds a method of the superclass on top of the stack.
+    // Fused property read and call that never creates a bound method.
+    // Operands are a two-byte property site as above and the argument count;
+    // the receiver sits below the arguments. The super forms find the
+    // superclass on top of the stack.
+    OP_INVOKE,
+    OP_TAIL_INVOKE,
+    OP_SUPER_INVOKE,
+    OP_TAIL_SUPER_INVOKE,
+    // Operand is the number of key-value pairs on the stack, which the new
+    // map replaces.
+    OP_MAP,
+    // Index a map or an array. The get replaces the receiver and key with
+    // the value; the set replaces the receiver, key and value with the value.
+    OP_INDEX_GET,
+    OP_INDEX_SET,
+    // Type-specialized forms the vm rewrites generic instructions into once
+    // it has seen their operand types. Never emitted by the compiler.
+    OP_ADD_NUM,
+    OP_ADD_STR,
+    OP_EQUAL_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    // Double arithmetic the compiler emits when it has proven that both
+    // operands are numbers and that the generic form would compute in
+    // doubles too: one operand is a double, or the operator divides.
+    OP_ADD_F64,
+    OP_SUBTRACT_F64,
+    OP_MULTIPLY_F64,
+    OP_DIVIDE_F64,
+    OP_NEGATE_F64,
+    OP_EQUAL_F64,
+    OP_GREATER_F64,
+    OP_LESS_F64,
+};
+
+// Maps a specialized instruction back to its generic form.
+constexpr OpCode generic_opcode(OpCode op)
+{
+    switch (op)
+    {
+        case OpCode::OP_ADD_NUM:
+        case OpCode::OP_ADD_STR:
+        case OpCode::OP_ADD_F64:
+            return OpCode::OP_ADD;
+        case OpCode::OP_SUBTRACT_F64:
+            return OpCode::OP_SUBTRACT;
+        case OpCode::OP_MULTIPLY_F64:
+            return OpCode::OP_MULTIPLY;
+        case OpCode::OP_DIVIDE_F64:
+            return OpCode::OP_DIVIDE;
+        case OpCode::OP_NEGATE_F64:
+            return OpCode::OP_NEGATE;
+        case OpCode::OP_EQUAL_NUM:
+        case OpCode::OP_EQUAL_F64:
+            return OpCode::OP_EQUAL;
+        case OpCode::OP_GREATER_NUM:
+        case OpCode::OP_GREATER_F64:
+            return OpCode::OP_GREATER;
+        case OpCode::OP_LESS_NUM:
+        case OpCode::OP_LESS_F64:
+            return OpCode::OP_LESS;
+        default:
+            return op;
+    }
+}
+
+// OP_FOR_LOOP flags.
+inline constexpr std::uint8_t LOOP_LIMIT_CONST = 1;
+inline constexpr std::uint8_t LOOP_INCLUSIVE   = 2;  // i <= limit
+
+// Number of operand bytes following 'op'.
+constexpr int operand_size(OpCode op)
+{
+    switch (op)
+    {
+        case OpCode::OP_CONSTANT:
+        case OpCode::OP_GET_LOCAL:
+        case OpCode::OP_SET_LOCAL:
+        case OpCode::OP_POPN:
+        case OpCode::OP_CALL:
+        case OpCode::OP_TAIL_CALL:
+        case OpCode::OP_CLOSURE:
+        case OpCode::OP_CAPTURE_LOCAL:
+        case OpCode::OP_CAPTURE_LOCAL_FLAT:
+        case OpCode::OP_CAPTURE_UPVALUE:
+        case OpCode::OP_GET_UPVALUE:
+        case OpCode::OP_GET_UPVALUE_FLAT:
+        case OpCode::OP_SET_UPVALUE:
+        case OpCode::OP_CLASS:
+        case OpCode::OP_METHOD:
+        case OpCode::OP_MAP:
+            return 1;
+        case OpCode::OP_DEFINE_GLOBAL:
+        case OpCode::OP_GET_GLOBAL:
+        case OpCode::OP_SET_GLOBAL:
+        case OpCode::OP_JUMP:
+        case OpCode::OP_JUMP_IF_FALSE:
+        case OpCode::OP_JUMP_IF_FALSE_OR_POP:
+        case OpCode::OP_JUMP_IF_TRUE_OR_POP:
+        case OpCode::OP_LOOP:
+        case OpCode::OP_GET_PROPERTY:
+        case OpCode::OP_SET_PROPERTY:
+        case OpCode::OP_GET_SUPER:
+            return 2;
+        case OpCode::OP_INVOKE:
+        case OpCode::OP_TAIL_INVOKE:
+        case OpCode::OP_SUPER_INVOKE:
+        case OpCode::OP_TAIL_SUPER_INVOKE:
+            return 3;
+        case OpCode::OP_FOR_LOOP:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+class obj_string;
+class shape;
+
+// Inline cache entry of a property instruction: receivers of shape 'from'
+// hold the property in field 'slot'. When an OP_SET_PROPERTY adds the
+// field, 'to' is the shape the receiver moves to. Invoke sites may cache a
+// method of the receiver's class instead, which stays alive with any
+// instance of shape 'from'.
+struct property_cache
+{
+    std::shared_ptr<shape> from;
+    std::shared_ptr<shape> to;
+    std::size_t            slot   = 0;
+    const ValueType*       method = nullptr;
+};
+
+// The name and inline cache of one property instruction. The cache is
+// monomorphic at first and becomes polymorphic up to CACHE_SIZE shapes;
+// sites that see more take the slow path for the shapes left out.
+struct property_site
+{
+    static constexpr std::size_t CACHE_SIZE = 4;
+
+    std::shared_ptr<obj_string>            name;  // Interned when linked.
+    std::array<property_cache, CACHE_SIZE> cache  = {};
+    std::size_t                            cached = 0;
+
+    const property_cache* find(const shape* layout) const noexcept
+    {
+        for (std::size_t idx = 0; idx < cached; ++idx)
+        {
+            if (cache[idx].from.get() == layout)
+            {
+                return &cache[idx];
+            }
+        }
+        return nullptr;
+    }
+    void remember(property_cache entry)
+    {
+        if (cached < CACHE_SIZE)
+        {
+            cache[cached++] = std::move(entry);
+        }
+    }
 };
 
 class chunk
 {
-    std::vector<std::uint8_t> code_;
-    std::vector<ValueType>    constants_;
-    std::vector<int>          lines_;
+    std::vector<std::uint8_t>  code_;
+    std::vector<ValueType>     constants_;
+    std::vector<int>           lines_;
+    std::vector<std::string>   globals_;
+    std::vector<property_site> properties_;
+    // The vm's global names by slot, shared by every chunk linked to it.
+    std::shared_ptr<const std::vector<std::string>> slot_names_;
 
     using const_idx_t = std::size_t;
 
   public:
+    using global_idx_t = std::size_t;
+
     template <class T>
     void                write_chunk(T code, int line);
     const_idx_t         add_constant(ValueType val);
+    // Returns the index of 'name' in the global table, adding it if needed.
+    global_idx_t        add_global(std::string_view name);
+    const std::vector<std::string>& globals() const noexcept
+    {
+        return globals_;
+    }
+    // The name of the variable a global operand 'idx' refers to.
+    const std::string&  global_name(std::size_t idx) const;
+    // Adds a site for a property instruction naming 'name'. Sites are never
+    // shared: each caches the shapes seen by its own instruction.
+    std::size_t         add_property(std::string_view name);
+    property_site&      property(std::size_t idx) { return properties_[idx]; }
+    std::size_t         property_count() const { return properties_.size(); }
+    const property_site& property(std::size_t idx) const
+    {
+        return properties_[idx];
+    }
+    // Replaces the opcode at 'offset' with one of the same length.
+    void                patch(std::size_t offset, OpCode code);
+    // Replaces the two bytes at 'offset' with 'value', big-endian.
+    void                patch_short(std::size_t offset, std::uint16_t value);
+    // Drops the code from 'size' on.
+    void                truncate(std::size_t size);
+    // Rewrites every global operand 'idx' to 'slots[idx]'; 'names' are the
+    // variable names by slot. Functions among the constants are moved to
+    // chunk index 'chunk_base + idx'.
+    void link(const std::vector<std::uint16_t>&               slots,
+              std::shared_ptr<const std::vector<std::string>> names,
+              std::uint16_t                                   chunk_base = 0);
     const std::uint8_t* get_instruction(int idx) const noexcept(false);
     const ValueType&    get_constant(const_idx_t idx) const noexcept(false);
+    ValueType&          constant(const_idx_t idx) { return constants_[idx]; }
+    std::size_t constant_count() const noexcept { return constants_.size(); }
     std::size_t         size() const;
     int                 line(std::size_t idx) const;
 
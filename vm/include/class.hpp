@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "object.hpp"
+#include "table.hpp"
+#include "value.hpp"
+
+namespace clox
+{
+// The field layout shared by all instances that were given the same fields
+// in the same order: the slot of each field name. Adding a field moves an
+// instance to a child shape, which is created once and then shared, so
+// equal layouts have identical shapes.
+class shape
+{
+    table<std::size_t>            slots_;
+    table<std::shared_ptr<shape>> transitions_;
+
+  public:
+    std::optional<std::size_t> find(const obj_string& name) const;
+    // Returns the shape with 'name' appended as the next slot.
+    const std::shared_ptr<shape>& add(const std::shared_ptr<obj_string>& name);
+    std::size_t size() const noexcept { return slots_.size(); }
+};
+
+class obj_class : public obj
+{
+    const std::string        name_;
+    // Function or closure values; inherited ones are copied down. Methods
+    // are only added while the class body runs, so pointers into the table
+    // stay valid once there are instances.
+    table<ValueType>         methods_;
+    std::optional<ValueType> initializer_;
+    // Shape of instances without fields; the root of the class's shapes.
+    const std::shared_ptr<shape> root_;
+
+  public:
+    explicit obj_class(std::string name);
+    ObjType            type() const override;
+    void               print(std::string& out) const override;
+    bool               operator==(const obj& other) const override;
+    void               trace(obj_visitor& visitor) const override;
+    void               clear() override;
+    const std::string& name() const noexcept { return name_; }
+    void add_method(std::shared_ptr<obj_string> name, ValueType method);
+    // Copies the methods of 'superclass'; call before adding any.
+    void             inherit(const obj_class& superclass);
+    const ValueType* find_method(const obj_string& name) const;
+    const std::optional<ValueType>& initializer() const noexcept
+    {
+        return initializer_;
+    }
+    const std::shared_ptr<shape>& root() const noexcept { return root_; }
+};
+
+// Fields are stored densely in the slots described by the instance's shape.
+class obj_instance : public obj
+{
+    const std::shared_ptr<obj_class> class_;
+    std::shared_ptr<shape>           shape_;
+    value_vector                     fields_;
+
+  public:
+    explicit obj_instance(std::shared_ptr<obj_class> klass);
+    ObjType                       type() const override;
+    void                          print(std::string& out) const override;
+    bool                          operator==(const obj& other) const override;
+    void                          trace(obj_visitor& visitor) const override;
+    void                          clear() override;
+    const obj_class&              klass() const noexcept { return *class_; }
+    const std::shared_ptr<shape>& layout() const noexcept { return shape_; }
+    value_vector&                 fields() noexcept { return fields_; }
+    // Appends a field; 'next' must be layout() with that field added. The
+    // instance is unchanged if growing its fields throws.
+    void add_field(std::shared_ptr<shape> next, ValueType value);
+};
+
+// A method read as a property, remembering its receiver.
+class obj_bound_method : public obj
+{
+    ValueType receiver_;
+    ValueType method_;
+
+  public:
+    obj_bound_method(ValueType receiver, ValueType method);
+    ObjType          type() const override;
+    void             print(std::string& out) const override;
+    bool             operator==(const obj& other) const override;
+    void             trace(obj_visitor& visitor) const override;
+    void             clear() override;
+    const ValueType& receiver() const noexcept { return receiver_; }
+    const ValueType& method() const noexcept { return method_; }
+};
+
+}  // namespace clox
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "object.hpp"
+#include "value.hpp"
+
+namespace clox
+{
+// A captured variable that may still be assigned. While its scope is alive
+// the variable stays in its stack slot and the box only refers to it; when
+// the scope exits the value moves into the box.
+class obj_upvalue : public obj
+{
+  public:
+    std::size_t slot;  // Stack slot of the variable while open.
+    ValueType   closed;
+    bool        is_open = true;
+
+    explicit obj_upvalue(std::size_t stack_slot);
+    ObjType type() const override;
+    void    print(std::string& out) const override;
+    bool    operator==(const obj& other) const override;
+    void    trace(obj_visitor& visitor) const override;
+    void    clear() override;
+};
+
+// A function together with its captures. A capture is either the value of
+// a variable that is never assigned, copied flat into the closure, or an
+// obj_upvalue box shared with the variable's other users.
+class obj_closure : public obj
+{
+    // Functions live as long as the program's constants, which the vm
+    // keeps for its whole lifetime.
+    const obj_function& function_;
+    value_vector        captures_;
+
+  public:
+    explicit obj_closure(const obj_function& function);
+    ObjType             type() const override;
+    void                print(std::string& out) const override;
+    bool                operator==(const obj& other) const override;
+    void                trace(obj_visitor& visitor) const override;
+    void                clear() override;
+    const obj_function& function() const noexcept { return function_; }
+    value_vector&       captures() noexcept { return captures_; }
+};
+
+}  // namespace clox
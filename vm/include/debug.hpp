@@ -1,5 +1,6 @@
 #pragma once
 #include "chunk.hpp"
+#include "register.hpp"
 
 namespace clox
 {
@@ -7,11 +8,33 @@ class debug
 {
     static int constant_instruction(std::string_view name, const chunk& chunk,
                                     int offset);
+    static int byte_instruction(std::string_view name, const chunk& chunk,
+                                int offset);
+    static int jump_instruction(std::string_view name, int sign,
+                                const chunk& chunk, int offset);
+    static int for_loop_instruction(const chunk& chunk, int offset);
+    static int global_instruction(std::string_view name, const chunk& chunk,
+                                  int offset);
+    static int property_instruction(std::string_view name, const chunk& chunk,
+                                    int offset);
+    static int invoke_instruction(std::string_view name, const chunk& chunk,
+                                  int offset);
+    static void reg_operand(const reg_chunk& chunk, std::uint16_t idx,
+                            bool is_const);
 
   public:
     static int  disassemble_instruction(const chunk& chunk, int offset);
+    // Disassembles 'instruction' with the operands at 'offset', which may
+    // since have been quickened to another opcode.
+    static int  disassemble_instruction(const chunk& chunk, int offset,
+                                        OpCode instruction);
     static void disassemble_chunk(const chunk& chunk, std::string_view name);
+    static int  disassemble_instruction(const reg_chunk& chunk, int offset);
+    static void disassemble_chunk(const reg_chunk& chunk,
+                                  std::string_view name);
     static void print_value(const clox::ValueType& val);
+    // Appends the printed representation of 'val' to 'out'.
+    static void format_value(std::string& out, const clox::ValueType& val);
 };
 
 }  // namespace clox
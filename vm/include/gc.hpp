@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "object.hpp"
+
+namespace clox
+{
+// Pause times of one kind of collection, with a histogram of four buckets
+// per power of two nanoseconds for their percentiles.
+struct gc_pauses
+{
+    std::uint64_t                  count = 0;
+    std::chrono::nanoseconds       total{};
+    std::chrono::nanoseconds       max{};
+    std::array<std::uint64_t, 256> histogram{};
+
+    void record(std::chrono::nanoseconds pause);
+    // An upper bound, within 25%, of the pause that a fraction 'q' of the
+    // pauses did not exceed: percentile(0.99) is the p99.
+    std::chrono::nanoseconds percentile(double q) const;
+};
+
+struct gc_stats
+{
+    gc_pauses     minor;  // Minor collections alone.
+    gc_pauses     major;  // Major collections, or slices of incremental ones.
+    // Every time the program stopped: for a minor collection together with
+    // the major collection or slice it started.
+    gc_pauses     pauses;
+    std::uint64_t freed = 0;  // Objects freed by breaking their cycles.
+};
+
+// Frees the reference cycles that reference counting alone never frees.
+// Objects that can be part of a cycle are tracked from their allocation,
+// in two generations. Most die young through their reference count; a
+// minor collection drops those and then looks for cycles among the live
+// young objects only, which it promotes to the old generation if they
+// survive. A major collection scans both generations once the old one has
+// grown by a quarter; with a pause target, it is spread over the minor
+// collections that follow in slices sized to meet the target.
+//
+// The target is best effort. A minor collection is never divided, a slice
+// visits at least 256 objects, and it visits at least twice as many old
+// objects as were promoted since the last one, so that a pass over the
+// old generation ends even while the program promotes faster than the
+// target allows to collect. Pauses exceed the target then.
+//
+// A collection needs no roots: it subtracts the references that tracked
+// objects hold to each other from their use counts, and any object left
+// with a reference from elsewhere (the stack, a global, a constant, an old
+// object during a minor collection) is live, as is what it reaches. The
+// rest is unreachable, and is freed by clearing its references. Since old
+// objects that point to young ones are counted this way, no write barrier
+// or remembered set is needed. For the same reason a slice is a complete
+// collection of its objects: it needs no barrier against the changes the
+// program makes between slices. A slice is extended with the objects it
+// reaches, so that it holds whole cycles of up to one slice's size; larger
+// cycles are left to collect().
+class collector
+{
+    struct tracked
+    {
+        std::weak_ptr<obj> ref;
+        const obj*         ptr;  // Valid while 'ref' has not expired.
+    };
+
+    std::vector<tracked> young_;
+    // Growing it never moves millions of entries in one pause.
+    std::deque<tracked>  old_;
+    std::size_t          young_limit_ = 1024;
+    // Old objects after the last major collection, and promoted since.
+    std::size_t          old_live_    = 0;
+    std::size_t          promoted_    = 0;
+    // Promoted since the last slice, which the next one has to outpace.
+    std::size_t          unswept_     = 0;
+    gc_stats             stats_;
+
+    std::chrono::nanoseconds pause_target_{};
+    // Time a slice takes per object, as last measured.
+    double                   slice_cost_ = 100;
+    // An incremental major collection visited the old objects before
+    // 'cursor_', and moved the survivors among them to the first 'kept_'
+    // slots.
+    bool                     in_major_ = false;
+    std::size_t              cursor_   = 0;
+    std::size_t              kept_     = 0;
+
+  public:
+    collector()                            = default;
+    collector(const collector&)            = delete;
+    collector& operator=(const collector&) = delete;
+    // Frees the cycles among the tracked objects that nothing else holds.
+    ~collector();
+
+    // Starts tracking 'object'. Runs a minor collection when the young
+    // generation is full; 'object' itself is live then.
+    void track(const std::shared_ptr<obj>& object);
+    void collect_young();
+    // Collects both generations, finishing an incremental major collection
+    // at once.
+    void collect();
+
+    // Number of young objects that triggers a minor collection.
+    void set_young_limit(std::size_t limit) { young_limit_ = limit; }
+    // Makes major collections incremental, with slices that aim at
+    // 'target' each, see above; zero, the default, runs them in one pause.
+    void set_pause_target(std::chrono::nanoseconds target)
+    {
+        pause_target_ = target;
+    }
+    // Tracked objects, including dead ones not dropped yet.
+    std::size_t     young_size() const noexcept { return young_.size(); }
+    std::size_t     old_size() const noexcept { return old_.size(); }
+    const gc_stats& stats() const noexcept { return stats_; }
+
+  private:
+    void minor();
+    void major();
+    // Runs the next slice of an incremental major collection, with as many
+    // objects as take about 'time', or more to keep up with promotion.
+    void slice(std::chrono::nanoseconds time);
+    // Frees the cycles among 'objects' and leaves the live ones in it.
+    // First adds the objects they reach while there are fewer than
+    // 'limit'. Returns the number of objects examined.
+    template <class Objects>
+    std::size_t sweep(Objects& objects, std::size_t limit = 0);
+};
+
+}  // namespace clox
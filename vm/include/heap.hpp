@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace clox
+{
+// Thrown by an allocation that would take a heap over its limit. The vm
+// reports it as a runtime error.
+class heap_exhausted : public std::bad_alloc
+{
+  public:
+    const char* what() const noexcept override
+    {
+        return "heap limit exceeded";
+    }
+};
+
+// Allocation-site profiler: the bytes and number of allocations made by
+// each source line.
+class heap_profiler
+{
+  public:
+    struct site
+    {
+        std::uint64_t bytes       = 0;
+        std::uint64_t allocations = 0;
+    };
+
+  private:
+    std::vector<site> lines_;
+    std::uint64_t     bytes_ = 0;
+
+  public:
+    void          record(int line, std::size_t bytes);
+    site          line(int line) const noexcept;
+    std::uint64_t bytes() const noexcept { return bytes_; }
+    // Writes the lines that allocated, most bytes first.
+    void          write(std::ostream& out) const;
+};
+
+// Memory accounting for one vm. The objects allocated while it runs, with
+// the characters, elements, entries, fields and captures they own, are
+// charged to it through heap_allocator, and credited back when freed.
+//
+// Objects may outlive their vm, so the heap is reference counted by the vm
+// and by every allocator on it. The counts are not atomic: like the
+// objects, a heap belongs to one thread.
+class heap
+{
+    std::size_t   refs_        = 0;
+    std::size_t   bytes_       = 0;
+    std::size_t   peak_        = 0;
+    std::uint64_t allocations_ = 0;
+    std::size_t   limit_       = 0;
+    // Frees what it can before an allocation fails for the limit.
+    std::function<void()> reclaim_;
+    bool                  reclaiming_ = false;
+    heap_profiler*        profiler_   = nullptr;
+    std::function<int()>  line_;
+
+    static inline thread_local heap* current_ = nullptr;
+
+    friend class heap_ref;
+
+  public:
+    heap()                       = default;
+    heap(const heap&)            = delete;
+    heap& operator=(const heap&) = delete;
+
+    // The heap that allocators made now charge: the one of the running vm,
+    // or null.
+    static heap* current() noexcept { return current_; }
+
+    // Makes a heap current for its lifetime.
+    class scope
+    {
+        heap* previous_;
+
+      public:
+        explicit scope(heap* running) noexcept : previous_(current_)
+        {
+            current_ = running;
+        }
+        ~scope() { current_ = previous_; }
+        scope(const scope&)            = delete;
+        scope& operator=(const scope&) = delete;
+    };
+
+    // Throws heap_exhausted if the limit does not leave room for 'size'
+    // bytes even after reclaiming.
+    void* allocate(std::size_t size)
+    {
+        if ((limit_ != 0 && bytes_ + size > limit_) || profiler_ != nullptr)
+        {
+            return allocate_slow(size);
+        }
+        return charge(::operator new(size), size);
+    }
+    void deallocate(void* ptr, std::size_t size) noexcept
+    {
+        bytes_ -= size;
+        ::operator delete(ptr, size);
+    }
+
+    // Bytes allocated and not freed yet.
+    std::size_t   bytes() const noexcept { return bytes_; }
+    std::size_t   peak() const noexcept { return peak_; }
+    std::uint64_t allocations() const noexcept { return allocations_; }
+    std::size_t   limit() const noexcept { return limit_; }
+    // Zero, the default, means no limit.
+    void          set_limit(std::size_t bytes) noexcept { limit_ = bytes; }
+    void          set_reclaim(std::function<void()> reclaim)
+    {
+        reclaim_ = std::move(reclaim);
+    }
+    // Records every allocation in 'prof', at the source line that 'line'
+    // returns; pass nullptr to stop.
+    void profile(heap_profiler* prof, std::function<int()> line)
+    {
+        profiler_ = prof;
+        line_     = std::move(line);
+    }
+
+  private:
+    void* allocate_slow(std::size_t size);
+    // Frees a heap that lost its last reference. Out of line: containers
+    // and shared_ptr copy and drop allocators all the time, and only the
+    // decrement needs to be inlined there.
+    static void release(heap* target) noexcept;
+    void* charge(void* ptr, std::size_t size) noexcept
+    {
+        bytes_ += size;
+        peak_   = std::max(peak_, bytes_);
+        ++allocations_;
+        return ptr;
+    }
+};
+
+// A counted reference to a heap, which frees it with the last one.
+class heap_ref
+{
+    heap* heap_ = nullptr;
+
+  public:
+    heap_ref() noexcept = default;
+    explicit heap_ref(heap* target) noexcept : heap_(target)
+    {
+        if (heap_ != nullptr)
+        {
+            ++heap_->refs_;
+        }
+    }
+    heap_ref(const heap_ref& other) noexcept : heap_ref(other.heap_) {}
+    heap_ref(heap_ref&& other) noexcept : heap_(other.heap_)
+    {
+        other.heap_ = nullptr;
+    }
+    heap_ref& operator=(heap_ref other) noexcept
+    {
+        std::swap(heap_, other.heap_);
+        return *this;
+    }
+    ~heap_ref()
+    {
+        if (heap_ != nullptr && --heap_->refs_ == 0)
+        {
+            heap::release(heap_);
+        }
+    }
+
+    heap* get() const noexcept { return heap_; }
+    heap* operator->() const noexcept { return heap_; }
+    heap& operator*() const noexcept { return *heap_; }
+};
+
+// Allocates on the heap that was current when it was made, or with plain
+// new and delete outside a vm.
+template <class T>
+class heap_allocator
+{
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    heap_ref heap_;
+
+    template <class U>
+    friend class heap_allocator;
+
+  public:
+    using value_type = T;
+    // Containers keep the heap their storage came from.
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap            = std::true_type;
+
+    heap_allocator() noexcept : heap_(heap::current()) {}
+    template <class U>
+    heap_allocator(const heap_allocator<U>& other) noexcept
+        : heap_(other.heap_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        const auto size = n * sizeof(T);
+        return static_cast<T*>(heap_.get() != nullptr ? heap_->allocate(size)
+                                                      : ::operator new(size));
+    }
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        if (heap_.get() != nullptr)
+        {
+            heap_->deallocate(ptr, n * sizeof(T));
+            return;
+        }
+        ::operator delete(ptr, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const heap_allocator<U>& other) const noexcept
+    {
+        return heap_.get() == other.heap_.get();
+    }
+};
+
+}  // namespace clox
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "object.hpp"
+#include "value.hpp"
+
+namespace clox
+{
+// A Lox map from strings and numbers to values, as a Robin Hood hash table:
+// linear probing where an insertion takes the slot of any entry closer to
+// its home slot than the new one, which keeps every probe sequence short
+// and lets a miss stop early. Erasing shifts the following entries back
+// instead of leaving tombstones. Numbers are keys by value, so 1 and 1.0
+// are the same key; the vm interns string keys, so most string compares
+// are pointer compares.
+class obj_map : public obj
+{
+    struct entry
+    {
+        ValueType     key;
+        ValueType     value;
+        std::uint32_t hash = 0;
+        // Distance from the home slot plus one; 0 marks an empty slot.
+        std::uint32_t dist = 0;
+    };
+
+    using entry_vector = std::vector<entry, heap_allocator<entry>>;
+
+    entry_vector entries_;
+    std::size_t  count_ = 0;
+
+  public:
+    ObjType type() const override;
+    // Prints the entries in table order.
+    void    print(std::string& out) const override;
+    bool    operator==(const obj& other) const override;
+    // Keys are strings and numbers, so only values are traced.
+    void    trace(obj_visitor& visitor) const override;
+    void    clear() override;
+
+    // Strings and numbers other than NaN.
+    static bool valid_key(const ValueType& key);
+
+    std::size_t size() const noexcept { return count_; }
+    std::size_t capacity() const noexcept { return entries_.size(); }
+    // 'key' must be a valid_key.
+    const ValueType* find(const ValueType& key) const;
+    // Returns true if 'key' was not in the map yet.
+    bool             set(ValueType key, ValueType value);
+    bool             erase(const ValueType& key);
+
+  private:
+    static std::uint32_t hash_key(const ValueType& key);
+    // Returns capacity() if the key is absent.
+    std::size_t          find_index(const ValueType& key,
+                                    std::uint32_t    hash) const;
+    void                 insert(entry item);
+    void                 grow();
+};
+
+}  // namespace clox
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "object.hpp"
+#include "value.hpp"
+
+namespace clox
+{
+// Host code callable from Lox. 'args' views the arguments in place on the
+// vm's stack and is only valid during the call. A native fails by storing a
+// message in 'error'; the vm then reports it as a runtime error.
+using native_fn = ValueType (*)(std::span<const ValueType> args,
+                                std::string&               error);
+
+// Arity of a native that takes any number of arguments.
+inline constexpr int VARIADIC = -1;
+
+class obj_native : public obj
+{
+    const std::string name_;
+    const native_fn   fn_;
+    const int         arity_;
+
+  public:
+    obj_native(std::string name, native_fn fn, int arity);
+    ObjType            type() const override;
+    void               print(std::string& out) const override;
+    bool               operator==(const obj& other) const override;
+    const std::string& name() const noexcept { return name_; }
+    native_fn          fn() const noexcept { return fn_; }
+    int                arity() const noexcept { return arity_; }
+};
+
+struct native_def
+{
+    std::string_view name;
+    native_fn        fn;
+    int              arity;
+};
+
+// clock() and the string and math helpers every vm starts with.
+std::span<const native_def> builtin_natives();
+
+}  // namespace clox
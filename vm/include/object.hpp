@@ -1,13 +1,39 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
+
+#include "heap.hpp"
 
 namespace clox
 {
 enum class ObjType
 {
     STRING,
+    FUNCTION,
+    NATIVE,
+    CLOSURE,
+    UPVALUE,
+    CLASS,
+    INSTANCE,
+    BOUND_METHOD,
+    MAP,
+    ARRAY,
+};
+
+class obj;
+
+// Receives the references that an object holds to other objects.
+class obj_visitor
+{
+  public:
+    virtual void visit(const std::shared_ptr<obj>& child) = 0;
+
+  protected:
+    ~obj_visitor() = default;
 };
 
 class obj
@@ -17,23 +43,108 @@ class obj
 
     virtual ObjType type() const = 0;
 
-    virtual void print() const = 0;
+    // Appends the printed representation to 'out'.
+    virtual void print(std::string& out) const = 0;
 
     virtual bool operator==(const obj& other) const = 0;
+
+    // Objects that can be part of a reference cycle pass the objects they
+    // reference to 'visitor', once per shared_ptr they own. Reporting a
+    // reference that is not owned would let the collector free live data.
+    virtual void trace(obj_visitor& /*visitor*/) const {}
+    // Drops the references that trace() reports, to break the cycles of
+    // an unreachable object.
+    virtual void clear() {}
 };
 
+// Allocates an object on the heap of the running vm, if any.
+template <class T, class... Args>
+std::shared_ptr<T> make_object(Args&&... args)
+{
+    return std::allocate_shared<T>(heap_allocator<T>{},
+                                   std::forward<Args>(args)...);
+}
+
+// FNV-1a; cached by every obj_string for the tables keyed by strings.
+std::uint32_t hash_string(std::string_view chars);
+
+// An immutable string. It either owns its characters or is a slice that
+// views part of a shared buffer: the characters of another string, or the
+// script's source for literals.
 class obj_string : public obj
 {
-    const std::string val_;
+    using heap_string =
+        std::basic_string<char, std::char_traits<char>, heap_allocator<char>>;
+
+    const heap_string                 owned_;  // Empty for a slice.
+    // Null unless a slice: the owner of the buffer, which holds
+    // 'buffer_size_' characters.
+    const std::shared_ptr<const void> buffer_;
+    const std::size_t                 buffer_size_ = 0;
+    const std::string_view            chars_;
+    // Computed on first use, so that slicing takes constant time.
+    mutable std::uint32_t             hash_   = 0;
+    mutable bool                      hashed_ = false;
 
   public:
-    explicit obj_string(std::string str);
+    explicit obj_string(std::string_view str);
+    // The concatenation of 'head' and 'tail'.
+    obj_string(std::string_view head, std::string_view tail);
+    // A slice viewing 'chars', which must lie in 'source'.
+    obj_string(std::shared_ptr<const std::string> source,
+               std::string_view                   chars);
+    // A slice viewing 'chars', which must lie in the 'buffer_size'
+    // characters that 'buffer' keeps alive.
+    obj_string(std::shared_ptr<const void> buffer, std::size_t buffer_size,
+               std::string_view chars);
+    obj_string(const obj_string&)            = delete;
+    obj_string& operator=(const obj_string&) = delete;
+
+    // The 'length' characters of 'str' from 'start', which must be in range.
+    // The result shares the buffer of 'str' unless it is less than an
+    // eighth of it: then it copies, so as not to keep a buffer that is
+    // mostly garbage alive.
+    static std::shared_ptr<obj_string> substr(
+        const std::shared_ptr<obj_string>& str, std::size_t start,
+        std::size_t length);
+
     ObjType                     type() const override;
-    void                        print() const override;
+    void                        print(std::string& out) const override;
     bool                        operator==(const obj& other) const override;
     std::shared_ptr<obj_string> operator+(const obj_string& other) const;
+    std::string_view            str() const noexcept { return chars_; }
+    std::uint32_t               hash() const noexcept
+    {
+        if (!hashed_)
+        {
+            hash_   = hash_string(chars_);
+            hashed_ = true;
+        }
+        return hash_;
+    }
+    bool is_slice() const noexcept { return buffer_ != nullptr; }
+};
+
+// A function's code is not part of the object: it is the chunk with index
+// 'chunk()' in the program, so that the vm owns and can quicken all code.
+// Functions that capture variables are only called through an obj_closure.
+class obj_function : public obj
+{
+    const std::string  name_;
+    const std::uint8_t arity_;
+    std::uint16_t      chunk_;
+    const std::uint8_t upvalue_count_;
 
-  private:
+  public:
+    obj_function(std::string name, std::uint8_t arity, std::uint16_t chunk,
+                 std::uint8_t upvalue_count = 0);
+    ObjType            type() const override;
+    void               print(std::string& out) const override;
+    bool               operator==(const obj& other) const override;
+    const std::string& name() const noexcept { return name_; }
+    std::uint8_t       arity() const noexcept { return arity_; }
+    std::uint16_t      chunk() const noexcept { return chunk_; }
+    std::uint8_t upvalue_count() const noexcept { return upvalue_count_; }
 };
 
 }  // namespace clox
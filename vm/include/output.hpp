@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace clox
+{
+// Destination of everything a script prints. The vm formats values into
+// its own reusable buffer and hands complete pieces to the sink; sinks may
+// buffer and only have to make data visible on flush().
+class output_sink
+{
+  public:
+    virtual ~output_sink() = default;
+
+    virtual void write(std::string_view data) = 0;
+    virtual void flush() {}
+};
+
+// Buffered writer on top of a raw file descriptor. On standard output it
+// flushes std::cout before each write, so the two stay in order.
+class fd_sink : public output_sink
+{
+    int         fd_;
+    std::string buffer_;
+
+  public:
+    static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit fd_sink(int fd);
+    ~fd_sink() override;
+    fd_sink(const fd_sink&)            = delete;
+    fd_sink& operator=(const fd_sink&) = delete;
+
+    void write(std::string_view data) override;
+    void flush() override;
+
+  private:
+    void write_all(std::string_view data);
+};
+
+// Keeps everything in memory, for embedding and tests.
+class memory_sink : public output_sink
+{
+    std::string buffer_;
+
+  public:
+    void write(std::string_view data) override { buffer_ += data; }
+
+    const std::string& str() const noexcept { return buffer_; }
+    void               clear() noexcept { buffer_.clear(); }
+};
+
+// Discards everything, for benchmarks.
+class null_sink : public output_sink
+{
+  public:
+    void write(std::string_view) override {}
+};
+
+// Process-wide buffered sink on standard output.
+output_sink& stdout_sink();
+
+}  // namespace clox
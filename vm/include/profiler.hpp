@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clox
+{
+// A source position on the sampled call stack.
+struct profile_frame
+{
+    std::uint16_t chunk;
+    int           line;
+
+    auto operator<=>(const profile_frame&) const = default;
+};
+
+// Sampling profiler. The vm polls it every 'interval()' instructions; a
+// poll turns into a sample either unconditionally (INSTRUCTIONS mode) or
+// when the SIGPROF timer has fired since the last one (TIMER mode), so the
+// signal handler itself never touches vm state.
+class profiler
+{
+  public:
+    enum class Mode
+    {
+        INSTRUCTIONS,  // Sample every 'period' instructions.
+        TIMER,         // Sample every 'period' microseconds of CPU time.
+    };
+
+  private:
+    // Instructions between two polls of the timer flag.
+    static constexpr std::uint32_t TIMER_POLL = 1000;
+
+    Mode          mode_;
+    std::uint32_t period_;
+    bool          running_ = false;
+    std::uint64_t samples_ = 0;
+
+    std::vector<std::uint64_t>                          line_samples_;
+    std::map<std::vector<profile_frame>, std::uint64_t> stack_samples_;
+    std::vector<std::string>                            chunk_names_;
+
+    std::string frame_name(const profile_frame& frame) const;
+
+  public:
+    explicit profiler(Mode mode = Mode::INSTRUCTIONS,
+                      std::uint32_t period = 1000);
+    ~profiler();
+    profiler(const profiler&)            = delete;
+    profiler& operator=(const profiler&) = delete;
+
+    void start();
+    void stop();
+
+    // Number of instructions the vm runs between two polls.
+    std::uint32_t interval() const noexcept;
+    // Returns true when the vm should record a sample now.
+    bool          poll() noexcept;
+    // Records one sample; 'stack' is ordered from the outermost frame.
+    void          sample(std::span<const profile_frame> stack);
+    // Names the frames of 'chunk' in folded stacks, once.
+    void          name_chunk(std::uint16_t chunk, std::string_view name);
+
+    std::uint64_t samples() const noexcept { return samples_; }
+    std::uint64_t line_samples(int line) const noexcept;
+
+    // Writes per-line sample counts, hottest first.
+    void write_lines(std::ostream& out) const;
+    // Writes flamegraph.pl compatible folded stacks.
+    void write_folded(std::ostream& out) const;
+};
+
+}  // namespace clox
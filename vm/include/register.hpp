@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "chunk.hpp"
+#include "value.hpp"
+
+namespace clox
+{
+// Three-address instructions over frame-relative registers. Operands 'b'
+// and 'c' are either registers or constants, see RegInstr::B_CONST and
+// RegInstr::C_CONST.
+enum class RegOpCode : std::uint8_t
+{
+    LOADK,  // R[a] = K[b]
+    MOVE,   // R[a] = R[b]
+    ADD,    // R[a] = RK[b] + RK[c]
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    EQUAL,
+    GREATER,
+    LESS,
+    NOT,            // R[a] = !RK[b]
+    NEGATE,         // R[a] = -RK[b]
+    RETURN,         // return RK[b], or nothing when a is 0
+    PRINT,          // print RK[b]
+    DEFINE_GLOBAL,  // G[a] = RK[b]
+    GET_GLOBAL,     // R[a] = G[b]
+    SET_GLOBAL,     // G[a] = RK[b]
+    JUMP,           // goto c
+    JUMP_IF_FALSE,  // if !RK[b] goto c
+    JUMP_IF_TRUE,   // if RK[b] goto c
+    FOR_LOOP,       // R[a] += 1; if R[a] < RK[b] goto c
+};
+
+struct reg_instr
+{
+    static constexpr std::uint8_t B_CONST   = 1;
+    static constexpr std::uint8_t C_CONST   = 2;
+    static constexpr std::uint8_t INCLUSIVE = 4;  // FOR_LOOP tests <=
+
+    RegOpCode     op;
+    std::uint8_t  flags;
+    std::uint16_t a;
+    std::uint16_t b;
+    std::uint16_t c;
+};
+static_assert(sizeof(reg_instr) == 8);
+
+class reg_chunk
+{
+    std::vector<reg_instr> code_;
+    std::vector<ValueType> constants_;
+    std::vector<int>       lines_;
+    std::uint16_t          registers_ = 0;
+
+  public:
+    // Translates stack bytecode into register code. Returns nullopt when
+    // 'source' uses an instruction the register backend does not support:
+    // calls, closures, upvalues, classes, properties, arrays and maps.
+    static std::optional<reg_chunk> lower(const chunk& source);
+
+    const reg_instr* code() const noexcept { return code_.data(); }
+    std::size_t      size() const noexcept { return code_.size(); }
+    const ValueType& constant(std::size_t idx) const { return constants_[idx]; }
+    int              line(std::size_t idx) const { return lines_.at(idx); }
+    std::uint16_t    registers() const noexcept { return registers_; }
+
+    friend class debug;
+};
+
+}  // namespace clox
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "object.hpp"
+
+namespace clox
+{
+// Hash table keyed by strings, with open addressing and linear probing.
+// The capacity is a power of two and doubles before live entries and
+// tombstones exceed 3/4 of it. Keys are normally interned, so a probe that
+// hits compares pointers only; a different string with the same contents
+// still matches through its cached hash and then its characters.
+template <class V>
+class table
+{
+    struct entry
+    {
+        std::shared_ptr<obj_string> key;  // Null if empty or a tombstone.
+        std::uint32_t               hash      = 0;
+        bool                        tombstone = false;
+        V                           value{};
+    };
+
+    std::vector<entry> entries_;
+    std::size_t        count_ = 0;  // Live entries.
+    std::size_t        used_  = 0;  // Live entries and tombstones.
+
+  public:
+    std::size_t size() const noexcept { return count_; }
+    std::size_t capacity() const noexcept { return entries_.size(); }
+
+    const V* find(const obj_string& key) const
+    {
+        const auto idx = find_index(&key, key.str(), key.hash());
+        return idx < entries_.size() ? &entries_[idx].value : nullptr;
+    }
+    V* find(const obj_string& key)
+    {
+        return const_cast<V*>(std::as_const(*this).find(key));
+    }
+    // Returns the key with contents 'chars' and hash 'hash', for interning.
+    const std::shared_ptr<obj_string>* find_key(std::string_view chars,
+                                                std::uint32_t    hash) const
+    {
+        const auto idx = find_index(nullptr, chars, hash);
+        return idx < entries_.size() ? &entries_[idx].key : nullptr;
+    }
+    // Returns true if 'key' was not in the table yet.
+    bool insert_or_assign(std::shared_ptr<obj_string> key, V value)
+    {
+        if ((used_ + 1) * 4 > entries_.size() * 3)
+        {
+            grow();
+        }
+        const auto idx   = probe(key.get(), key->str(), key->hash());
+        auto&      slot  = entries_[idx];
+        const bool added = slot.key == nullptr;
+        if (added)
+        {
+            used_ += slot.tombstone ? 0 : 1;
+            ++count_;
+            slot.hash      = key->hash();
+            slot.tombstone = false;
+            slot.key       = std::move(key);
+        }
+        slot.value = std::move(value);
+        return added;
+    }
+    bool erase(const obj_string& key)
+    {
+        const auto idx = find_index(&key, key.str(), key.hash());
+        if (idx == entries_.size())
+        {
+            return false;
+        }
+        // The tombstone keeps later keys of the probe sequence reachable.
+        auto& slot     = entries_[idx];
+        slot.key       = nullptr;
+        slot.tombstone = true;
+        slot.value     = V{};
+        --count_;
+        return true;
+    }
+    // Calls 'fn(key, value)' for every entry, in no particular order.
+    template <class F>
+    void for_each(F&& fn) const
+    {
+        for (const auto& slot : entries_)
+        {
+            if (slot.key != nullptr)
+            {
+                fn(slot.key, slot.value);
+            }
+        }
+    }
+
+  private:
+    // Index of the entry holding the key, or of the slot it belongs in:
+    // the first tombstone on its probe sequence, or else the empty slot
+    // that ends it.
+    std::size_t probe(const obj_string* key, std::string_view chars,
+                      std::uint32_t hash) const
+    {
+        const auto  mask      = entries_.size() - 1;
+        auto        idx       = hash & mask;
+        std::size_t tombstone = entries_.size();
+        for (;;)
+        {
+            const auto& slot = entries_[idx];
+            if (slot.key == nullptr)
+            {
+                if (!slot.tombstone)
+                {
+                    return tombstone != entries_.size() ? tombstone : idx;
+                }
+                if (tombstone == entries_.size())
+                {
+                    tombstone = idx;
+                }
+            }
+            else if (slot.key.get() == key ||
+                     (slot.hash == hash && slot.key->str() == chars))
+            {
+                return idx;
+            }
+            idx = (idx + 1) & mask;
+        }
+    }
+    // Like probe, but returns capacity() if the key is absent.
+    std::size_t find_index(const obj_string* key, std::string_view chars,
+                           std::uint32_t hash) const
+    {
+        if (count_ == 0)
+        {
+            return entries_.size();
+        }
+        const auto idx = probe(key, chars, hash);
+        return entries_[idx].key != nullptr ? idx : entries_.size();
+    }
+    // Rehashes into twice the capacity, or into the same capacity when
+    // dropping the tombstones frees enough room.
+    void grow()
+    {
+        auto capacity = entries_.empty() ? std::size_t{8} : entries_.size();
+        if ((count_ + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        auto old = std::exchange(entries_, std::vector<entry>(capacity));
+        const auto mask = capacity - 1;
+        used_           = count_;
+        // Keys are distinct and there are no tombstones yet: each goes into
+        // the first empty slot of its sequence.
+        for (auto& slot : old)
+        {
+            if (slot.key != nullptr)
+            {
+                auto idx = slot.hash & mask;
+                while (entries_[idx].key != nullptr)
+                {
+                    idx = (idx + 1) & mask;
+                }
+                entries_[idx] = std::move(slot);
+            }
+        }
+    }
+};
+
+}  // namespace clox
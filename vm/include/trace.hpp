@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <type_traits>
+#include <vector>
+
+#include "chunk.hpp"
+
+namespace clox
+{
+// One executed instruction. Kept small and trivially copyable so that the
+// ring buffer can be dumped and reloaded as raw bytes.
+struct trace_record
+{
+    std::uint32_t offset;       // Offset of the instruction in its chunk.
+    std::uint16_t chunk;        // Index of the chunk in the vm.
+    OpCode        opcode;
+    std::uint8_t  top_tag;      // ValueType index of the stack top.
+    std::uint32_t stack_depth;  // Stack size before the instruction runs.
+};
+static_assert(std::is_trivially_copyable_v<trace_record>);
+
+// Fixed-capacity ring buffer of executed instructions. Recording never
+// allocates or does I/O: once full, the oldest records are overwritten, so
+// the buffer always holds the last 'capacity' instructions.
+class tracer
+{
+    std::vector<trace_record> records_;
+    std::size_t               mask_;
+    std::uint64_t             count_ = 0;
+
+  public:
+    static constexpr std::uint8_t EMPTY_STACK = 0xff;
+
+    // Capacity is rounded up to a power of two.
+    explicit tracer(std::size_t capacity = 1 << 16);
+
+    void record(std::uint16_t chunk, std::uint32_t offset, OpCode opcode,
+                std::uint32_t stack_depth, std::uint8_t top_tag) noexcept
+    {
+        records_[count_++ & mask_] = {offset, chunk, opcode, top_tag,
+                                      stack_depth};
+    }
+
+    std::size_t   capacity() const noexcept { return records_.size(); }
+    std::uint64_t total() const noexcept { return count_; }
+    std::size_t   size() const noexcept;
+    void          clear() noexcept { count_ = 0; }
+
+    // Retained records, oldest first.
+    std::vector<trace_record> snapshot() const;
+
+    // Binary dump/reload of the retained records.
+    bool save(const std::filesystem::path& path) const;
+    bool load(const std::filesystem::path& path);
+
+    // Prints the retained records, disassembling each recorded opcode with
+    // its operands from the chunks it was recorded against.
+    void decode(const std::vector<chunk>& chunks) const;
+};
+
+}  // namespace clox
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <memory>
 #include <variant>
+#include <vector>
 
 #include "object.hpp"
 
@@ -12,7 +15,52 @@ struct nil
     bool operator==(const nil&) const { return true; }
 };
 
-using ValueType = std::variant<double, bool, nil, std::shared_ptr<obj>>;
+// A Lox number is either a double or, while it is integral and exactly
+// representable as a double, a std::int64_t. The two are never observably
+// different: integer results that leave that range or would be -0 become
+// doubles, and both compare and print alike.
+using ValueType =
+    std::variant<double, bool, nil, std::shared_ptr<obj>, std::int64_t>;
+
+// Values that an object owns, charged to the heap of the vm that made it.
+using value_vector = std::vector<ValueType, heap_allocator<ValueType>>;
+
+inline constexpr std::int64_t MAX_EXACT_INT = std::int64_t{1} << 53;
+
+inline bool is_number(const ValueType& val)
+{
+    return std::holds_alternative<double>(val) ||
+           std::holds_alternative<std::int64_t>(val);
+}
+
+inline double as_number(const ValueType& val)
+{
+    if (const auto* i = std::get_if<std::int64_t>(&val))
+    {
+        return static_cast<double>(*i);
+    }
+    return std::get<double>(val);
+}
+
+// Picks the integer representation for 'val' when it has one.
+inline ValueType make_number(double val)
+{
+    if (val == std::trunc(val) && std::fabs(val) <= MAX_EXACT_INT &&
+        !(val == 0 && std::signbit(val)))
+    {
+        return static_cast<std::int64_t>(val);
+    }
+    return val;
+}
+
+// Passes the object that 'val' holds, if any, to 'visitor'.
+inline void trace_value(const ValueType& val, obj_visitor& visitor)
+{
+    if (const auto* ptr = std::get_if<std::shared_ptr<obj>>(&val))
+    {
+        visitor.visit(*ptr);
+    }
+}
 
 inline bool is_string(const ValueType& val)
 {
@@ -20,4 +68,106 @@ inline bool is_string(const ValueType& val)
            std::get<std::shared_ptr<obj>>(val)->type() == ObjType::STRING;
 }
 
+// For operands proven to be numbers at compile time, mostly doubles: tests
+// for a double first, and leaves integers to the checked as_number.
+inline double as_number_f64(const ValueType& val)
+{
+    if (const auto* d = std::get_if<double>(&val)) [[likely]]
+    {
+        return *d;
+    }
+    return as_number(val);
+}
+
+// Arithmetic on two numbers. Both-integer operands take the integer path,
+// which never needs more than a range check: operands are at most 2^53 in
+// magnitude, so only multiplication can overflow std::int64_t.
+inline ValueType add_numbers(const ValueType& a, const ValueType& b)
+{
+    const auto* x = std::get_if<std::int64_t>(&a);
+    const auto* y = std::get_if<std::int64_t>(&b);
+    if (x != nullptr && y != nullptr)
+    {
+        const auto result = *x + *y;
+        if (result >= -MAX_EXACT_INT && result <= MAX_EXACT_INT) [[likely]]
+        {
+            return result;
+        }
+    }
+    return as_number(a) + as_number(b);
+}
+
+inline ValueType subtract_numbers(const ValueType& a, const ValueType& b)
+{
+    const auto* x = std::get_if<std::int64_t>(&a);
+    const auto* y = std::get_if<std::int64_t>(&b);
+    if (x != nullptr && y != nullptr)
+    {
+        const auto result = *x - *y;
+        if (result >= -MAX_EXACT_INT && result <= MAX_EXACT_INT) [[likely]]
+        {
+            return result;
+        }
+    }
+    return as_number(a) - as_number(b);
+}
+
+inline ValueType multiply_numbers(const ValueType& a, const ValueType& b)
+{
+    const auto*  x = std::get_if<std::int64_t>(&a);
+    const auto*  y = std::get_if<std::int64_t>(&b);
+    std::int64_t result;
+    // A zero product with a negative factor is -0 in double arithmetic.
+    if (x != nullptr && y != nullptr &&
+        !__builtin_mul_overflow(*x, *y, &result) &&
+        result >= -MAX_EXACT_INT && result <= MAX_EXACT_INT &&
+        (result != 0 || (*x >= 0 && *y >= 0))) [[likely]]
+    {
+        return result;
+    }
+    return as_number(a) * as_number(b);
+}
+
+// Division always produces a double.
+inline ValueType divide_numbers(const ValueType& a, const ValueType& b)
+{
+    return as_number(a) / as_number(b);
+}
+
+inline ValueType negate_number(const ValueType& a)
+{
+    if (const auto* x = std::get_if<std::int64_t>(&a); x != nullptr && *x != 0)
+    {
+        return -*x;
+    }
+    return -as_number(a);
+}
+
+inline bool less_numbers(const ValueType& a, const ValueType& b)
+{
+    const auto* x = std::get_if<std::int64_t>(&a);
+    const auto* y = std::get_if<std::int64_t>(&b);
+    if (x != nullptr && y != nullptr)
+    {
+        return *x < *y;
+    }
+    return as_number(a) < as_number(b);
+}
+
+inline bool greater_numbers(const ValueType& a, const ValueType& b)
+{
+    return less_numbers(b, a);
+}
+
+inline bool numbers_equal(const ValueType& a, const ValueType& b)
+{
+    const auto* x = std::get_if<std::int64_t>(&a);
+    const auto* y = std::get_if<std::int64_t>(&b);
+    if (x != nullptr && y != nullptr)
+    {
+        return *x == *y;
+    }
+    return as_number(a) == as_number(b);
+}
+
 }  // namespace clox
@@ -1,9 +1,27 @@
 #pragma once
 
+#include <array>
+#include <optional>
 #include <stack>
+#include <string>
 #include <string_view>
+#include <variant>
 
+#include "array.hpp"
 #include "chunk.hpp"
+#include "class.hpp"
+#include "closure.hpp"
+#include "gc.hpp"
+#include "heap.hpp"
+#include "map.hpp"
+#include "native.hpp"
+#include "output.hpp"
+#include "profiler.hpp"
+#include "register.hpp"
+#include "table.hpp"
+#ifdef DEBUG_TRACE_EXECUTION
+#include "trace.hpp"
+#endif
 
 namespace clox
 {
@@ -15,20 +33,173 @@ enum class InterpretResult
     INTERPRET_RUNTIME_ERROR,
 };
 
+enum class Backend
+{
+    STACK,     // Executes the compiler's stack bytecode directly.
+    REGISTER,  // Lowers it to three-address register code first.
+};
+
+// A function activation. Its locals start at stack index 'slots', which
+// holds the callee itself; the script's frame has no callee slot.
+struct call_frame
+{
+    chunk*              code;
+    const std::uint8_t* ip;  // Saved while the frame is not running.
+    std::size_t         slots;
+    const obj_function* function;  // Null for the script.
+    obj_closure*        closure;   // Null unless the function captures.
+};
+
 class vm
 {
+    static constexpr std::size_t FRAMES_MAX = 256;
+    static constexpr std::size_t STACK_MAX  = FRAMES_MAX * 256;
+
+    // The vm's own copy of the code: instructions are rewritten in place
+    // into their type-specialized forms as the vm observes operand types.
     std::vector<chunk>                 chunks_;
-    std::vector<chunk>::const_iterator current_chunk_;
-    const std::uint8_t*                ip_;
+    // Index of the top-level chunk of the program loaded last.
+    std::size_t                        script_ = 0;
+    // Preallocated so that calls and returns never allocate.
+    std::array<call_frame, FRAMES_MAX> frames_;
+    std::size_t                        frame_count_ = 0;
+    // The running frame; its code and ip are cached below.
+    call_frame*                        frame_         = nullptr;
+    chunk*                             current_chunk_ = nullptr;
+    const std::uint8_t*                ip_            = nullptr;
     std::vector<ValueType>             stack_;
+    // Boxes of captured variables whose stack slot is still alive, ordered
+    // by slot.
+    std::vector<std::shared_ptr<obj_upvalue>> open_upvalues_;
+    // Global variables by slot. Chunks are linked to these slots when they
+    // are loaded; an empty slot is a variable that is not defined yet.
+    std::vector<std::optional<ValueType>> globals_;
+    // Shared with every linked chunk, for the disassembler.
+    std::shared_ptr<std::vector<std::string>> global_names_ =
+        std::make_shared<std::vector<std::string>>();
+    table<std::uint16_t>                  global_slots_;
+    // Why the program loaded last cannot run, reported by interpret().
+    std::string                           load_error_;
+    // Names the vm looks things up by, one object per distinct string, so
+    // that table probes mostly compare pointers.
+    table<std::monostate>                 strings_;
+    // Charged with every object the program allocates.
+    heap_ref                              heap_{new heap};
+    collector                             gc_;
+#ifdef DEBUG_TRACE_EXECUTION
+    tracer tracer_;
+#endif
+    profiler*     profiler_          = nullptr;
+    std::uint32_t profile_countdown_ = 1;
+    output_sink*  out_               = &stdout_sink();
+    std::string   out_buffer_;
+    std::string   native_error_;
+
+#ifdef CLOX_REGISTER_VM
+    Backend backend_ = Backend::REGISTER;
+#else
+    Backend backend_ = Backend::STACK;
+#endif
+    std::optional<reg_chunk> reg_code_;
+    const reg_instr*         reg_ip_ = nullptr;
 
   public:
     explicit vm(std::vector<chunk> chunks);
+    // Frees the cycles that the program's objects still form.
+    ~vm();
+    // Replaces the program. Global variables keep their values and earlier
+    // programs' functions stay callable, so a REPL can feed one vm line by
+    // line.
+    void            load(std::vector<chunk> chunks);
     InterpretResult interpret();
     InterpretResult run();
+    // Chunks the register backend cannot lower still run on the stack VM.
+    // The execution tracer only records stack bytecode.
+    InterpretResult run_registers();
+    void            set_backend(Backend backend) { backend_ = backend; }
+    // Whether the program was lowered to register code; false when the
+    // register backend fell back to the stack VM.
+    bool lowered() const noexcept { return reg_code_.has_value(); }
+    // The code as currently executed, including quickened instructions, of
+    // every program loaded so far.
+    const std::vector<chunk>& chunks() const noexcept { return chunks_; }
+#ifdef DEBUG_TRACE_EXECUTION
+    const tracer& trace() const { return tracer_; }
+#endif
+    // Attaches a sampling profiler; pass nullptr to detach.
+    void set_profiler(profiler* prof);
+    // Everything the script prints goes to 'sink', which is flushed when
+    // interpret() returns.
+    void set_output(output_sink& sink) { out_ = &sink; }
+    // Binds 'fn' to the global 'name'. The builtin_natives() are defined by
+    // the constructor.
+    void define_native(std::string_view name, native_fn fn,
+                       int arity = VARIADIC);
+    // The cycle collector, with its pause statistics.
+    collector&       gc() noexcept { return gc_; }
+    const collector& gc() const noexcept { return gc_; }
+    // The memory the program's objects use, and its limit: an allocation
+    // beyond it ends the program with a runtime error once collecting
+    // cycles does not make room.
+    heap&            memory() noexcept { return *heap_; }
+    const heap&      memory() const noexcept { return *heap_; }
+    // Attributes the program's allocations to source lines in 'prof'; pass
+    // nullptr to detach.
+    void             set_heap_profiler(heap_profiler* prof);
 
   private:
     ValueType stack_pop();
+    // Allocates an object that can be part of a reference cycle, which the
+    // collector tracks from then on.
+    template <class T, class... Args>
+    std::shared_ptr<T> allocate(Args&&... args);
+    void      link(chunk& code, std::uint16_t chunk_base);
+    // Throws std::length_error once every slot is taken.
+    std::uint16_t global_slot(const std::string& name);
+    std::shared_ptr<obj_string> intern(std::string_view chars);
+    // Returns the interned string equal to 'str', which becomes it if there
+    // is none yet.
+    std::shared_ptr<obj_string> intern(std::shared_ptr<obj_string> str);
+    // Interns a string 'key'. Returns false after reporting a runtime error
+    // if 'key' cannot be a map key.
+    bool      map_key(ValueType& key);
+    // Returns the element of 'array' that 'key' indexes, or null after
+    // reporting a runtime error.
+    double*   array_element(obj_array& array, const ValueType& key);
+    // Calls the value below the top 'argc' values. A tail call reuses the
+    // running frame. Returns false after reporting a runtime error.
+    bool      call(std::uint8_t argc, bool tail);
+    bool      call_native(const obj_native& native, std::uint8_t argc);
+    // Enters 'fn' with the callee or receiver and 'argc' arguments on top of
+    // the stack.
+    bool      call_function(const obj_function& fn, obj_closure* closure,
+                            std::uint8_t argc, bool tail);
+    // Calls method 'site.name' of the receiver below the arguments, or a
+    // field of that name, filling the site's cache.
+    bool      invoke(property_site& site, std::uint8_t argc, bool tail);
+    // Calls method 'site.name' of the superclass on top of the stack, which
+    // it pops, on the receiver below the arguments.
+    bool      super_invoke(property_site& site, std::uint8_t argc, bool tail);
+    // Slow paths of the property instructions, which fill the site's inline
+    // cache. They expect the stack of the instruction: the receiver on top
+    // for get_property, the assigned value for set_property.
+    bool      get_property(property_site& site, obj_instance& instance);
+    void      set_property(property_site& site, obj_instance& instance);
+    // Replaces the receiver on top of the stack with its method 'name' of
+    // 'klass'. Returns false after reporting a runtime error.
+    bool      bind_method(const obj_class& klass, const obj_string& name);
+    // Returns the box of the variable in stack slot 'slot', sharing it with
+    // earlier captures.
+    std::shared_ptr<obj_upvalue> capture_upvalue(std::size_t slot);
+    // Moves every variable from stack slot 'first' up into its box.
+    void                         close_upvalues(std::size_t first);
+    void      pop_frame();
+    void      profile_tick();
+    // Line of the instruction being executed.
+    int       current_line() const;
+    void      print_result(const ValueType& val);
+    // Rewrites the instruction being executed.
+    void      quicken(OpCode code);
     template <class... Args>
     void runtime_error(std::string_view format, Args&&... args);
 };
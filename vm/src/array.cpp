@@ -0,0 +1,209 @@
+#include "array.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include "debug.hpp"
+
+// GCC dispatches between the clones through an ifunc resolver.
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && \
+    !defined(__clang__)
+#define SIMD_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_KERNEL
+#endif
+
+// The helpers below are always inlined, so how a non-AVX build would pass
+// 32-byte vectors between functions never matters.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace
+{
+// One AVX register, or two SSE2 or NEON registers.
+using v4d = double __attribute__((vector_size(32)));
+
+constexpr std::size_t LANES = 4;
+
+[[gnu::always_inline]] inline v4d load(const double* ptr)
+{
+    v4d val;
+    std::memcpy(&val, ptr, sizeof val);
+    return val;
+}
+
+[[gnu::always_inline]] inline void store(double* ptr, v4d val)
+{
+    std::memcpy(ptr, &val, sizeof val);
+}
+
+[[gnu::always_inline]] inline double lane_sum(v4d val)
+{
+    return (val[0] + val[1]) + (val[2] + val[3]);
+}
+
+}  // namespace
+
+namespace clox
+{
+namespace simd
+{
+// Two accumulators hide the latency of the vector additions.
+SIMD_KERNEL double sum(std::span<const double> xs)
+{
+    const auto* ptr = xs.data();
+    const auto  n   = xs.size();
+    v4d         acc0{};
+    v4d         acc1{};
+    std::size_t idx = 0;
+    for (; idx + 2 * LANES <= n; idx += 2 * LANES)
+    {
+        acc0 += load(ptr + idx);
+        acc1 += load(ptr + idx + LANES);
+    }
+    for (; idx + LANES <= n; idx += LANES)
+    {
+        acc0 += load(ptr + idx);
+    }
+    auto total = lane_sum(acc0 + acc1);
+    for (; idx < n; ++idx)
+    {
+        total += ptr[idx];
+    }
+    return total;
+}
+
+SIMD_KERNEL double dot(std::span<const double> xs, std::span<const double> ys)
+{
+    const auto* x = xs.data();
+    const auto* y = ys.data();
+    const auto  n = xs.size();
+    v4d         acc0{};
+    v4d         acc1{};
+    std::size_t idx = 0;
+    for (; idx + 2 * LANES <= n; idx += 2 * LANES)
+    {
+        acc0 += load(x + idx) * load(y + idx);
+        acc1 += load(x + idx + LANES) * load(y + idx + LANES);
+    }
+    for (; idx + LANES <= n; idx += LANES)
+    {
+        acc0 += load(x + idx) * load(y + idx);
+    }
+    auto total = lane_sum(acc0 + acc1);
+    for (; idx < n; ++idx)
+    {
+        total += x[idx] * y[idx];
+    }
+    return total;
+}
+
+SIMD_KERNEL void add(std::span<const double> xs, std::span<const double> ys,
+                     std::span<double> out)
+{
+    const auto  n   = xs.size();
+    std::size_t idx = 0;
+    for (; idx + LANES <= n; idx += LANES)
+    {
+        store(out.data() + idx, load(xs.data() + idx) + load(ys.data() + idx));
+    }
+    for (; idx < n; ++idx)
+    {
+        out[idx] = xs[idx] + ys[idx];
+    }
+}
+
+SIMD_KERNEL void scale(std::span<const double> xs, double factor,
+                       std::span<double> out)
+{
+    const auto  n   = xs.size();
+    std::size_t idx = 0;
+    for (; idx + LANES <= n; idx += LANES)
+    {
+        store(out.data() + idx, load(xs.data() + idx) * factor);
+    }
+    for (; idx < n; ++idx)
+    {
+        out[idx] = xs[idx] * factor;
+    }
+}
+
+SIMD_KERNEL double min(std::span<const double> xs)
+{
+    const auto* ptr    = xs.data();
+    const auto  n      = xs.size();
+    auto        result = ptr[0];
+    std::size_t idx    = 0;
+    if (n >= LANES)
+    {
+        auto acc = load(ptr);
+        for (idx = LANES; idx + LANES <= n; idx += LANES)
+        {
+            const auto val = load(ptr + idx);
+            acc            = val < acc ? val : acc;
+        }
+        for (std::size_t lane = 0; lane < LANES; ++lane)
+        {
+            result = acc[lane] < result ? acc[lane] : result;
+        }
+    }
+    for (; idx < n; ++idx)
+    {
+        result = ptr[idx] < result ? ptr[idx] : result;
+    }
+    return result;
+}
+
+SIMD_KERNEL double max(std::span<const double> xs)
+{
+    const auto* ptr    = xs.data();
+    const auto  n      = xs.size();
+    auto        result = ptr[0];
+    std::size_t idx    = 0;
+    if (n >= LANES)
+    {
+        auto acc = load(ptr);
+        for (idx = LANES; idx + LANES <= n; idx += LANES)
+        {
+            const auto val = load(ptr + idx);
+            acc            = val > acc ? val : acc;
+        }
+        for (std::size_t lane = 0; lane < LANES; ++lane)
+        {
+            result = acc[lane] > result ? acc[lane] : result;
+        }
+    }
+    for (; idx < n; ++idx)
+    {
+        result = ptr[idx] > result ? ptr[idx] : result;
+    }
+    return result;
+}
+
+}  // namespace simd
+
+obj_array::obj_array(std::size_t size) : values_(size) {}
+
+obj_array::obj_array(std::span<const double> values)
+    : values_(values.begin(), values.end())
+{
+}
+
+ObjType obj_array::type() const { return ObjType::ARRAY; }
+
+void obj_array::print(std::string& out) const
+{
+    out += '[';
+    for (std::size_t idx = 0; idx < values_.size(); ++idx)
+    {
+        if (idx != 0)
+        {
+            out += ", ";
+        }
+        debug::format_value(out, values_[idx]);
+    }
+    out += ']';
+}
+
+bool obj_array::operator==(const obj& other) const { return this == &other; }
+
+}  // namespace clox
@@ -1,4 +1,9 @@
 #include "chunk.hpp"
+
+#include <memory>
+
+#include "object.hpp"
+
 namespace clox
 {
 template <>
@@ -27,6 +32,84 @@ chunk::const_idx_t chunk::add_constant(ValueType val)
     return constants_.size() - 1;
 }
 
+chunk::global_idx_t chunk::add_global(std::string_view name)
+{
+    for (std::size_t idx = 0; idx < globals_.size(); ++idx)
+    {
+        if (globals_[idx] == name)
+        {
+            return idx;
+        }
+    }
+    globals_.emplace_back(name);
+    return globals_.size() - 1;
+}
+
+const std::string& chunk::global_name(std::size_t idx) const
+{
+    return slot_names_ ? slot_names_->at(idx) : globals_.at(idx);
+}
+
+std::size_t chunk::add_property(std::string_view name)
+{
+    properties_.push_back({std::make_shared<obj_string>(std::string{name})});
+    return properties_.size() - 1;
+}
+
+void chunk::patch(std::size_t offset, OpCode code)
+{
+    code_[offset] = static_cast<std::uint8_t>(code);
+}
+
+void chunk::patch_short(std::size_t offset, std::uint16_t value)
+{
+    code_[offset]     = static_cast<std::uint8_t>(value >> 8);
+    code_[offset + 1] = static_cast<std::uint8_t>(value & 0xff);
+}
+
+void chunk::truncate(std::size_t size)
+{
+    code_.resize(size);
+    lines_.resize(size);
+}
+
+void chunk::link(const std::vector<std::uint16_t>&               slots,
+                 std::shared_ptr<const std::vector<std::string>> names,
+                 std::uint16_t                                   chunk_base)
+{
+    for (std::size_t offset = 0; offset < code_.size();)
+    {
+        const auto op = static_cast<OpCode>(code_[offset]);
+        if (op == OpCode::OP_DEFINE_GLOBAL || op == OpCode::OP_GET_GLOBAL ||
+            op == OpCode::OP_SET_GLOBAL)
+        {
+            const auto idx = static_cast<std::size_t>(code_[offset + 1] << 8 |
+                                                      code_[offset + 2]);
+            patch_short(offset + 1, slots[idx]);
+        }
+        offset += 1 + static_cast<std::size_t>(operand_size(op));
+    }
+    slot_names_ = std::move(names);
+    if (chunk_base == 0)
+    {
+        return;
+    }
+    // Copies rather than updates the functions: they may be shared with
+    // another copy of the program.
+    for (auto& constant : constants_)
+    {
+        const auto* ptr = std::get_if<std::shared_ptr<obj>>(&constant);
+        if (ptr != nullptr && (*ptr)->type() == ObjType::FUNCTION)
+        {
+            const auto& fn = static_cast<const obj_function&>(**ptr);
+            constant       = std::make_shared<obj_function>(
+                fn.name(), fn.arity(),
+                static_cast<std::uint16_t>(chunk_base + fn.chunk()),
+                fn.upvalue_count());
+        }
+    }
+}
+
 const std::uint8_t* chunk::get_instruction(int idx) const noexcept(false)
 {
     return &code_[idx];
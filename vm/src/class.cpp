@@ -0,0 +1,143 @@
+#include "class.hpp"
+
+namespace clox
+{
+std::optional<std::size_t> shape::find(const obj_string& name) const
+{
+    const auto* slot = slots_.find(name);
+    if (slot == nullptr)
+    {
+        return std::nullopt;
+    }
+    return *slot;
+}
+
+const std::shared_ptr<shape>& shape::add(
+    const std::shared_ptr<obj_string>& name)
+{
+    if (const auto* next = transitions_.find(*name))
+    {
+        return *next;
+    }
+    auto next          = std::make_shared<shape>();
+    next->slots_       = slots_;
+    next->slots_.insert_or_assign(name, slots_.size());
+    transitions_.insert_or_assign(name, std::move(next));
+    return *transitions_.find(*name);
+}
+
+obj_class::obj_class(std::string name)
+    : name_(std::move(name)), root_(std::make_shared<shape>())
+{
+}
+
+ObjType obj_class::type() const { return ObjType::CLASS; }
+
+void obj_class::print(std::string& out) const { out += name_; }
+
+bool obj_class::operator==(const obj& other) const { return this == &other; }
+
+// The initializer is a second reference to the "init" method.
+void obj_class::trace(obj_visitor& visitor) const
+{
+    methods_.for_each([&](const auto&, const ValueType& method)
+                      { trace_value(method, visitor); });
+    if (initializer_)
+    {
+        trace_value(*initializer_, visitor);
+    }
+}
+
+void obj_class::clear()
+{
+    methods_ = {};
+    initializer_.reset();
+}
+
+void obj_class::add_method(std::shared_ptr<obj_string> name, ValueType method)
+{
+    if (name->str() == "init")
+    {
+        initializer_ = method;
+    }
+    methods_.insert_or_assign(std::move(name), std::move(method));
+}
+
+void obj_class::inherit(const obj_class& superclass)
+{
+    methods_     = superclass.methods_;
+    initializer_ = superclass.initializer_;
+}
+
+const ValueType* obj_class::find_method(const obj_string& name) const
+{
+    return methods_.find(name);
+}
+
+obj_instance::obj_instance(std::shared_ptr<obj_class> klass)
+    : class_(std::move(klass)), shape_(class_->root())
+{
+}
+
+ObjType obj_instance::type() const { return ObjType::INSTANCE; }
+
+void obj_instance::print(std::string& out) const
+{
+    out += class_->name();
+    out += " instance";
+}
+
+bool obj_instance::operator==(const obj& other) const
+{
+    return this == &other;
+}
+
+void obj_instance::trace(obj_visitor& visitor) const
+{
+    visitor.visit(class_);
+    for (const auto& field : fields_)
+    {
+        trace_value(field, visitor);
+    }
+}
+
+// The class is kept for print(). Any cycle through it is broken when the
+// class is cleared, as it is garbage too.
+void obj_instance::clear() { fields_.clear(); }
+
+void obj_instance::add_field(std::shared_ptr<shape> next, ValueType value)
+{
+    fields_.push_back(std::move(value));
+    shape_ = std::move(next);
+}
+
+obj_bound_method::obj_bound_method(ValueType receiver, ValueType method)
+    : receiver_(std::move(receiver)), method_(std::move(method))
+{
+}
+
+ObjType obj_bound_method::type() const { return ObjType::BOUND_METHOD; }
+
+void obj_bound_method::print(std::string& out) const
+{
+    std::get<std::shared_ptr<obj>>(method_)->print(out);
+}
+
+bool obj_bound_method::operator==(const obj& other) const
+{
+    return this == &other;
+}
+
+void obj_bound_method::trace(obj_visitor& visitor) const
+{
+    trace_value(receiver_, visitor);
+    trace_value(method_, visitor);
+}
+
+void obj_bound_method::clear()
+{
+    receiver_ = nil{};
+    method_   = nil{};
+}
+
+}  // namespace clox
@@ -0,0 +1,42 @@
+#include "closure.hpp"
+
+namespace clox
+{
+obj_upvalue::obj_upvalue(std::size_t stack_slot) : slot(stack_slot) {}
+
+ObjType obj_upvalue::type() const { return ObjType::UPVALUE; }
+
+void obj_upvalue::print(std::string& out) const { out += "upvalue"; }
+
+bool obj_upvalue::operator==(const obj& other) const { return this == &other; }
+
+// An open box refers to its stack slot, which the vm owns.
+void obj_upvalue::trace(obj_visitor& visitor) const
+{
+    trace_value(closed, visitor);
+}
+
+void obj_upvalue::clear() { closed = nil{}; }
+
+obj_closure::obj_closure(const obj_function& function) : function_(function)
+{
+    captures_.reserve(function.upvalue_count());
+}
+
+ObjType obj_closure::type() const { return ObjType::CLOSURE; }
+
+void obj_closure::print(std::string& out) const { function_.print(out); }
+
+bool obj_closure::operator==(const obj& other) const { return this == &other; }
+
+void obj_closure::trace(obj_visitor& visitor) const
+{
+    for (const auto& capture : captures_)
+    {
+        trace_value(capture, visitor);
+    }
+}
+
+void obj_closure::clear() { captures_.clear(); }
+
+}  // namespace clox
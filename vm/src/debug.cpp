@@ -2,6 +2,7 @@
 
 #include <format>
 #include <iostream>
+#include <iterator>
 #include <memory>
 
 #include "chunk.hpp"
@@ -25,12 +26,33 @@ overloaded(Ts...) -> overloaded<Ts...>;
 
 void debug::print_value(const clox::ValueType& val)
 {
+    std::string out;
+    format_value(out, val);
+    std::cout << out;
+}
+
+void debug::format_value(std::string& out, const clox::ValueType& val)
+{
+    const auto it = std::back_inserter(out);
     std::visit(
         overloaded{
-            [](const double val) { std::cout << std::format("'{:g}'", val); },
-            [](const bool val) { std::cout << std::format("'{}'", val); },
-            [](const nil val) { std::cout << "nil"; },
-            [](const std::shared_ptr<obj>& val) { val->print(); }},
+            [it](const double val) { std::format_to(it, "'{:g}'", val); },
+            [it](const std::int64_t val)
+            {
+                // Below a million '{:g}' prints integers exactly, and the
+                // integer formatter is much cheaper.
+                if (val > -1000000 && val < 1000000)
+                {
+                    std::format_to(it, "'{}'", val);
+                }
+                else
+                {
+                    std::format_to(it, "'{:g}'", static_cast<double>(val));
+                }
+            },
+            [it](const bool val) { std::format_to(it, "'{}'", val); },
+            [&out](nil) { out += "nil"; },
+            [&out](const std::shared_ptr<obj>& val) { val->print(out); }},
         val);
 }
 
@@ -44,10 +66,85 @@ int debug::constant_instruction(std::string_view name, const chunk& chunk,
     return offset + 2;
 }
 
+int debug::byte_instruction(std::string_view name, const chunk& chunk,
+                            int offset)
+{
+    std::cout << std::format("{:<16} {:04}", name, chunk.code_[offset + 1])
+              << std::endl;
+    return offset + 2;
+}
+
+int debug::jump_instruction(std::string_view name, int sign,
+                            const chunk& chunk, int offset)
+{
+    const auto jump = chunk.code_[offset + 1] << 8 | chunk.code_[offset + 2];
+    std::cout << std::format("{:<16} {:04} -> {:04}", name, offset,
+                             offset + 3 + sign * jump)
+              << std::endl;
+    return offset + 3;
+}
+
+int debug::for_loop_instruction(const chunk& chunk, int offset)
+{
+    const auto  slot  = chunk.code_[offset + 1];
+    const auto  limit = chunk.code_[offset + 2];
+    const auto  flags = chunk.code_[offset + 3];
+    const auto  jump  = chunk.code_[offset + 4] << 8 | chunk.code_[offset + 5];
+    std::string out   = std::format("{:<16} {:04} {} ", "OP_FOR_LOOP", slot,
+                                    flags & LOOP_INCLUSIVE ? "<=" : "<");
+    if (flags & LOOP_LIMIT_CONST)
+    {
+        format_value(out, chunk.constants_.at(limit));
+    }
+    else
+    {
+        out += std::format("{:04}", limit);
+    }
+    std::cout << out << std::format(" -> {:04}", offset + 6 - jump)
+              << std::endl;
+    return offset + 6;
+}
+
+int debug::global_instruction(std::string_view name, const chunk& chunk,
+                              int offset)
+{
+    const auto idx = static_cast<std::size_t>(chunk.code_[offset + 1] << 8 |
+                                              chunk.code_[offset + 2]);
+    std::cout << std::format("{:<16} {:04} '{}'", name, idx,
+                             chunk.global_name(idx))
+              << std::endl;
+    return offset + 3;
+}
+
+int debug::property_instruction(std::string_view name, const chunk& chunk,
+                                int offset)
+{
+    const auto  idx  = static_cast<std::size_t>(chunk.code_[offset + 1] << 8 |
+                                                chunk.code_[offset + 2]);
+    const auto& site = chunk.properties_.at(idx);
+    std::cout << std::format("{:<16} {:04} '{}' ({} cached)", name, idx,
+                             site.name->str(), site.cached)
+              << std::endl;
+    return offset + 3;
+}
+
+int debug::invoke_instruction(std::string_view name, const chunk& chunk,
+                              int offset)
+{
+    const auto  idx  = static_cast<std::size_t>(chunk.code_[offset + 1] << 8 |
+                                                chunk.code_[offset + 2]);
+    const auto& site = chunk.properties_.at(idx);
+    std::cout << std::format("{:<16} ({} args) {:04} '{}' ({} cached)", name,
+                             chunk.code_[offset + 3], idx, site.name->str(),
+                             site.cached)
+              << std::endl;
+    return offset + 4;
+}
+
 void debug::disassemble_chunk(const chunk& chunk, std::string_view name)
 {
     std::cout << std::format("== {} ==\n", name) << std::endl;
-    for (int offset = 0; offset < chunk.size();)
+    for (int offset = 0; offset < static_cast<int>(chunk.size());)
     {
         offset = disassemble_instruction(chunk, offset);
     }
@@ -55,10 +152,15 @@ void debug::disassemble_chunk(const chunk& chunk, std::string_view name)
 }
 
 int debug::disassemble_instruction(const chunk& chunk, int offset)
+{
+    return disassemble_instruction(
+        chunk, offset, static_cast<OpCode>(*chunk.get_instruction(offset)));
+}
+
+int debug::disassemble_instruction(const chunk& chunk, int offset,
+                                   OpCode instruction)
 {
     std::cout << std::format("{:04} ", offset);
-    const auto instruction =
-        static_cast<OpCode>(*chunk.get_instruction(offset));
     if (offset > 0 && chunk.lines_[offset] == chunk.lines_[offset - 1])
     {
         std::cout << "   | ";
@@ -97,6 +199,108 @@ int debug::disassemble_instruction(const chunk& chunk, int offset)
             return simple_instruction("OP_NOT", offset);
         case OpCode::OP_NEGATE:
             return simple_instruction("OP_NEGATE", offset);
+        case OpCode::OP_POP:
+            return simple_instruction("OP_POP", offset);
+        case OpCode::OP_PRINT:
+            return simple_instruction("OP_PRINT", offset);
+        case OpCode::OP_DEFINE_GLOBAL:
+            return global_instruction("OP_DEFINE_GLOBAL", chunk, offset);
+        case OpCode::OP_GET_GLOBAL:
+            return global_instruction("OP_GET_GLOBAL", chunk, offset);
+        case OpCode::OP_SET_GLOBAL:
+            return global_instruction("OP_SET_GLOBAL", chunk, offset);
+        case OpCode::OP_GET_LOCAL:
+            return byte_instruction("OP_GET_LOCAL", chunk, offset);
+        case OpCode::OP_SET_LOCAL:
+            return byte_instruction("OP_SET_LOCAL", chunk, offset);
+        case OpCode::OP_POPN:
+            return byte_instruction("OP_POPN", chunk, offset);
+        case OpCode::OP_JUMP:
+            return jump_instruction("OP_JUMP", 1, chunk, offset);
+        case OpCode::OP_JUMP_IF_FALSE:
+            return jump_instruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OpCode::OP_JUMP_IF_FALSE_OR_POP:
+            return jump_instruction("OP_JUMP_IF_FALSE_OR_POP", 1, chunk,
+                                    offset);
+        case OpCode::OP_JUMP_IF_TRUE_OR_POP:
+            return jump_instruction("OP_JUMP_IF_TRUE_OR_POP", 1, chunk,
+                                    offset);
+        case OpCode::OP_LOOP:
+            return jump_instruction("OP_LOOP", -1, chunk, offset);
+        case OpCode::OP_FOR_LOOP:
+            return for_loop_instruction(chunk, offset);
+        case OpCode::OP_CALL:
+            return byte_instruction("OP_CALL", chunk, offset);
+        case OpCode::OP_TAIL_CALL:
+            return byte_instruction("OP_TAIL_CALL", chunk, offset);
+        case OpCode::OP_CLOSURE:
+            return constant_instruction("OP_CLOSURE", chunk, offset);
+        case OpCode::OP_CAPTURE_LOCAL:
+            return byte_instruction("OP_CAPTURE_LOCAL", chunk, offset);
+        case OpCode::OP_CAPTURE_LOCAL_FLAT:
+            return byte_instruction("OP_CAPTURE_LOCAL_FLAT", chunk, offset);
+        case OpCode::OP_CAPTURE_UPVALUE:
+            return byte_instruction("OP_CAPTURE_UPVALUE", chunk, offset);
+        case OpCode::OP_GET_UPVALUE:
+            return byte_instruction("OP_GET_UPVALUE", chunk, offset);
+        case OpCode::OP_GET_UPVALUE_FLAT:
+            return byte_instruction("OP_GET_UPVALUE_FLAT", chunk, offset);
+        case OpCode::OP_SET_UPVALUE:
+            return byte_instruction("OP_SET_UPVALUE", chunk, offset);
+        case OpCode::OP_CLOSE_UPVALUE:
+            return simple_instruction("OP_CLOSE_UPVALUE", offset);
+        case OpCode::OP_CLASS:
+            return constant_instruction("OP_CLASS", chunk, offset);
+        case OpCode::OP_INHERIT:
+            return simple_instruction("OP_INHERIT", offset);
+        case OpCode::OP_METHOD:
+            return constant_instruction("OP_METHOD", chunk, offset);
+        case OpCode::OP_GET_PROPERTY:
+            return property_instruction("OP_GET_PROPERTY", chunk, offset);
+        case OpCode::OP_SET_PROPERTY:
+            return property_instruction("OP_SET_PROPERTY", chunk, offset);
+        case OpCode::OP_GET_SUPER:
+            return property_instruction("OP_GET_SUPER", chunk, offset);
+        case OpCode::OP_INVOKE:
+            return invoke_instruction("OP_INVOKE", chunk, offset);
+        case OpCode::OP_TAIL_INVOKE:
+            return invoke_instruction("OP_TAIL_INVOKE", chunk, offset);
+        case OpCode::OP_SUPER_INVOKE:
+            return invoke_instruction("OP_SUPER_INVOKE", chunk, offset);
+        case OpCode::OP_TAIL_SUPER_INVOKE:
+            return invoke_instruction("OP_TAIL_SUPER_INVOKE", chunk, offset);
+        case OpCode::OP_MAP:
+            return byte_instruction("OP_MAP", chunk, offset);
+        case OpCode::OP_INDEX_GET:
+            return simple_instruction("OP_INDEX_GET", offset);
+        case OpCode::OP_INDEX_SET:
+            return simple_instruction("OP_INDEX_SET", offset);
+        case OpCode::OP_ADD_NUM:
+            return simple_instruction("OP_ADD_NUM", offset);
+        case OpCode::OP_ADD_STR:
+            return simple_instruction("OP_ADD_STR", offset);
+        case OpCode::OP_EQUAL_NUM:
+            return simple_instruction("OP_EQUAL_NUM", offset);
+        case OpCode::OP_GREATER_NUM:
+            return simple_instruction("OP_GREATER_NUM", offset);
+        case OpCode::OP_LESS_NUM:
+            return simple_instruction("OP_LESS_NUM", offset);
+        case OpCode::OP_ADD_F64:
+            return simple_instruction("OP_ADD_F64", offset);
+        case OpCode::OP_SUBTRACT_F64:
+            return simple_instruction("OP_SUBTRACT_F64", offset);
+        case OpCode::OP_MULTIPLY_F64:
+            return simple_instruction("OP_MULTIPLY_F64", offset);
+        case OpCode::OP_DIVIDE_F64:
+            return simple_instruction("OP_DIVIDE_F64", offset);
+        case OpCode::OP_NEGATE_F64:
+            return simple_instruction("OP_NEGATE_F64", offset);
+        case OpCode::OP_EQUAL_F64:
+            return simple_instruction("OP_EQUAL_F64", offset);
+        case OpCode::OP_GREATER_F64:
+            return simple_instruction("OP_GREATER_F64", offset);
+        case OpCode::OP_LESS_F64:
+            return simple_instruction("OP_LESS_F64", offset);
         default:
             std::cout << std::format("Unknown opcode {}",
                                      static_cast<int>(instruction))
@@ -105,4 +309,147 @@ int debug::disassemble_instruction(const chunk& chunk, int offset)
     }
 }
 
+void debug::reg_operand(const reg_chunk& chunk, std::uint16_t idx,
+                        bool is_const)
+{
+    if (is_const)
+    {
+        std::cout << std::format("K{} ", idx);
+        print_value(chunk.constants_.at(idx));
+    }
+    else
+    {
+        std::cout << std::format("r{}", idx);
+    }
+}
+
+void debug::disassemble_chunk(const reg_chunk& chunk, std::string_view name)
+{
+    std::cout << std::format("== {} ({} registers) ==\n", name,
+                             chunk.registers())
+              << std::endl;
+    for (int offset = 0; offset < static_cast<int>(chunk.size());)
+    {
+        offset = disassemble_instruction(chunk, offset);
+    }
+    std::cout << std::endl;
+}
+
+int debug::disassemble_instruction(const reg_chunk& chunk, int offset)
+{
+    std::cout << std::format("{:04} ", offset);
+    if (offset > 0 && chunk.lines_[offset] == chunk.lines_[offset - 1])
+    {
+        std::cout << "   | ";
+    }
+    else
+    {
+        std::cout << std::format("{:4} ", chunk.lines_[offset]);
+    }
+    const auto& ins     = chunk.code_[offset];
+    const bool  b_const = ins.flags & reg_instr::B_CONST;
+    const bool  c_const = ins.flags & reg_instr::C_CONST;
+    const auto  binary  = [&](std::string_view name)
+    {
+        std::cout << std::format("{:<16} r{}, ", name, ins.a);
+        reg_operand(chunk, ins.b, b_const);
+        std::cout << ", ";
+        reg_operand(chunk, ins.c, c_const);
+        std::cout << std::endl;
+        return offset + 1;
+    };
+    const auto unary = [&](std::string_view name)
+    {
+        std::cout << std::format("{:<16} r{}, ", name, ins.a);
+        reg_operand(chunk, ins.b, b_const);
+        std::cout << std::endl;
+        return offset + 1;
+    };
+    // Instructions that only read RK[b].
+    const auto source = [&](std::string_view name)
+    {
+        std::cout << std::format("{:<16} ", name);
+        reg_operand(chunk, ins.b, b_const);
+        std::cout << std::endl;
+        return offset + 1;
+    };
+    const auto global = [&](std::string_view name)
+    {
+        std::cout << std::format("{:<16} g{}, ", name, ins.a);
+        reg_operand(chunk, ins.b, b_const);
+        std::cout << std::endl;
+        return offset + 1;
+    };
+    const auto branch = [&](std::string_view name)
+    {
+        std::cout << std::format("{:<16} ", name);
+        reg_operand(chunk, ins.b, b_const);
+        std::cout << std::format(" -> {}", ins.c) << std::endl;
+        return offset + 1;
+    };
+    switch (ins.op)
+    {
+        case RegOpCode::LOADK:
+            return unary("LOADK");
+        case RegOpCode::MOVE:
+            return unary("MOVE");
+        case RegOpCode::ADD:
+            return binary("ADD");
+        case RegOpCode::SUBTRACT:
+            return binary("SUBTRACT");
+        case RegOpCode::MULTIPLY:
+            return binary("MULTIPLY");
+        case RegOpCode::DIVIDE:
+            return binary("DIVIDE");
+        case RegOpCode::EQUAL:
+            return binary("EQUAL");
+        case RegOpCode::GREATER:
+            return binary("GREATER");
+        case RegOpCode::LESS:
+            return binary("LESS");
+        case RegOpCode::NOT:
+            return unary("NOT");
+        case RegOpCode::NEGATE:
+            return unary("NEGATE");
+        case RegOpCode::RETURN:
+            if (ins.a == 0)
+            {
+                std::cout << "RETURN" << std::endl;
+                return offset + 1;
+            }
+            return source("RETURN");
+        case RegOpCode::PRINT:
+            return source("PRINT");
+        case RegOpCode::DEFINE_GLOBAL:
+            return global("DEFINE_GLOBAL");
+        case RegOpCode::GET_GLOBAL:
+            std::cout << std::format("{:<16} r{}, g{}", "GET_GLOBAL", ins.a,
+                                     ins.b)
+                      << std::endl;
+            return offset + 1;
+        case RegOpCode::SET_GLOBAL:
+            return global("SET_GLOBAL");
+        case RegOpCode::JUMP:
+            std::cout << std::format("{:<16} -> {}", "JUMP", ins.c)
+                      << std::endl;
+            return offset + 1;
+        case RegOpCode::JUMP_IF_FALSE:
+            return branch("JUMP_IF_FALSE");
+        case RegOpCode::JUMP_IF_TRUE:
+            return branch("JUMP_IF_TRUE");
+        case RegOpCode::FOR_LOOP:
+            std::cout << std::format(
+                "{:<16} r{} {} ", "FOR_LOOP", ins.a,
+                (ins.flags & reg_instr::INCLUSIVE) ? "<=" : "<");
+            reg_operand(chunk, ins.b, b_const);
+            std::cout << std::format(" -> {}", ins.c) << std::endl;
+            return offset + 1;
+        default:
+            std::cout << std::format("Unknown opcode {}",
+                                     static_cast<int>(ins.op))
+                      << std::endl;
+            return offset + 1;
+    }
+}
+
 }  // namespace clox
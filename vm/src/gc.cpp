@@ -0,0 +1,418 @@
+#include "gc.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace
+{
+// Positions of the objects being collected, by address: open addressing
+// with linear probing in a table sized up front to be at most half full.
+class object_index
+{
+    struct slot
+    {
+        const clox::obj* key = nullptr;
+        std::size_t      pos = 0;
+    };
+
+    std::vector<slot> slots_;
+    int               shift_;
+
+    std::size_t home(const clox::obj* key) const noexcept
+    {
+        // Fibonacci hashing spreads the aligned addresses.
+        return static_cast<std::size_t>(
+            (reinterpret_cast<std::uintptr_t>(key) * 0x9e3779b97f4a7c15u) >>
+            shift_);
+    }
+
+  public:
+    static constexpr auto NONE = std::numeric_limits<std::size_t>::max();
+
+    // Room for 'size' objects.
+    explicit object_index(std::size_t size)
+        : slots_(std::bit_ceil(std::max<std::size_t>(2 * size, 2))),
+          shift_(64 - std::countr_zero(slots_.size()))
+    {
+    }
+    // Returns false if 'key' is already in the index.
+    bool emplace(const clox::obj* key, std::size_t pos)
+    {
+        const auto mask = slots_.size() - 1;
+        for (auto idx = home(key);; idx = (idx + 1) & mask)
+        {
+            if (slots_[idx].key == key)
+            {
+                return false;
+            }
+            if (slots_[idx].key == nullptr)
+            {
+                slots_[idx] = {key, pos};
+                return true;
+            }
+        }
+    }
+    std::size_t find(const clox::obj* key) const noexcept
+    {
+        const auto mask = slots_.size() - 1;
+        for (auto idx = home(key);; idx = (idx + 1) & mask)
+        {
+            if (slots_[idx].key == key)
+            {
+                return slots_[idx].pos;
+            }
+            if (slots_[idx].key == nullptr)
+            {
+                return NONE;
+            }
+        }
+    }
+};
+
+// The types whose objects trace their references.
+bool can_cycle(clox::ObjType type)
+{
+    switch (type)
+    {
+        case clox::ObjType::CLOSURE:
+        case clox::ObjType::UPVALUE:
+        case clox::ObjType::CLASS:
+        case clox::ObjType::INSTANCE:
+        case clox::ObjType::BOUND_METHOD:
+        case clox::ObjType::MAP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Pauses below 4ns have a bucket each. Above, a power of two is split
+// into four buckets by the two bits below the leading one.
+std::size_t pause_bucket(std::chrono::nanoseconds pause)
+{
+    const auto ns = static_cast<std::uint64_t>(
+        std::max<std::chrono::nanoseconds::rep>(pause.count(), 0));
+    if (ns < 4)
+    {
+        return ns;
+    }
+    const auto log = static_cast<std::size_t>(std::bit_width(ns) - 1);
+    return 4 * log + ((ns >> (log - 2)) & 3);
+}
+
+// The longest pause in 'bucket'.
+std::chrono::nanoseconds bucket_limit(std::size_t bucket)
+{
+    if (bucket < 4)
+    {
+        return std::chrono::nanoseconds{bucket};
+    }
+    const auto log  = bucket / 4;
+    const auto next = (std::uint64_t{5} + bucket % 4) << (log - 2);
+    return std::chrono::nanoseconds{static_cast<std::int64_t>(next - 1)};
+}
+
+// Takes the references between the objects being collected off their
+// counts.
+class internal_references final : public clox::obj_visitor
+{
+    const object_index& index_;
+    std::vector<long>&  refs_;
+
+  public:
+    internal_references(const object_index& index, std::vector<long>& refs)
+        : index_(index), refs_(refs)
+    {
+    }
+    void visit(const std::shared_ptr<clox::obj>& child) override
+    {
+        if (const auto pos = index_.find(child.get());
+            pos != object_index::NONE)
+        {
+            --refs_[pos];
+        }
+    }
+};
+
+// Marks the objects reachable from the ones on 'pending'.
+class reachable final : public clox::obj_visitor
+{
+    const object_index&       index_;
+    std::vector<bool>&        live_;
+    std::vector<std::size_t>& pending_;
+
+  public:
+    reachable(const object_index& index, std::vector<bool>& live,
+              std::vector<std::size_t>& pending)
+        : index_(index), live_(live), pending_(pending)
+    {
+    }
+    void visit(const std::shared_ptr<clox::obj>& child) override
+    {
+        const auto pos = index_.find(child.get());
+        if (pos != object_index::NONE && !live_[pos])
+        {
+            live_[pos] = true;
+            pending_.push_back(pos);
+        }
+    }
+};
+
+}  // namespace
+
+namespace clox
+{
+void gc_pauses::record(std::chrono::nanoseconds pause)
+{
+    ++count;
+    total += pause;
+    max = std::max(max, pause);
+    ++histogram[pause_bucket(pause)];
+}
+
+std::chrono::nanoseconds gc_pauses::percentile(double q) const
+{
+    const auto    rank = static_cast<std::uint64_t>(
+        std::ceil(q * static_cast<double>(count)));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < histogram.size(); ++bucket)
+    {
+        seen += histogram[bucket];
+        if (seen >= rank && seen != 0)
+        {
+            return std::min(bucket_limit(bucket), max);
+        }
+    }
+    return max;
+}
+
+void collector::track(const std::shared_ptr<obj>& object)
+{
+    young_.push_back({object, object.get()});
+    if (young_.size() >= young_limit_)
+    {
+        collect_young();
+    }
+}
+
+void collector::collect_young()
+{
+    const auto start = std::chrono::steady_clock::now();
+    minor();
+    // Waiting for the old generation to grow by a quarter keeps the
+    // amortized cost of major collections constant per promoted object.
+    if (!in_major_ && promoted_ > std::max(old_live_ / 4, young_limit_))
+    {
+        if (pause_target_.count() == 0)
+        {
+            major();
+        }
+        else
+        {
+            in_major_ = true;
+            promoted_ = 0;
+            unswept_  = 0;
+        }
+    }
+    if (in_major_)
+    {
+        // The target covers the whole pause.
+        slice(pause_target_ - (std::chrono::steady_clock::now() - start));
+    }
+    stats_.pauses.record(std::chrono::steady_clock::now() - start);
+}
+
+collector::~collector()
+{
+    collect();
+}
+
+void collector::collect()
+{
+    const auto start = std::chrono::steady_clock::now();
+    major();
+    stats_.pauses.record(std::chrono::steady_clock::now() - start);
+}
+
+void collector::minor()
+{
+    const auto start = std::chrono::steady_clock::now();
+    sweep(young_);
+    promoted_ += young_.size();
+    unswept_  += young_.size();
+    old_.insert(old_.end(), std::make_move_iterator(young_.begin()),
+                std::make_move_iterator(young_.end()));
+    young_.clear();
+    stats_.minor.record(std::chrono::steady_clock::now() - start);
+}
+
+// The entries that an unfinished slice pass moved from are empty, so the
+// sweep drops them.
+void collector::major()
+{
+    const auto start = std::chrono::steady_clock::now();
+    old_.insert(old_.end(), std::make_move_iterator(young_.begin()),
+                std::make_move_iterator(young_.end()));
+    young_.clear();
+    sweep(old_);
+    old_live_ = old_.size();
+    promoted_ = 0;
+    unswept_  = 0;
+    in_major_ = false;
+    cursor_   = 0;
+    kept_     = 0;
+    stats_.major.record(std::chrono::steady_clock::now() - start);
+}
+
+// Objects promoted while the pass runs are appended after the cursor, so
+// the pass visits them too.
+void collector::slice(std::chrono::nanoseconds time)
+{
+    const auto start  = std::chrono::steady_clock::now();
+    // At most twice the old generation, beyond which the extension hardly
+    // ever goes.
+    const auto most   = std::max(2.0 * static_cast<double>(old_.size()), 256.0);
+    const auto budget = static_cast<std::size_t>(std::clamp(
+        static_cast<double>(time.count()) / slice_cost_, 256.0, most));
+    // The objects promoted since the last slice were appended after the
+    // cursor. Moving it past twice as many closes the distance to the end
+    // by at least that many, so the pass ends, and the old generation
+    // grows by at most half of what it visits.
+    const auto batch  = std::max(budget / 2, 2 * unswept_);
+    const auto end    = std::min(old_.size(), cursor_ + batch);
+    unswept_          = 0;
+    const auto first  = old_.begin();
+    std::vector<tracked> objects(first + static_cast<std::ptrdiff_t>(cursor_),
+                                 first + static_cast<std::ptrdiff_t>(end));
+    const auto examined = sweep(objects, budget);
+    for (; cursor_ < end; ++cursor_)
+    {
+        if (old_[cursor_].ref.expired())
+        {
+            continue;
+        }
+        if (kept_ != cursor_)
+        {
+            old_[kept_] = std::move(old_[cursor_]);
+        }
+        ++kept_;
+    }
+    if (cursor_ == old_.size())
+    {
+        old_.erase(old_.begin() + static_cast<std::ptrdiff_t>(kept_),
+                   old_.end());
+        old_live_ = kept_;
+        in_major_ = false;
+        cursor_   = 0;
+        kept_     = 0;
+    }
+    const auto pause = std::chrono::steady_clock::now() - start;
+    stats_.major.record(pause);
+    if (examined != 0)
+    {
+        const auto cost = static_cast<double>(
+                              std::chrono::nanoseconds{pause}.count()) /
+                          static_cast<double>(examined);
+        slice_cost_     = (3 * slice_cost_ + cost) / 4;
+    }
+}
+
+template <class Objects>
+std::size_t collector::sweep(Objects& objects, std::size_t limit)
+{
+    std::erase_if(objects,
+                  [](const tracked& item) { return item.ref.expired(); });
+    object_index index{std::max(objects.size(), limit)};
+    for (std::size_t idx = 0; idx < objects.size(); ++idx)
+    {
+        index.emplace(objects[idx].ptr, idx);
+    }
+    // Appends the objects that are reached first, whether tracked or not.
+    class reaching final : public obj_visitor
+    {
+        object_index&     index_;
+        Objects&          objects_;
+        const std::size_t limit_;
+
+      public:
+        reaching(object_index& index, Objects& objects, std::size_t limit)
+            : index_(index), objects_(objects), limit_(limit)
+        {
+        }
+        void visit(const std::shared_ptr<obj>& child) override
+        {
+            if (objects_.size() < limit_ && can_cycle(child->type()) &&
+                index_.emplace(child.get(), objects_.size()))
+            {
+                objects_.push_back({child, child.get()});
+            }
+        }
+    } reach{index, objects, limit};
+    for (std::size_t idx = 0; idx < objects.size() && objects.size() < limit;
+         ++idx)
+    {
+        objects[idx].ptr->trace(reach);
+    }
+
+    const auto        count = objects.size();
+    std::vector<long> refs(count);
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        refs[idx] = objects[idx].ref.use_count();
+    }
+    internal_references internal{index, refs};
+    for (const auto& item : objects)
+    {
+        item.ptr->trace(internal);
+    }
+
+    std::vector<bool>        live(count);
+    std::vector<std::size_t> pending;
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        if (refs[idx] > 0)
+        {
+            live[idx] = true;
+            pending.push_back(idx);
+        }
+    }
+    reachable marker{index, live, pending};
+    while (!pending.empty())
+    {
+        const auto idx = pending.back();
+        pending.pop_back();
+        objects[idx].ptr->trace(marker);
+    }
+
+    // Holding the garbage keeps every object of a cycle alive until all of
+    // them are cleared.
+    std::vector<std::shared_ptr<obj>> garbage;
+    std::size_t                       kept = 0;
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        if (!live[idx])
+        {
+            garbage.push_back(objects[idx].ref.lock());
+            continue;
+        }
+        if (kept != idx)
+        {
+            objects[kept] = std::move(objects[idx]);
+        }
+        ++kept;
+    }
+    objects.erase(objects.begin() + static_cast<std::ptrdiff_t>(kept),
+                  objects.end());
+    for (const auto& object : garbage)
+    {
+        object->clear();
+    }
+    stats_.freed += garbage.size();
+    return count;
+}
+
+}  // namespace clox
@@ -0,0 +1,75 @@
+#include "heap.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace clox
+{
+void heap_profiler::record(int line, std::size_t bytes)
+{
+    const auto idx = static_cast<std::size_t>(std::max(line, 0));
+    if (idx >= lines_.size())
+    {
+        lines_.resize(idx + 1);
+    }
+    lines_[idx].bytes += bytes;
+    ++lines_[idx].allocations;
+    bytes_ += bytes;
+}
+
+heap_profiler::site heap_profiler::line(int line) const noexcept
+{
+    const auto idx = static_cast<std::size_t>(std::max(line, 0));
+    return idx < lines_.size() ? lines_[idx] : site{};
+}
+
+void heap_profiler::write(std::ostream& out) const
+{
+    std::vector<std::pair<int, site>> lines;
+    for (std::size_t line = 0; line < lines_.size(); ++line)
+    {
+        if (lines_[line].allocations != 0)
+        {
+            lines.emplace_back(static_cast<int>(line), lines_[line]);
+        }
+    }
+    std::ranges::stable_sort(lines, std::greater{},
+                             [](const auto& item)
+                             { return item.second.bytes; });
+    for (const auto& [line, totals] : lines)
+    {
+        out << std::format("line {:>6} {:>12} bytes {:>10} allocations "
+                           "{:6.2f}%\n",
+                           line, totals.bytes, totals.allocations,
+                           100.0 * static_cast<double>(totals.bytes) /
+                               static_cast<double>(bytes_));
+    }
+}
+
+void* heap::allocate_slow(std::size_t size)
+{
+    if (limit_ != 0 && bytes_ + size > limit_ && reclaim_ && !reclaiming_)
+    {
+        // Cycles the collector has not found yet may hold the memory.
+        reclaiming_ = true;
+        reclaim_();
+        reclaiming_ = false;
+    }
+    if (limit_ != 0 && bytes_ + size > limit_)
+    {
+        throw heap_exhausted{};
+    }
+    auto* ptr = charge(::operator new(size), size);
+    if (profiler_ != nullptr)
+    {
+        profiler_->record(line_(), size);
+    }
+    return ptr;
+}
+
+void heap::release(heap* target) noexcept
+{
+    delete target;
+}
+
+}  // namespace clox
@@ -0,0 +1,194 @@
+#include "map.hpp"
+
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+#include "debug.hpp"
+
+namespace
+{
+bool keys_equal(const clox::ValueType& a, const clox::ValueType& b)
+{
+    if (clox::is_number(a))
+    {
+        return clox::is_number(b) && clox::numbers_equal(a, b);
+    }
+    return clox::is_string(b) && *std::get<std::shared_ptr<clox::obj>>(a) ==
+                                     *std::get<std::shared_ptr<clox::obj>>(b);
+}
+
+}  // namespace
+
+namespace clox
+{
+ObjType obj_map::type() const { return ObjType::MAP; }
+
+void obj_map::print(std::string& out) const
+{
+    out += '{';
+    bool first = true;
+    for (const auto& slot : entries_)
+    {
+        if (slot.dist == 0)
+        {
+            continue;
+        }
+        if (!first)
+        {
+            out += ", ";
+        }
+        first = false;
+        debug::format_value(out, slot.key);
+        out += ": ";
+        debug::format_value(out, slot.value);
+    }
+    out += '}';
+}
+
+bool obj_map::operator==(const obj& other) const { return this == &other; }
+
+void obj_map::trace(obj_visitor& visitor) const
+{
+    for (const auto& slot : entries_)
+    {
+        trace_value(slot.value, visitor);
+    }
+}
+
+void obj_map::clear()
+{
+    entries_.clear();
+    count_ = 0;
+}
+
+bool obj_map::valid_key(const ValueType& key)
+{
+    if (const auto* val = std::get_if<double>(&key))
+    {
+        return !std::isnan(*val);
+    }
+    return std::holds_alternative<std::int64_t>(key) || is_string(key);
+}
+
+const ValueType* obj_map::find(const ValueType& key) const
+{
+    const auto idx = find_index(key, hash_key(key));
+    return idx < entries_.size() ? &entries_[idx].value : nullptr;
+}
+
+bool obj_map::set(ValueType key, ValueType value)
+{
+    const auto hash = hash_key(key);
+    if (const auto idx = find_index(key, hash); idx < entries_.size())
+    {
+        entries_[idx].value = std::move(value);
+        return false;
+    }
+    if ((count_ + 1) * 8 > entries_.size() * 7)
+    {
+        grow();
+    }
+    insert({std::move(key), std::move(value), hash, 1});
+    ++count_;
+    return true;
+}
+
+bool obj_map::erase(const ValueType& key)
+{
+    auto idx = find_index(key, hash_key(key));
+    if (idx == entries_.size())
+    {
+        return false;
+    }
+    // Moves the rest of the cluster one slot back, up to an entry that sits
+    // in its home slot.
+    const auto mask = entries_.size() - 1;
+    for (auto next = (idx + 1) & mask; entries_[next].dist > 1;
+         next      = (next + 1) & mask)
+    {
+        entries_[idx] = std::move(entries_[next]);
+        --entries_[idx].dist;
+        idx = next;
+    }
+    entries_[idx] = entry{};
+    --count_;
+    return true;
+}
+
+// Strings cache their hash. Numbers hash their value as a double, with -0
+// folded into 0, through the splitmix64 finalizer.
+std::uint32_t obj_map::hash_key(const ValueType& key)
+{
+    if (!is_number(key))
+    {
+        return static_cast<const obj_string&>(
+                   *std::get<std::shared_ptr<obj>>(key))
+            .hash();
+    }
+    const auto val  = as_number(key);
+    auto       bits = std::bit_cast<std::uint64_t>(val == 0 ? 0.0 : val);
+    bits            = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9u;
+    bits            = (bits ^ (bits >> 27)) * 0x94d049bb133111ebu;
+    return static_cast<std::uint32_t>(bits ^ (bits >> 31));
+}
+
+std::size_t obj_map::find_index(const ValueType& key, std::uint32_t hash) const
+{
+    if (count_ == 0)
+    {
+        return entries_.size();
+    }
+    const auto mask = entries_.size() - 1;
+    auto       idx  = hash & mask;
+    for (std::uint32_t dist = 1;; ++dist)
+    {
+        const auto& slot = entries_[idx];
+        // The key would have displaced an entry closer to its home slot.
+        if (slot.dist < dist)
+        {
+            return entries_.size();
+        }
+        if (slot.hash == hash && keys_equal(slot.key, key))
+        {
+            return idx;
+        }
+        idx = (idx + 1) & mask;
+    }
+}
+
+void obj_map::insert(entry item)
+{
+    const auto mask = entries_.size() - 1;
+    for (auto idx = item.hash & mask;; idx = (idx + 1) & mask, ++item.dist)
+    {
+        auto& slot = entries_[idx];
+        if (slot.dist == 0)
+        {
+            slot = std::move(item);
+            return;
+        }
+        if (slot.dist < item.dist)
+        {
+            std::swap(slot, item);
+        }
+    }
+}
+
+void obj_map::grow()
+{
+    const auto capacity = entries_.empty() ? std::size_t{8}
+                                           : entries_.size() * 2;
+    auto       old      = std::exchange(entries_, entry_vector(capacity));
+    for (auto& slot : old)
+    {
+        if (slot.dist != 0)
+        {
+            slot.dist = 1;
+            insert(std::move(slot));
+        }
+    }
+}
+
+}  // namespace clox
@@ -0,0 +1,365 @@
+#include "native.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "array.hpp"
+#include "debug.hpp"
+#include "map.hpp"
+
+namespace
+{
+using clox::ValueType;
+
+bool expect_numbers(std::span<const ValueType> args, std::string_view name,
+                    std::string& error)
+{
+    for (const auto& arg : args)
+    {
+        if (!clox::is_number(arg))
+        {
+            error = std::format("{}() expects numbers.", name);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Seconds on a monotonic clock, for scripts that time themselves.
+ValueType clock_native(std::span<const ValueType>, std::string&)
+{
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch())
+        .count();
+}
+
+ValueType sqrt_native(std::span<const ValueType> args, std::string& error)
+{
+    if (!expect_numbers(args, "sqrt", error))
+    {
+        return clox::nil{};
+    }
+    return std::sqrt(clox::as_number(args[0]));
+}
+
+ValueType floor_native(std::span<const ValueType> args, std::string& error)
+{
+    if (!expect_numbers(args, "floor", error))
+    {
+        return clox::nil{};
+    }
+    return clox::make_number(std::floor(clox::as_number(args[0])));
+}
+
+ValueType abs_native(std::span<const ValueType> args, std::string& error)
+{
+    if (!expect_numbers(args, "abs", error))
+    {
+        return clox::nil{};
+    }
+    if (const auto* i = std::get_if<std::int64_t>(&args[0]))
+    {
+        return *i < 0 ? -*i : *i;
+    }
+    return std::fabs(std::get<double>(args[0]));
+}
+
+// The array 'arg' holds, or null.
+clox::obj_array* as_array(const ValueType& arg)
+{
+    const auto* ptr = std::get_if<std::shared_ptr<clox::obj>>(&arg);
+    if (ptr == nullptr || (*ptr)->type() != clox::ObjType::ARRAY)
+    {
+        return nullptr;
+    }
+    return static_cast<clox::obj_array*>(ptr->get());
+}
+
+clox::obj_array* expect_array(const ValueType& arg, std::string_view name,
+                              std::string& error)
+{
+    auto* array = as_array(arg);
+    if (array == nullptr)
+    {
+        error = std::format("{}() expects an array.", name);
+    }
+    return array;
+}
+
+// The elements of two arrays of the same length, or nullopt.
+std::optional<std::pair<std::span<const double>, std::span<const double>>>
+expect_array_pair(std::span<const ValueType> args, std::string_view name,
+                  std::string& error)
+{
+    const auto* xs = as_array(args[0]);
+    const auto* ys = as_array(args[1]);
+    if (xs == nullptr || ys == nullptr)
+    {
+        error = std::format("{}() expects two arrays.", name);
+        return std::nullopt;
+    }
+    if (xs->values().size() != ys->values().size())
+    {
+        error = std::format("{}() expects arrays of the same length.", name);
+        return std::nullopt;
+    }
+    return std::pair{std::span<const double>{xs->values()},
+                     std::span<const double>{ys->values()}};
+}
+
+// min(a, b) of two numbers, or the smallest element of an array.
+ValueType min_native(std::span<const ValueType> args, std::string& error)
+{
+    if (args.size() == 1 && as_array(args[0]) != nullptr)
+    {
+        const auto& values = as_array(args[0])->values();
+        if (values.empty())
+        {
+            error = "min() of an empty array.";
+            return clox::nil{};
+        }
+        return clox::simd::min(values);
+    }
+    if (args.size() != 2 || !expect_numbers(args, "min", error))
+    {
+        error = "min() expects two numbers or an array.";
+        return clox::nil{};
+    }
+    return clox::less_numbers(args[1], args[0]) ? args[1] : args[0];
+}
+
+ValueType max_native(std::span<const ValueType> args, std::string& error)
+{
+    if (args.size() == 1 && as_array(args[0]) != nullptr)
+    {
+        const auto& values = as_array(args[0])->values();
+        if (values.empty())
+        {
+            error = "max() of an empty array.";
+            return clox::nil{};
+        }
+        return clox::simd::max(values);
+    }
+    if (args.size() != 2 || !expect_numbers(args, "max", error))
+    {
+        error = "max() expects two numbers or an array.";
+        return clox::nil{};
+    }
+    return clox::greater_numbers(args[1], args[0]) ? args[1] : args[0];
+}
+
+// array(n) holds n zeros.
+ValueType array_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto size =
+        clox::is_number(args[0]) ? clox::as_number(args[0]) : -1.0;
+    if (size != std::trunc(size) || size < 0 ||
+        size > static_cast<double>(clox::obj_array::MAX_SIZE))
+    {
+        error = std::format("array() expects a size from 0 to {}.",
+                            clox::obj_array::MAX_SIZE);
+        return clox::nil{};
+    }
+    return clox::make_object<clox::obj_array>(static_cast<std::size_t>(size));
+}
+
+ValueType sum_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto* array = expect_array(args[0], "sum", error);
+    if (array == nullptr)
+    {
+        return clox::nil{};
+    }
+    return clox::simd::sum(array->values());
+}
+
+ValueType dot_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto arrays = expect_array_pair(args, "dot", error);
+    if (!arrays)
+    {
+        return clox::nil{};
+    }
+    return clox::simd::dot(arrays->first, arrays->second);
+}
+
+// add(a, b) and scale(a, k) return new arrays.
+ValueType add_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto arrays = expect_array_pair(args, "add", error);
+    if (!arrays)
+    {
+        return clox::nil{};
+    }
+    auto result = clox::make_object<clox::obj_array>(arrays->first.size());
+    clox::simd::add(arrays->first, arrays->second, result->values());
+    return result;
+}
+
+ValueType scale_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto* array = expect_array(args[0], "scale", error);
+    if (array == nullptr)
+    {
+        return clox::nil{};
+    }
+    if (!clox::is_number(args[1]))
+    {
+        error = "scale() expects a number factor.";
+        return clox::nil{};
+    }
+    auto result = clox::make_object<clox::obj_array>(array->values().size());
+    clox::simd::scale(array->values(), clox::as_number(args[1]),
+                      result->values());
+    return result;
+}
+
+// The map in 'args[0]' and a valid key in 'args[1]', or null.
+// Maps are shared, so a native may change one it was passed.
+clox::obj_map* expect_map_key(std::span<const ValueType> args,
+                              std::string_view name, std::string& error)
+{
+    const auto* ptr = std::get_if<std::shared_ptr<clox::obj>>(&args[0]);
+    if (ptr == nullptr || (*ptr)->type() != clox::ObjType::MAP)
+    {
+        error = std::format("{}() expects a map.", name);
+        return nullptr;
+    }
+    if (!clox::obj_map::valid_key(args[1]))
+    {
+        error = "Map keys must be strings or numbers.";
+        return nullptr;
+    }
+    return static_cast<clox::obj_map*>(ptr->get());
+}
+
+ValueType len_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto* ptr = std::get_if<std::shared_ptr<clox::obj>>(&args[0]);
+    if (ptr != nullptr && (*ptr)->type() == clox::ObjType::MAP)
+    {
+        return static_cast<std::int64_t>(
+            static_cast<const clox::obj_map&>(**ptr).size());
+    }
+    if (const auto* array = as_array(args[0]))
+    {
+        return static_cast<std::int64_t>(array->values().size());
+    }
+    if (!clox::is_string(args[0]))
+    {
+        error = "len() expects a string, a map or an array.";
+        return clox::nil{};
+    }
+    const auto& str = static_cast<const clox::obj_string&>(**ptr);
+    return static_cast<std::int64_t>(str.str().size());
+}
+
+// A non-negative integer index, or -1.
+double index_arg(const ValueType& arg)
+{
+    if (!clox::is_number(arg))
+    {
+        return -1;
+    }
+    const auto val = clox::as_number(arg);
+    return val >= 0 && val == std::trunc(val) ? val : -1;
+}
+
+// substr(s, start, length) views the characters of 's' without copying
+// them, see obj_string::substr.
+ValueType substr_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto start  = index_arg(args[1]);
+    const auto length = index_arg(args[2]);
+    if (!clox::is_string(args[0]) || start < 0 || length < 0)
+    {
+        error = "substr() expects a string, a start and a length.";
+        return clox::nil{};
+    }
+    auto str = std::static_pointer_cast<clox::obj_string>(
+        std::get<std::shared_ptr<clox::obj>>(args[0]));
+    if (start + length > static_cast<double>(str->str().size()))
+    {
+        error = "substr() range is out of bounds.";
+        return clox::nil{};
+    }
+    return clox::obj_string::substr(str, static_cast<std::size_t>(start),
+                                    static_cast<std::size_t>(length));
+}
+
+ValueType has_native(std::span<const ValueType> args, std::string& error)
+{
+    const auto* map = expect_map_key(args, "has", error);
+    if (map == nullptr)
+    {
+        return clox::nil{};
+    }
+    return map->find(args[1]) != nullptr;
+}
+
+// Returns whether the key was there.
+ValueType delete_native(std::span<const ValueType> args, std::string& error)
+{
+    auto* map = expect_map_key(args, "delete", error);
+    if (map == nullptr)
+    {
+        return clox::nil{};
+    }
+    return map->erase(args[1]);
+}
+
+// The text 'print' shows, without the quotes around numbers and booleans.
+ValueType str_native(std::span<const ValueType> args, std::string&)
+{
+    if (clox::is_string(args[0]))
+    {
+        return args[0];
+    }
+    std::string out;
+    clox::debug::format_value(out, args[0]);
+    if (out.size() >= 2 && out.front() == '\'' && out.back() == '\'')
+    {
+        out = out.substr(1, out.size() - 2);
+    }
+    return clox::make_object<clox::obj_string>(out);
+}
+
+constexpr clox::native_def BUILTINS[] = {
+    {"clock", clock_native, 0}, {"sqrt", sqrt_native, 1},
+    {"floor", floor_native, 1}, {"abs", abs_native, 1},
+    {"min", min_native, clox::VARIADIC},
+    {"max", max_native, clox::VARIADIC},
+    {"len", len_native, 1},     {"str", str_native, 1},
+    {"has", has_native, 2},     {"delete", delete_native, 2},
+    {"array", array_native, 1}, {"sum", sum_native, 1},
+    {"dot", dot_native, 2},     {"add", add_native, 2},
+    {"scale", scale_native, 2}, {"substr", substr_native, 3},
+};
+
+}  // namespace
+
+namespace clox
+{
+obj_native::obj_native(std::string name, native_fn fn, int arity)
+    : name_(std::move(name)), fn_(fn), arity_(arity)
+{
+}
+
+ObjType obj_native::type() const { return ObjType::NATIVE; }
+
+void obj_native::print(std::string& out) const
+{
+    out += "<native fn ";
+    out += name_;
+    out += '>';
+}
+
+bool obj_native::operator==(const obj& other) const { return this == &other; }
+
+std::span<const native_def> builtin_natives() { return BUILTINS; }
+
+}  // namespace clox
@@ -1,15 +1,76 @@
 #include "object.hpp"
 
-#include <iostream>
+#include <utility>
 
 namespace clox
 {
 
-obj_string::obj_string(std::string str) : val_(std::move(str)) {}
+std::uint32_t hash_string(std::string_view chars)
+{
+    std::uint32_t hash = 2166136261u;
+    for (const auto c : chars)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+obj_string::obj_string(std::string_view str) : owned_(str), chars_(owned_) {}
+
+obj_string::obj_string(std::string_view head, std::string_view tail)
+    : owned_(
+          [&]
+          {
+              heap_string chars;
+              chars.reserve(head.size() + tail.size());
+              chars += head;
+              chars += tail;
+              return chars;
+          }()),
+      chars_(owned_)
+{
+}
+
+obj_string::obj_string(std::shared_ptr<const std::string> source,
+                       std::string_view                   chars)
+    : obj_string(source, source->size(), chars)
+{
+}
+
+obj_string::obj_string(std::shared_ptr<const void> buffer,
+                       std::size_t buffer_size, std::string_view chars)
+    : buffer_(std::move(buffer)), buffer_size_(buffer_size), chars_(chars)
+{
+}
+
+std::shared_ptr<obj_string> obj_string::substr(
+    const std::shared_ptr<obj_string>& str, std::size_t start,
+    std::size_t length)
+{
+    const auto chars = str->chars_.substr(start, length);
+    // An owning string lends its characters by keeping itself alive.
+    const auto size  = str->is_slice() ? str->buffer_size_ : str->owned_.size();
+    if (chars.size() * 8 < size)
+    {
+        return make_object<obj_string>(chars);
+    }
+    if (str->is_slice())
+    {
+        return make_object<obj_string>(str->buffer_, size, chars);
+    }
+    return make_object<obj_string>(std::shared_ptr<const void>(str), size,
+                                   chars);
+}
 
 ObjType obj_string::type() const { return ObjType::STRING; }
 
-void obj_string::print() const { std::cout << '"' << val_ << '"'; }
+void obj_string::print(std::string& out) const
+{
+    out += '"';
+    out += chars_;
+    out += '"';
+}
 
 bool obj_string::operator==(const obj& other) const
 {
@@ -17,12 +78,43 @@ bool obj_string::operator==(const obj& other) const
     {
         return false;
     }
-    return static_cast<const obj_string&>(other).val_ == val_;
+    const auto& str = static_cast<const obj_string&>(other);
+    // Hashes are only compared once both are known.
+    if (&str == this)
+    {
+        return true;
+    }
+    if (str.hashed_ && hashed_ && str.hash_ != hash_)
+    {
+        return false;
+    }
+    return str.chars_ == chars_;
 }
 
 std::shared_ptr<obj_string> obj_string::operator+(const obj_string& other) const
 {
-    return std::make_shared<obj_string>(val_ + other.val_);
+    return make_object<obj_string>(chars_, other.chars_);
 }
 
+obj_function::obj_function(std::string name, std::uint8_t arity,
+                           std::uint16_t chunk, std::uint8_t upvalue_count)
+    : name_(std::move(name)),
+      arity_(arity),
+      chunk_(chunk),
+      upvalue_count_(upvalue_count)
+{
+}
+
+ObjType obj_function::type() const { return ObjType::FUNCTION; }
+
+void obj_function::print(std::string& out) const
+{
+    out += "<fn ";
+    out += name_;
+    out += '>';
+}
+
+// Functions are only equal to themselves.
+bool obj_function::operator==(const obj& other) const { return this == &other; }
+
 }  // namespace clox
@@ -0,0 +1,63 @@
+#include "output.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+namespace clox
+{
+fd_sink::fd_sink(int fd) : fd_(fd) { buffer_.reserve(BUFFER_SIZE); }
+
+fd_sink::~fd_sink() { flush(); }
+
+void fd_sink::write(std::string_view data)
+{
+    if (buffer_.size() + data.size() > BUFFER_SIZE)
+    {
+        flush();
+    }
+    if (data.size() >= BUFFER_SIZE)
+    {
+        write_all(data);
+        return;
+    }
+    buffer_ += data;
+}
+
+void fd_sink::flush()
+{
+    write_all(buffer_);
+    buffer_.clear();
+}
+
+void fd_sink::write_all(std::string_view data)
+{
+    if (fd_ == STDOUT_FILENO && !data.empty())
+    {
+        // Whatever went through std::cout before, like the REPL prompt or
+        // disassembly, comes out first.
+        std::cout.flush();
+    }
+    while (!data.empty())
+    {
+        const auto written = ::write(fd_, data.data(), data.size());
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+output_sink& stdout_sink()
+{
+    static fd_sink sink{STDOUT_FILENO};
+    return sink;
+}
+
+}  // namespace clox
@@ -0,0 +1,173 @@
+#include "profiler.hpp"
+
+#include <sys/time.h>
+
+#include <algorithm>
+#include <csignal>
+#include <format>
+
+static volatile std::sig_atomic_t sample_pending = 0;
+
+static void on_sigprof(int) { sample_pending = 1; }
+
+namespace clox
+{
+profiler::profiler(Mode mode, std::uint32_t period)
+    : mode_(mode), period_(std::max<std::uint32_t>(period, 1))
+{
+}
+
+profiler::~profiler() { stop(); }
+
+void profiler::start()
+{
+    if (running_)
+    {
+        return;
+    }
+    running_ = true;
+    if (mode_ != Mode::TIMER)
+    {
+        return;
+    }
+    sample_pending = 0;
+    std::signal(SIGPROF, on_sigprof);
+    itimerval timer{};
+    timer.it_interval.tv_sec  = period_ / 1000000;
+    timer.it_interval.tv_usec = period_ % 1000000;
+    timer.it_value            = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void profiler::stop()
+{
+    if (!running_)
+    {
+        return;
+    }
+    running_ = false;
+    if (mode_ != Mode::TIMER)
+    {
+        return;
+    }
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    std::signal(SIGPROF, SIG_DFL);
+}
+
+std::uint32_t profiler::interval() const noexcept
+{
+    // In timer mode a sample lands up to TIMER_POLL instructions after the
+    // timer fired: microseconds late, against periods of a millisecond,
+    // while checking the flag on every instruction cost over half the run
+    // time.
+    return mode_ == Mode::TIMER ? TIMER_POLL : period_;
+}
+
+bool profiler::poll() noexcept
+{
+    if (!running_)
+    {
+        return false;
+    }
+    if (mode_ == Mode::INSTRUCTIONS)
+    {
+        return true;
+    }
+    if (sample_pending == 0)
+    {
+        return false;
+    }
+    sample_pending = 0;
+    return true;
+}
+
+void profiler::sample(std::span<const profile_frame> stack)
+{
+    if (stack.empty())
+    {
+        return;
+    }
+    ++samples_;
+    const auto line = static_cast<std::size_t>(std::max(stack.back().line, 0));
+    if (line >= line_samples_.size())
+    {
+        line_samples_.resize(line + 1);
+    }
+    ++line_samples_[line];
+    ++stack_samples_[{stack.begin(), stack.end()}];
+}
+
+void profiler::name_chunk(std::uint16_t chunk, std::string_view name)
+{
+    if (chunk >= chunk_names_.size())
+    {
+        chunk_names_.resize(chunk + 1);
+    }
+    if (chunk_names_[chunk].empty())
+    {
+        chunk_names_[chunk] = name;
+    }
+}
+
+std::string profiler::frame_name(const profile_frame& frame) const
+{
+    if (frame.chunk < chunk_names_.size() &&
+        !chunk_names_[frame.chunk].empty())
+    {
+        return std::format("{}:{}", chunk_names_[frame.chunk], frame.line);
+    }
+    if (frame.chunk == 0)
+    {
+        return std::format("script:{}", frame.line);
+    }
+    return std::format("chunk{}:{}", frame.chunk, frame.line);
+}
+
+std::uint64_t profiler::line_samples(int line) const noexcept
+{
+    if (line < 0 || static_cast<std::size_t>(line) >= line_samples_.size())
+    {
+        return 0;
+    }
+    return line_samples_[line];
+}
+
+void profiler::write_lines(std::ostream& out) const
+{
+    std::vector<std::pair<int, std::uint64_t>> lines;
+    for (std::size_t line = 0; line < line_samples_.size(); ++line)
+    {
+        if (line_samples_[line] != 0)
+        {
+            lines.emplace_back(static_cast<int>(line), line_samples_[line]);
+        }
+    }
+    std::ranges::stable_sort(lines, std::greater{},
+                             &std::pair<int, std::uint64_t>::second);
+    for (const auto& [line, count] : lines)
+    {
+        out << std::format("line {:>6} {:>10} {:6.2f}%\n", line, count,
+                           100.0 * static_cast<double>(count) /
+                               static_cast<double>(samples_));
+    }
+}
+
+void profiler::write_folded(std::ostream& out) const
+{
+    for (const auto& [stack, count] : stack_samples_)
+    {
+        std::string line;
+        for (const auto& frame : stack)
+        {
+            if (!line.empty())
+            {
+                line += ';';
+            }
+            line += frame_name(frame);
+        }
+        out << std::format("{} {}\n", line, count);
+    }
+}
+
+}  // namespace clox
@@ -0,0 +1,433 @@
+#include "register.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace
+{
+struct operand
+{
+    bool          is_const;
+    std::uint16_t idx;
+};
+}  // namespace
+
+namespace clox
+{
+// Abstractly interprets the value stack: stack slot 'n' becomes register
+// 'n', while constants, literals and copies of locals stay pending on the
+// simulated stack and are folded into the operands of the instruction that
+// consumes them. Where control flow joins, every value is moved into the
+// register of its slot first, so that all paths agree.
+std::optional<reg_chunk> reg_chunk::lower(const chunk& source)
+{
+    reg_chunk            result;
+    std::vector<operand> stack;
+    std::array<int, 256> const_map;
+    const_map.fill(-1);
+    int literal_map[3] = {-1, -1, -1};  // nil, true, false
+
+    const auto byte_at = [&source](std::size_t offset)
+    { return *source.get_instruction(static_cast<int>(offset)); };
+    const auto short_at = [&byte_at](std::size_t offset)
+    {
+        return static_cast<std::uint16_t>(byte_at(offset) << 8 |
+                                          byte_at(offset + 1));
+    };
+    // The offset a jump at 'offset' lands on, past the end when invalid.
+    const auto jump_target = [&](OpCode op, std::size_t offset)
+    {
+        const auto next = offset + 1 + operand_size(op);
+        switch (op)
+        {
+            case OpCode::OP_LOOP:
+                return next - short_at(offset + 1);
+            case OpCode::OP_FOR_LOOP:
+                return next - short_at(offset + 4);
+            default:
+                return next + short_at(offset + 1);
+        }
+    };
+
+    // Stack depth at each jump target, or -1 while no jump to it was seen.
+    std::vector<int> depths(source.size() + 1, -1);
+    std::vector<int> labels(source.size() + 1, -1);
+    std::vector<std::pair<std::size_t, std::size_t>> patches;
+    std::vector<bool> targets(source.size() + 1);
+    for (std::size_t offset = 0; offset < source.size();)
+    {
+        const auto op = generic_opcode(static_cast<OpCode>(byte_at(offset)));
+        switch (op)
+        {
+            case OpCode::OP_JUMP:
+            case OpCode::OP_JUMP_IF_FALSE:
+            case OpCode::OP_JUMP_IF_FALSE_OR_POP:
+            case OpCode::OP_JUMP_IF_TRUE_OR_POP:
+            case OpCode::OP_LOOP:
+            case OpCode::OP_FOR_LOOP:
+            {
+                const auto target = jump_target(op, offset);
+                if (target > source.size())
+                {
+                    return std::nullopt;
+                }
+                targets[target] = true;
+                break;
+            }
+            default:
+                break;
+        }
+        offset += 1 + operand_size(op);
+    }
+
+    const auto add_constant = [&result](ValueType val)
+    {
+        result.constants_.push_back(std::move(val));
+        return static_cast<std::uint16_t>(result.constants_.size() - 1);
+    };
+    const auto literal = [&](int slot, ValueType val)
+    {
+        if (literal_map[slot] < 0)
+        {
+            literal_map[slot] = add_constant(std::move(val));
+        }
+        stack.push_back({true, static_cast<std::uint16_t>(literal_map[slot])});
+    };
+    const auto constant = [&](std::uint8_t idx)
+    {
+        if (const_map[idx] < 0)
+        {
+            const_map[idx] = add_constant(source.get_constant(idx));
+        }
+        return operand{true, static_cast<std::uint16_t>(const_map[idx])};
+    };
+    const auto use = [&result](std::uint16_t reg)
+    {
+        result.registers_ =
+            std::max<std::uint16_t>(result.registers_, reg + 1);
+    };
+    const auto push_instr = [&](RegOpCode op, std::size_t offset,
+                                std::uint16_t a, operand b,
+                                operand c = {false, 0})
+    {
+        const auto flags = static_cast<std::uint8_t>(
+            (b.is_const ? reg_instr::B_CONST : 0) |
+            (c.is_const ? reg_instr::C_CONST : 0));
+        result.code_.push_back({op, flags, a, b.idx, c.idx});
+        result.lines_.push_back(source.line(offset));
+    };
+    const auto emit = [&](RegOpCode op, std::size_t offset, operand b,
+                          operand c = {false, 0})
+    {
+        const auto dst = static_cast<std::uint16_t>(stack.size());
+        use(dst);
+        push_instr(op, offset, dst, b, c);
+        stack.push_back({false, dst});
+    };
+    // Moves pending values into the registers of their slots: all of them,
+    // or only the copies of register 'copies_of' before it changes.
+    const auto materialize = [&](std::size_t offset, int copies_of = -1)
+    {
+        for (std::size_t slot = 0; slot < stack.size(); ++slot)
+        {
+            auto&      val = stack[slot];
+            const auto reg = static_cast<std::uint16_t>(slot);
+            if ((!val.is_const && val.idx == reg) ||
+                (copies_of >= 0 && (val.is_const || val.idx != copies_of)))
+            {
+                continue;
+            }
+            use(reg);
+            push_instr(val.is_const ? RegOpCode::LOADK : RegOpCode::MOVE,
+                       offset, reg, val);
+            val = {false, reg};
+        }
+    };
+    // Branches to the register code of 'target' with 'depth' values on the
+    // stack, all in their registers.
+    const auto branch = [&](RegOpCode op, std::size_t offset,
+                            std::size_t target, operand cond,
+                            std::uint16_t a = 0)
+    {
+        const auto depth = static_cast<int>(stack.size());
+        if (depths[target] >= 0 && depths[target] != depth)
+        {
+            return false;
+        }
+        depths[target] = depth;
+        patches.emplace_back(result.code_.size(), target);
+        push_instr(op, offset, a, cond);
+        return true;
+    };
+    const auto binary = [&](RegOpCode op, std::size_t offset)
+    {
+        if (stack.size() < 2)
+        {
+            return false;
+        }
+        const auto b = stack.back();
+        stack.pop_back();
+        const auto a = stack.back();
+        stack.pop_back();
+        emit(op, offset, a, b);
+        return true;
+    };
+    const auto unary = [&](RegOpCode op, std::size_t offset)
+    {
+        if (stack.empty())
+        {
+            return false;
+        }
+        const auto a = stack.back();
+        stack.pop_back();
+        emit(op, offset, a);
+        return true;
+    };
+
+    // False after an unconditional jump, until the next jump target.
+    bool reachable = true;
+    for (std::size_t offset = 0; offset < source.size();)
+    {
+        const auto instr = generic_opcode(static_cast<OpCode>(byte_at(offset)));
+        const auto size  = 1 + static_cast<std::size_t>(operand_size(instr));
+        if (offset + size > source.size())
+        {
+            return std::nullopt;
+        }
+        if (targets[offset])
+        {
+            if (reachable)
+            {
+                materialize(offset);
+                if (depths[offset] >= 0 &&
+                    depths[offset] != static_cast<int>(stack.size()))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if (depths[offset] >= 0)
+            {
+                // Only jumps get here, and they leave every value in its
+                // register.
+                stack.clear();
+                for (int slot = 0; slot < depths[offset]; ++slot)
+                {
+                    stack.push_back({false, static_cast<std::uint16_t>(slot)});
+                }
+            }
+            depths[offset] = static_cast<int>(stack.size());
+            labels[offset] = static_cast<int>(result.code_.size());
+            reachable      = true;
+        }
+
+        bool ok = true;
+        switch (instr)
+        {
+            case OpCode::OP_CONSTANT:
+                stack.push_back(constant(byte_at(offset + 1)));
+                break;
+            case OpCode::OP_NIL:
+                literal(0, nil{});
+                break;
+            case OpCode::OP_TRUE:
+                literal(1, true);
+                break;
+            case OpCode::OP_FALSE:
+                literal(2, false);
+                break;
+            case OpCode::OP_EQUAL:
+                ok = binary(RegOpCode::EQUAL, offset);
+                break;
+            case OpCode::OP_GREATER:
+                ok = binary(RegOpCode::GREATER, offset);
+                break;
+            case OpCode::OP_LESS:
+                ok = binary(RegOpCode::LESS, offset);
+                break;
+            case OpCode::OP_ADD:
+                ok = binary(RegOpCode::ADD, offset);
+                break;
+            case OpCode::OP_SUBTRACT:
+                ok = binary(RegOpCode::SUBTRACT, offset);
+                break;
+            case OpCode::OP_MULTIPLY:
+                ok = binary(RegOpCode::MULTIPLY, offset);
+                break;
+            case OpCode::OP_DIVIDE:
+                ok = binary(RegOpCode::DIVIDE, offset);
+                break;
+            case OpCode::OP_NOT:
+                ok = unary(RegOpCode::NOT, offset);
+                break;
+            case OpCode::OP_NEGATE:
+                ok = unary(RegOpCode::NEGATE, offset);
+                break;
+            case OpCode::OP_POP:
+                ok = !stack.empty();
+                if (ok)
+                {
+                    stack.pop_back();
+                }
+                break;
+            case OpCode::OP_POPN:
+            {
+                const auto count = byte_at(offset + 1);
+                ok               = count <= stack.size();
+                if (ok)
+                {
+                    stack.resize(stack.size() - count);
+                }
+                break;
+            }
+            case OpCode::OP_GET_LOCAL:
+            {
+                const auto slot = byte_at(offset + 1);
+                ok              = slot < stack.size();
+                if (ok)
+                {
+                    stack.push_back(stack[slot]);
+                }
+                break;
+            }
+            case OpCode::OP_SET_LOCAL:
+            {
+                const auto slot = byte_at(offset + 1);
+                ok              = !stack.empty() && slot < stack.size() - 1;
+                if (ok)
+                {
+                    materialize(offset, slot);
+                    use(slot);
+                    const auto val = stack.back();
+                    push_instr(val.is_const ? RegOpCode::LOADK
+                                            : RegOpCode::MOVE,
+                               offset, slot, val);
+                    stack[slot] = {false, slot};
+                }
+                break;
+            }
+            case OpCode::OP_PRINT:
+                ok = !stack.empty();
+                if (ok)
+                {
+                    push_instr(RegOpCode::PRINT, offset, 0, stack.back());
+                    stack.pop_back();
+                }
+                break;
+            case OpCode::OP_DEFINE_GLOBAL:
+            case OpCode::OP_SET_GLOBAL:
+                ok = !stack.empty();
+                if (ok)
+                {
+                    push_instr(instr == OpCode::OP_DEFINE_GLOBAL
+                                   ? RegOpCode::DEFINE_GLOBAL
+                                   : RegOpCode::SET_GLOBAL,
+                               offset, short_at(offset + 1), stack.back());
+                    if (instr == OpCode::OP_DEFINE_GLOBAL)
+                    {
+                        stack.pop_back();
+                    }
+                }
+                break;
+            case OpCode::OP_GET_GLOBAL:
+                emit(RegOpCode::GET_GLOBAL, offset,
+                     {false, short_at(offset + 1)});
+                break;
+            case OpCode::OP_JUMP:
+            case OpCode::OP_LOOP:
+                materialize(offset);
+                ok = branch(RegOpCode::JUMP, offset,
+                            jump_target(instr, offset), {false, 0});
+                reachable = false;
+                break;
+            case OpCode::OP_JUMP_IF_FALSE:
+            {
+                ok = !stack.empty();
+                if (ok)
+                {
+                    const auto cond = stack.back();
+                    stack.pop_back();
+                    materialize(offset);
+                    ok = branch(RegOpCode::JUMP_IF_FALSE, offset,
+                                jump_target(instr, offset), cond);
+                }
+                break;
+            }
+            case OpCode::OP_JUMP_IF_FALSE_OR_POP:
+            case OpCode::OP_JUMP_IF_TRUE_OR_POP:
+                // The value stays in its register when the jump is taken.
+                ok = !stack.empty();
+                if (ok)
+                {
+                    materialize(offset);
+                    ok = branch(instr == OpCode::OP_JUMP_IF_FALSE_OR_POP
+                                    ? RegOpCode::JUMP_IF_FALSE
+                                    : RegOpCode::JUMP_IF_TRUE,
+                                offset, jump_target(instr, offset),
+                                stack.back());
+                    stack.pop_back();
+                }
+                break;
+            case OpCode::OP_FOR_LOOP:
+            {
+                const auto counter = byte_at(offset + 1);
+                const auto limit   = byte_at(offset + 2);
+                const auto flags   = byte_at(offset + 3);
+                ok = counter < stack.size() && ((flags & LOOP_LIMIT_CONST) ||
+                                                limit < stack.size());
+                if (!ok)
+                {
+                    break;
+                }
+                materialize(offset);
+                ok = branch(RegOpCode::FOR_LOOP, offset,
+                            jump_target(instr, offset),
+                            (flags & LOOP_LIMIT_CONST)
+                                ? constant(limit)
+                                : operand{false, limit},
+                            counter);
+                if (flags & LOOP_INCLUSIVE)
+                {
+                    result.code_.back().flags |= reg_instr::INCLUSIVE;
+                }
+                break;
+            }
+            case OpCode::OP_RETURN:
+                // Only a script ending in an expression has a result.
+                if (stack.empty())
+                {
+                    push_instr(RegOpCode::RETURN, offset, 0, {false, 0});
+                }
+                else
+                {
+                    push_instr(RegOpCode::RETURN, offset, 1, stack.back());
+                    stack.pop_back();
+                }
+                reachable = false;
+                break;
+            default:
+                return std::nullopt;
+        }
+        if (!ok)
+        {
+            return std::nullopt;
+        }
+        offset += size;
+    }
+
+    if (result.code_.size() > std::numeric_limits<std::uint16_t>::max())
+    {
+        return std::nullopt;
+    }
+    for (const auto& [idx, target] : patches)
+    {
+        if (labels[target] < 0)
+        {
+            return std::nullopt;
+        }
+        result.code_[idx].c = static_cast<std::uint16_t>(labels[target]);
+    }
+    return result;
+}
+
+}  // namespace clox
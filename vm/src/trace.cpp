@@ -0,0 +1,123 @@
+#include "trace.hpp"
+
+#include <bit>
+#include <format>
+#include <fstream>
+#include <iostream>
+
+#include "debug.hpp"
+
+static constexpr std::uint32_t TRACE_MAGIC = 0x434c5854;  // "CLXT"
+
+static std::string_view tag_name(std::uint8_t tag)
+{
+    switch (tag)
+    {
+        case 0:
+            return "number";
+        case 1:
+            return "bool";
+        case 2:
+            return "nil";
+        case 3:
+            return "obj";
+        case 4:
+            return "int";
+        case clox::tracer::EMPTY_STACK:
+            return "empty";
+        default:
+            return "?";
+    }
+}
+
+namespace clox
+{
+tracer::tracer(std::size_t capacity)
+    : records_(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+      mask_(records_.size() - 1)
+{
+}
+
+std::size_t tracer::size() const noexcept
+{
+    return count_ < records_.size() ? static_cast<std::size_t>(count_)
+                                    : records_.size();
+}
+
+std::vector<trace_record> tracer::snapshot() const
+{
+    std::vector<trace_record> result;
+    result.reserve(size());
+    for (auto i = count_ - size(); i < count_; ++i)
+    {
+        result.push_back(records_[i & mask_]);
+    }
+    return result;
+}
+
+bool tracer::save(const std::filesystem::path& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    const auto          records = snapshot();
+    const std::uint64_t size    = records.size();
+    file.write(reinterpret_cast<const char*>(&TRACE_MAGIC),
+               sizeof(TRACE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&count_), sizeof(count_));
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(records.data()),
+               static_cast<std::streamsize>(size * sizeof(trace_record)));
+    return file.good();
+}
+
+bool tracer::load(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::uint32_t magic = 0;
+    std::uint64_t total = 0;
+    std::uint64_t size  = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&total), sizeof(total));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file || magic != TRACE_MAGIC || size > total)
+    {
+        return false;
+    }
+    records_.assign(std::bit_ceil(std::max<std::uint64_t>(size, 1)), {});
+    mask_ = records_.size() - 1;
+    file.read(reinterpret_cast<char*>(records_.data()),
+              static_cast<std::streamsize>(size * sizeof(trace_record)));
+    if (!file)
+    {
+        return false;
+    }
+    // Records are stored oldest first, so they start at slot 0.
+    count_ = size;
+    return true;
+}
+
+void tracer::decode(const std::vector<chunk>& chunks) const
+{
+    std::cout << std::format("== trace ({} of {} instructions) ==\n", size(),
+                             count_)
+              << '\n';
+    for (const auto& rec : snapshot())
+    {
+        std::cout << std::format("          [depth {}, top {}]\n",
+                                 rec.stack_depth, tag_name(rec.top_tag));
+        if (rec.chunk >= chunks.size() ||
+            rec.offset >= chunks[rec.chunk].size())
+        {
+            std::cout << std::format("{:04} <invalid record>\n", rec.offset);
+            continue;
+        }
+        debug::disassemble_instruction(
+            chunks[rec.chunk], static_cast<int>(rec.offset), rec.opcode);
+    }
+    std::cout << std::endl;
+}
+
+}  // namespace clox
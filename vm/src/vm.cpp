@@ -1,12 +1,21 @@
 #include "vm.hpp"
 
+#include <cmath>
 #include <format>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 #include <variant>
 
+#include "array.hpp"
 #include "chunk.hpp"
+#include "class.hpp"
 #include "debug.hpp"
+#include "map.hpp"
 #include "value.hpp"
 
 static bool is_falsey(const clox::ValueType& val)
@@ -15,68 +24,448 @@ static bool is_falsey(const clox::ValueType& val)
            (std::holds_alternative<bool>(val) && std::get<bool>(val) == false);
 }
 
+static bool values_equal(const clox::ValueType& a, const clox::ValueType& b)
+{
+    const auto is_obj = [](const auto& val)
+    { return std::holds_alternative<std::shared_ptr<clox::obj>>(val); };
+    if (is_obj(b) && is_obj(a))
+    {
+        return *std::get<std::shared_ptr<clox::obj>>(b) ==
+               *std::get<std::shared_ptr<clox::obj>>(a);
+    }
+    if (clox::is_number(a) && clox::is_number(b))
+    {
+        return clox::numbers_equal(a, b);
+    }
+    return a == b;
+}
+
+// Returns the object 'val' holds if it has type 'type', else null.
+template <class T>
+static T* object_of(const clox::ValueType& val, clox::ObjType type)
+{
+    const auto* ptr = std::get_if<std::shared_ptr<clox::obj>>(&val);
+    if (ptr == nullptr || (*ptr)->type() != type)
+    {
+        return nullptr;
+    }
+    return static_cast<T*>(ptr->get());
+}
+
+// A method or callee value is a function, or a closure if it captures.
+static std::pair<const clox::obj_function*, clox::obj_closure*> callable_parts(
+    const clox::ValueType& val)
+{
+    auto* closure =
+        object_of<clox::obj_closure>(val, clox::ObjType::CLOSURE);
+    if (closure != nullptr)
+    {
+        return {&closure->function(), closure};
+    }
+    return {object_of<clox::obj_function>(val, clox::ObjType::FUNCTION),
+            nullptr};
+}
+
 namespace clox
 {
-vm::vm(std::vector<chunk> chunks) : chunks_(std::move(chunks))
+vm::vm(std::vector<chunk> chunks)
 {
-    if (!chunks_.empty())
+    stack_.reserve(STACK_MAX);
+    heap_->set_reclaim([this] { gc_.collect(); });
+    for (const auto& native : builtin_natives())
     {
-        current_chunk_ = chunks_.begin();
-        ip_            = current_chunk_->get_instruction(0);
+        define_native(native.name, native.fn, native.arity);
     }
+    load(std::move(chunks));
 }
-InterpretResult vm::interpret() { return run(); }
 
-InterpretResult vm::run()
+vm::~vm()
+{
+    // The heap lives on while objects the embedder holds use it.
+    heap_->set_reclaim(nullptr);
+    heap_->profile(nullptr, nullptr);
+    stack_.clear();
+    open_upvalues_.clear();
+    globals_.clear();
+    gc_.collect();
+}
+
+void vm::define_native(std::string_view name, native_fn fn, int arity)
+{
+    std::string key{name};
+    const auto  slot = global_slot(key);
+    globals_[slot]   = std::make_shared<obj_native>(std::move(key), fn, arity);
+}
+
+void vm::load(std::vector<chunk> chunks)
 {
+    // Functions of earlier programs may live on in globals, so their code
+    // is kept and the new program's chunks are appended after it.
+    script_ = chunks_.size();
+    load_error_.clear();
+    try
+    {
+        for (auto& code : chunks)
+        {
+            link(code, static_cast<std::uint16_t>(script_));
+            chunks_.push_back(std::move(code));
+        }
+    }
+    catch (const std::length_error& err)
+    {
+        chunks_.resize(script_);
+        load_error_ = err.what();
+    }
+    reg_code_.reset();
 #ifdef DEBUG_TRACE_EXECUTION
-    std::cout << "== run == " << std::endl;
+    // Records refer to offsets in the old code.
+    tracer_.clear();
 #endif
+}
+
+// Resolves the chunk's global names to slots once, so that executing a
+// global access never looks at a name.
+void vm::link(chunk& code, std::uint16_t chunk_base)
+{
+    std::vector<std::uint16_t> slots;
+    slots.reserve(code.globals().size());
+    for (const auto& name : code.globals())
+    {
+        slots.push_back(global_slot(name));
+    }
+    code.link(slots, global_names_, chunk_base);
+    for (std::size_t idx = 0; idx < code.property_count(); ++idx)
+    {
+        auto& name = code.property(idx).name;
+        name       = intern(name->str());
+    }
+    // So that map lookups with literal keys compare pointers.
+    for (std::size_t idx = 0; idx < code.constant_count(); ++idx)
+    {
+        auto& constant = code.constant(idx);
+        if (is_string(constant))
+        {
+            constant = intern(std::static_pointer_cast<obj_string>(
+                std::get<std::shared_ptr<obj>>(constant)));
+        }
+    }
+}
+
+// Returns the slot of the global 'name', allocating an undefined one for a
+// name seen for the first time.
+std::uint16_t vm::global_slot(const std::string& name)
+{
+    auto key = intern(name);
+    if (const auto* slot = global_slots_.find(*key))
+    {
+        return *slot;
+    }
+    if (global_names_->size() > std::numeric_limits<std::uint16_t>::max())
+    {
+        throw std::length_error("Too many global variables.");
+    }
+    const auto slot = static_cast<std::uint16_t>(global_names_->size());
+    global_slots_.insert_or_assign(std::move(key), slot);
+    global_names_->push_back(name);
+    globals_.emplace_back();
+    return slot;
+}
+
+template <class T, class... Args>
+std::shared_ptr<T> vm::allocate(Args&&... args)
+{
+    auto object = make_object<T>(std::forward<Args>(args)...);
+    gc_.track(object);
+    return object;
+}
+
+std::shared_ptr<obj_string> vm::intern(std::string_view chars)
+{
+    const auto hash = hash_string(chars);
+    if (const auto* key = strings_.find_key(chars, hash))
+    {
+        return *key;
+    }
+    auto key = make_object<obj_string>(chars);
+    strings_.insert_or_assign(key, {});
+    return key;
+}
+
+std::shared_ptr<obj_string> vm::intern(std::shared_ptr<obj_string> str)
+{
+    if (const auto* key = strings_.find_key(str->str(), str->hash()))
+    {
+        return *key;
+    }
+    strings_.insert_or_assign(str, {});
+    return str;
+}
+
+bool vm::map_key(ValueType& key)
+{
+    if (is_string(key))
+    {
+        key = intern(std::static_pointer_cast<obj_string>(
+            std::get<std::shared_ptr<obj>>(key)));
+        return true;
+    }
+    if (!obj_map::valid_key(key))
+    {
+        runtime_error("Map keys must be strings or numbers.");
+        return false;
+    }
+    return true;
+}
+
+double* vm::array_element(obj_array& array, const ValueType& key)
+{
+    std::size_t idx;
+    if (const auto* i = std::get_if<std::int64_t>(&key))
+    {
+        idx = static_cast<std::size_t>(*i);
+    }
+    else if (const auto* d = std::get_if<double>(&key);
+             d != nullptr && *d == std::trunc(*d) && *d >= 0 &&
+             *d < static_cast<double>(obj_array::MAX_SIZE))
+    {
+        idx = static_cast<std::size_t>(*d);
+    }
+    else
+    {
+        runtime_error("Array index must be an integer.");
+        return nullptr;
+    }
+    // Negative integers wrap around to huge indexes.
+    if (idx >= array.values().size())
+    {
+        runtime_error("Array index {} is out of bounds for length {}.",
+                      as_number(key), array.values().size());
+        return nullptr;
+    }
+    return &array.values()[idx];
+}
+
+InterpretResult vm::interpret()
+{
+    if (!load_error_.empty())
+    {
+        out_->flush();
+        std::cout << load_error_ << std::endl;
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    if (script_ >= chunks_.size())
+    {
+        return InterpretResult::INTERPRET_OK;
+    }
+    const heap::scope running{heap_.get()};
+    current_chunk_ = &chunks_[script_];
+    ip_            = current_chunk_->get_instruction(0);
+    frames_[0]     = {current_chunk_, ip_, 0, nullptr, nullptr};
+    frame_         = &frames_[0];
+    frame_count_   = 1;
+    stack_.clear();
+    open_upvalues_.clear();
+    if (backend_ == Backend::REGISTER && !reg_code_)
+    {
+        reg_code_ = reg_chunk::lower(*current_chunk_);
+#ifdef DEBUG_PRINT_CODE
+        if (reg_code_)
+        {
+            debug::disassemble_chunk(*reg_code_, "register code");
+        }
+#endif
+    }
+    auto result = InterpretResult::INTERPRET_RUNTIME_ERROR;
+    try
+    {
+        result = backend_ == Backend::REGISTER && reg_code_ ? run_registers()
+                                                            : run();
+    }
+    catch (const heap_exhausted&)
+    {
+        runtime_error("Out of memory: heap limit of {} bytes exceeded.",
+                      heap_->limit());
+    }
+    catch (const std::bad_alloc&)
+    {
+        runtime_error("Out of memory.");
+    }
+    if (result == InterpretResult::INTERPRET_RUNTIME_ERROR)
+    {
+        // Frees the objects only the aborted program still held.
+        reg_ip_ = nullptr;
+        stack_.clear();
+        open_upvalues_.clear();
+    }
+    out_->flush();
+    return result;
+}
+
+InterpretResult vm::run()
+{
 
     const auto read_byte  = [this] { return *ip_++; };
+    const auto read_short = [this]
+    {
+        ip_ += 2;
+        return static_cast<std::uint16_t>(ip_[-2] << 8 | ip_[-1]);
+    };
     const auto read_const = [this, read_byte]
     { return current_chunk_->get_constant(read_byte()); };
     const auto peek = [this](const auto idx) -> const ValueType&
     { return stack_[stack_.size() - idx - 1]; };
 
-#define BINARY_OP(type, op)                                             \
-    do                                                                  \
-    {                                                                   \
-        if (!std::holds_alternative<type>(stack_[stack_.size() - 1]) || \
-            !std::holds_alternative<type>(stack_[stack_.size() - 2]))   \
-        {                                                               \
-            runtime_error("Operands must be numbers.");                 \
-            return InterpretResult::INTERPRET_RUNTIME_ERROR;            \
-        }                                                               \
-        const auto b = std::get<double>(stack_pop());                   \
-        const auto a = std::get<double>(stack_pop());                   \
-        stack_.push_back(a op b);                                       \
+    const auto both_numbers = [this]
+    {
+        return is_number(stack_[stack_.size() - 1]) &&
+               is_number(stack_[stack_.size() - 2]);
+    };
+
+    // 'fn' is one of the number operations from value.hpp.
+#define BINARY_OP(fn)                                           \
+    do                                                          \
+    {                                                           \
+        if (!both_numbers())                                    \
+        {                                                       \
+            runtime_error("Operands must be numbers.");         \
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;    \
+        }                                                       \
+        const auto b  = stack_pop();                            \
+        stack_.back() = fn(stack_.back(), b);                   \
+    } while (false)
+
+    const auto peek_mut = [this](const auto idx) -> ValueType&
+    { return stack_[stack_.size() - idx - 1]; };
+    const auto closure_on_top = [this]() -> obj_closure&
+    {
+        return static_cast<obj_closure&>(
+            *std::get<std::shared_ptr<obj>>(stack_.back()));
+    };
+    const auto upvalue = [this](std::uint8_t idx) -> obj_upvalue&
+    {
+        return static_cast<obj_upvalue&>(*std::get<std::shared_ptr<obj>>(
+            frame_->closure->captures()[idx]));
+    };
+    // Puts the generic instruction back and executes it instead.
+    const auto deoptimize = [this](OpCode generic)
+    {
+        quicken(generic);
+        --ip_;
+    };
+
+    // Guarded fast path of a specialized numeric instruction: operates on
+    // the stack in place and falls back to 'generic' on a type mismatch.
+#define NUM_OP(generic, fn)                                     \
+    do                                                          \
+    {                                                           \
+        if (!both_numbers()) [[unlikely]]                       \
+        {                                                       \
+            deoptimize(generic);                                \
+            break;                                              \
+        }                                                       \
+        const auto b  = stack_pop();                            \
+        stack_.back() = fn(stack_.back(), b);                   \
+    } while (false)
+
+    // Operands proven to be doubles by the compiler.
+#define F64_OP(op)                                         \
+    do                                                     \
+    {                                                      \
+        const auto b = as_number_f64(stack_.back());       \
+        stack_.pop_back();                                 \
+        stack_.back() = as_number_f64(stack_.back()) op b; \
     } while (false)
 
     for (;;)
     {
-#ifdef DEBUG_TRACE_EXECUTION
-        std::cout << "          ";
-        for (const auto& val : stack_)
+        if (--profile_countdown_ == 0) [[unlikely]]
         {
-            std::cout << "[ ";
-            clox::debug::print_value(val);
-            std::cout << " ]";
+            profile_tick();
         }
-        std::cout << std::endl;
-        debug::disassemble_instruction(
-            *current_chunk_,
-            static_cast<int>(ip_ - current_chunk_->get_instruction(0)));
+#ifdef DEBUG_TRACE_EXECUTION
+        tracer_.record(
+            static_cast<std::uint16_t>(current_chunk_ - chunks_.data()),
+            static_cast<std::uint32_t>(ip_ -
+                                       current_chunk_->get_instruction(0)),
+            static_cast<OpCode>(*ip_),
+            static_cast<std::uint32_t>(stack_.size()),
+            stack_.empty() ? tracer::EMPTY_STACK
+                           : static_cast<std::uint8_t>(stack_.back().index()));
 #endif
         const auto instr = static_cast<OpCode>(read_byte());
         switch (instr)
         {
             case OpCode::OP_RETURN:
             {
-                clox::debug::print_value(stack_pop());
-                std::cout << std::endl;
+                if (frame_count_ > 1)
+                {
+                    close_upvalues(frame_->slots);
+                    auto result = std::move(stack_.back());
+                    stack_.resize(frame_->slots);
+                    stack_.push_back(std::move(result));
+                    pop_frame();
+                    break;
+                }
+                // Only a script ending in an expression without ';' leaves
+                // a value behind; it is the result.
+                if (!stack_.empty())
+                {
+                    print_result(stack_pop());
+                }
                 return InterpretResult::INTERPRET_OK;
             }
+            case OpCode::OP_CALL:
+                if (!call(read_byte(), false))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OpCode::OP_TAIL_CALL:
+                if (!call(read_byte(), true))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OpCode::OP_INVOKE:
+            case OpCode::OP_TAIL_INVOKE:
+            {
+                auto&      site = current_chunk_->property(read_short());
+                const auto argc = read_byte();
+                const auto tail = instr == OpCode::OP_TAIL_INVOKE;
+                auto*      instance =
+                    object_of<obj_instance>(peek(argc), ObjType::INSTANCE);
+                // Steady state: a shape compare, then straight into the
+                // method with the receiver in slot 0.
+                const auto* hit =
+                    instance != nullptr ? site.find(instance->layout().get())
+                                        : nullptr;
+                if (hit != nullptr && hit->method != nullptr)
+                {
+                    const auto [fn, closure] = callable_parts(*hit->method);
+                    if (!call_function(*fn, closure, argc, tail))
+                    {
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+                    break;
+                }
+                if (!invoke(site, argc, tail))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OpCode::OP_SUPER_INVOKE:
+            case OpCode::OP_TAIL_SUPER_INVOKE:
+            {
+                auto&      site = current_chunk_->property(read_short());
+                const auto argc = read_byte();
+                if (!super_invoke(site, argc,
+                                  instr == OpCode::OP_TAIL_SUPER_INVOKE))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
             case OpCode::OP_CONSTANT:
             {
                 const auto constant = read_const();
@@ -94,41 +483,37 @@ InterpretResult vm::run()
                 break;
             case OpCode::OP_EQUAL:
             {
-                const auto b      = stack_pop();
-                const auto a      = stack_pop();
-                const auto is_obj = [](const auto& val)
-                { return std::holds_alternative<std::shared_ptr<obj>>(val); };
-                if (is_obj(b) && is_obj(a))
+                if (both_numbers())
                 {
-                    stack_.push_back(*std::get<std::shared_ptr<obj>>(b) ==
-                                     *std::get<std::shared_ptr<obj>>(a));
-                }
-                else
-                {
-                    stack_.push_back(a == b);
+                    quicken(OpCode::OP_EQUAL_NUM);
                 }
+                const auto b = stack_pop();
+                const auto a = stack_pop();
+                stack_.push_back(values_equal(a, b));
                 break;
             }
             case OpCode::OP_GREATER:
-                BINARY_OP(bool, >);
+                BINARY_OP(greater_numbers);
+                quicken(OpCode::OP_GREATER_NUM);
                 break;
             case OpCode::OP_LESS:
-                BINARY_OP(bool, <);
+                BINARY_OP(less_numbers);
+                quicken(OpCode::OP_LESS_NUM);
                 break;
             case OpCode::OP_ADD:
                 if (is_string(peek(0)) && is_string(peek(1)))
                 {
+                    quicken(OpCode::OP_ADD_STR);
                     const auto b = std::get<std::shared_ptr<obj>>(stack_pop());
                     const auto a = std::get<std::shared_ptr<obj>>(stack_pop());
                     stack_.push_back(static_cast<obj_string&>(*a) +
                                      static_cast<obj_string&>(*b));
                 }
-                else if (std::holds_alternative<double>(peek(0)) &&
-                         std::holds_alternative<double>(peek(1)))
+                else if (both_numbers())
                 {
-                    const auto b = std::get<double>(stack_pop());
-                    const auto a = std::get<double>(stack_pop());
-                    stack_.push_back(a + b);
+                    quicken(OpCode::OP_ADD_NUM);
+                    const auto b  = stack_pop();
+                    stack_.back() = add_numbers(stack_.back(), b);
                 }
                 else
                 {
@@ -138,32 +523,944 @@ InterpretResult vm::run()
                 }
                 break;
             case OpCode::OP_SUBTRACT:
-                BINARY_OP(double, -);
+                BINARY_OP(subtract_numbers);
                 break;
             case OpCode::OP_MULTIPLY:
-                BINARY_OP(double, *);
+                BINARY_OP(multiply_numbers);
                 break;
             case OpCode::OP_DIVIDE:
-                BINARY_OP(double, /);
+                BINARY_OP(divide_numbers);
                 break;
             case OpCode::OP_NOT:
                 stack_.push_back(is_falsey(stack_pop()));
                 break;
+            case OpCode::OP_POP:
+                stack_.pop_back();
+                break;
+            case OpCode::OP_POPN:
+                stack_.resize(stack_.size() - read_byte());
+                break;
+            case OpCode::OP_GET_LOCAL:
+                stack_.push_back(stack_[frame_->slots + read_byte()]);
+                break;
+            case OpCode::OP_JUMP:
+                ip_ += read_short();
+                break;
+            case OpCode::OP_JUMP_IF_FALSE:
+            {
+                const auto offset = read_short();
+                if (is_falsey(stack_.back()))
+                {
+                    ip_ += offset;
+                }
+                stack_.pop_back();
+                break;
+            }
+            case OpCode::OP_JUMP_IF_FALSE_OR_POP:
+            {
+                const auto offset = read_short();
+                if (is_falsey(stack_.back()))
+                {
+                    ip_ += offset;
+                }
+                else
+                {
+                    stack_.pop_back();
+                }
+                break;
+            }
+            case OpCode::OP_JUMP_IF_TRUE_OR_POP:
+            {
+                const auto offset = read_short();
+                if (!is_falsey(stack_.back()))
+                {
+                    ip_ += offset;
+                }
+                else
+                {
+                    stack_.pop_back();
+                }
+                break;
+            }
+            case OpCode::OP_LOOP:
+            {
+                const auto offset = read_short();
+                ip_ -= offset;
+                break;
+            }
+            case OpCode::OP_FOR_LOOP:
+            {
+                auto&       counter = stack_[frame_->slots + read_byte()];
+                const auto  limit   = read_byte();
+                const auto  flags   = read_byte();
+                const auto  offset  = read_short();
+                const auto& bound   = (flags & LOOP_LIMIT_CONST)
+                                          ? current_chunk_->get_constant(limit)
+                                          : stack_[frame_->slots + limit];
+                // Same checks, in the same order, as the unfused code.
+                if (!is_number(counter))
+                {
+                    runtime_error(
+                        "Operands must be two numbers or two strings.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                counter = add_numbers(counter, std::int64_t{1});
+                if (!is_number(bound))
+                {
+                    runtime_error("Operands must be numbers.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if ((flags & LOOP_INCLUSIVE) ? !greater_numbers(counter, bound)
+                                             : less_numbers(counter, bound))
+                {
+                    ip_ -= offset;
+                }
+                break;
+            }
+            case OpCode::OP_SET_LOCAL:
+                stack_[frame_->slots + read_byte()] = stack_.back();
+                break;
+            case OpCode::OP_CLOSURE:
+            {
+                const auto& fn = static_cast<const obj_function&>(
+                    *std::get<std::shared_ptr<obj>>(read_const()));
+                stack_.push_back(allocate<obj_closure>(fn));
+                break;
+            }
+            case OpCode::OP_CAPTURE_LOCAL:
+                closure_on_top().captures().push_back(
+                    capture_upvalue(frame_->slots + read_byte()));
+                break;
+            case OpCode::OP_CAPTURE_LOCAL_FLAT:
+            {
+                // Copied first: the closure may capture its own slot.
+                auto value = stack_[frame_->slots + read_byte()];
+                closure_on_top().captures().push_back(std::move(value));
+                break;
+            }
+            case OpCode::OP_CAPTURE_UPVALUE:
+                closure_on_top().captures().push_back(
+                    frame_->closure->captures()[read_byte()]);
+                break;
+            case OpCode::OP_GET_UPVALUE:
+            {
+                const auto& box = upvalue(read_byte());
+                stack_.push_back(box.is_open ? stack_[box.slot] : box.closed);
+                break;
+            }
+            case OpCode::OP_GET_UPVALUE_FLAT:
+                stack_.push_back(frame_->closure->captures()[read_byte()]);
+                break;
+            case OpCode::OP_SET_UPVALUE:
+            {
+                auto& box = upvalue(read_byte());
+                (box.is_open ? stack_[box.slot] : box.closed) = stack_.back();
+                break;
+            }
+            case OpCode::OP_CLOSE_UPVALUE:
+                close_upvalues(stack_.size() - 1);
+                stack_.pop_back();
+                break;
+            case OpCode::OP_CLASS:
+                stack_.push_back(allocate<obj_class>(
+                    std::string{static_cast<const obj_string&>(
+                                    *std::get<std::shared_ptr<obj>>(
+                                        read_const()))
+                                    .str()}));
+                break;
+            case OpCode::OP_INHERIT:
+            {
+                const auto* superclass =
+                    object_of<obj_class>(peek(1), ObjType::CLASS);
+                if (superclass == nullptr)
+                {
+                    runtime_error("Superclass must be a class.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                object_of<obj_class>(peek(0), ObjType::CLASS)
+                    ->inherit(*superclass);
+                stack_.pop_back();
+                break;
+            }
+            case OpCode::OP_METHOD:
+            {
+                const auto& name = static_cast<const obj_string&>(
+                    *std::get<std::shared_ptr<obj>>(read_const()));
+                object_of<obj_class>(peek(1), ObjType::CLASS)
+                    ->add_method(intern(name.str()), stack_pop());
+                break;
+            }
+            case OpCode::OP_GET_PROPERTY:
+            {
+                auto& site     = current_chunk_->property(read_short());
+                auto* instance =
+                    object_of<obj_instance>(peek(0), ObjType::INSTANCE);
+                if (instance == nullptr)
+                {
+                    runtime_error("Only instances have properties.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                // Steady state: one shape compare and an indexed load.
+                const auto* hit = site.find(instance->layout().get());
+                if (hit != nullptr)
+                {
+                    // Copied first: the assignment may free the instance.
+                    auto value    = instance->fields()[hit->slot];
+                    stack_.back() = std::move(value);
+                    break;
+                }
+                if (!get_property(site, *instance))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OpCode::OP_SET_PROPERTY:
+            {
+                auto& site     = current_chunk_->property(read_short());
+                auto* instance =
+                    object_of<obj_instance>(peek(1), ObjType::INSTANCE);
+                if (instance == nullptr)
+                {
+                    runtime_error("Only instances have fields.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                const auto* hit = site.find(instance->layout().get());
+                if (hit == nullptr)
+                {
+                    set_property(site, *instance);
+                }
+                else if (hit->to != nullptr)
+                {
+                    instance->add_field(hit->to, stack_.back());
+                }
+                else
+                {
+                    instance->fields()[hit->slot] = stack_.back();
+                }
+                // The assigned value replaces the instance.
+                auto value    = stack_pop();
+                stack_.back() = std::move(value);
+                break;
+            }
+            case OpCode::OP_GET_SUPER:
+            {
+                const auto& site       = current_chunk_->property(read_short());
+                const auto  superclass = stack_pop();
+                if (!bind_method(
+                        *object_of<obj_class>(superclass, ObjType::CLASS),
+                        *site.name))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OpCode::OP_MAP:
+            {
+                const auto first = stack_.size() - 2 * read_byte();
+                auto       map   = allocate<obj_map>();
+                for (auto idx = first; idx < stack_.size(); idx += 2)
+                {
+                    if (!map_key(stack_[idx]))
+                    {
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+                    map->set(std::move(stack_[idx]),
+                             std::move(stack_[idx + 1]));
+                }
+                stack_.resize(first);
+                stack_.push_back(std::move(map));
+                break;
+            }
+            case OpCode::OP_INDEX_GET:
+            {
+                if (auto* array =
+                        object_of<obj_array>(peek(1), ObjType::ARRAY))
+                {
+                    const auto* element = array_element(*array, peek(0));
+                    if (element == nullptr)
+                    {
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+                    const auto value = *element;
+                    stack_.pop_back();
+                    stack_.back() = value;
+                    break;
+                }
+                const auto* map = object_of<obj_map>(peek(1), ObjType::MAP);
+                if (map == nullptr)
+                {
+                    runtime_error("Only maps and arrays can be indexed.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if (!obj_map::valid_key(peek(0)))
+                {
+                    runtime_error("Map keys must be strings or numbers.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                // A missing key reads as nil. Copied first: the assignment
+                // may free the map.
+                const auto* found = map->find(peek(0));
+                auto value = found != nullptr ? *found : ValueType{nil{}};
+                stack_.pop_back();
+                stack_.back() = std::move(value);
+                break;
+            }
+            case OpCode::OP_INDEX_SET:
+            {
+                if (auto* array =
+                        object_of<obj_array>(peek(2), ObjType::ARRAY))
+                {
+                    if (!is_number(peek(0)))
+                    {
+                        runtime_error("Arrays can only hold numbers.");
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+                    auto* element = array_element(*array, peek(1));
+                    if (element == nullptr)
+                    {
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+                    *element   = as_number(peek(0));
+                    auto value = stack_pop();
+                    stack_.pop_back();
+                    stack_.back() = std::move(value);
+                    break;
+                }
+                auto* map = object_of<obj_map>(peek(2), ObjType::MAP);
+                if (map == nullptr)
+                {
+                    runtime_error("Only maps and arrays can be indexed.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if (!map_key(peek_mut(1)))
+                {
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                map->set(std::move(peek_mut(1)), peek(0));
+                auto value = stack_pop();
+                stack_.pop_back();
+                stack_.back() = std::move(value);
+                break;
+            }
+            case OpCode::OP_PRINT:
+                print_result(stack_.back());
+                stack_.pop_back();
+                break;
+            case OpCode::OP_DEFINE_GLOBAL:
+                globals_[read_short()] = std::move(stack_.back());
+                stack_.pop_back();
+                break;
+            case OpCode::OP_GET_GLOBAL:
+            {
+                const auto& global = globals_[read_short()];
+                if (!global) [[unlikely]]
+                {
+                    runtime_error("Undefined variable '{}'.",
+                                  (*global_names_)[&global - globals_.data()]);
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                stack_.push_back(*global);
+                break;
+            }
+            case OpCode::OP_SET_GLOBAL:
+            {
+                auto& global = globals_[read_short()];
+                if (!global) [[unlikely]]
+                {
+                    runtime_error("Undefined variable '{}'.",
+                                  (*global_names_)[&global - globals_.data()]);
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                *global = stack_.back();
+                break;
+            }
+            case OpCode::OP_ADD_NUM:
+                NUM_OP(OpCode::OP_ADD, add_numbers);
+                break;
+            case OpCode::OP_EQUAL_NUM:
+                NUM_OP(OpCode::OP_EQUAL, numbers_equal);
+                break;
+            case OpCode::OP_GREATER_NUM:
+                NUM_OP(OpCode::OP_GREATER, greater_numbers);
+                break;
+            case OpCode::OP_LESS_NUM:
+                NUM_OP(OpCode::OP_LESS, less_numbers);
+                break;
+            case OpCode::OP_ADD_F64:
+                F64_OP(+);
+                break;
+            case OpCode::OP_SUBTRACT_F64:
+                F64_OP(-);
+                break;
+            case OpCode::OP_MULTIPLY_F64:
+                F64_OP(*);
+                break;
+            case OpCode::OP_DIVIDE_F64:
+                F64_OP(/);
+                break;
+            case OpCode::OP_EQUAL_F64:
+                F64_OP(==);
+                break;
+            case OpCode::OP_GREATER_F64:
+                F64_OP(>);
+                break;
+            case OpCode::OP_LESS_F64:
+                F64_OP(<);
+                break;
+            case OpCode::OP_NEGATE_F64:
+                stack_.back() = -as_number_f64(stack_.back());
+                break;
+            case OpCode::OP_ADD_STR:
+            {
+                if (!is_string(peek(0)) || !is_string(peek(1))) [[unlikely]]
+                {
+                    deoptimize(OpCode::OP_ADD);
+                    break;
+                }
+                auto&       a = std::get<std::shared_ptr<obj>>(peek_mut(1));
+                const auto& b = std::get<std::shared_ptr<obj>>(peek(0));
+                a = static_cast<obj_string&>(*a) + static_cast<obj_string&>(*b);
+                stack_.pop_back();
+                break;
+            }
             case OpCode::OP_NEGATE:
-                if (std::holds_alternative<double>(stack_.back()))
+                if (is_number(stack_.back()))
                 {
-                    stack_.back() = -std::get<double>(stack_.back());
+                    stack_.back() = negate_number(stack_.back());
                 }
                 else
                 {
                     runtime_error("Operand must be a number.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
                 break;
         }
     }
+#undef F64_OP
+#undef NUM_OP
 #undef BINARY_OP
 }
 
+InterpretResult vm::run_registers()
+{
+    const auto& code = *reg_code_;
+    stack_.assign(code.registers(), nil{});
+    ValueType* const regs = stack_.data();
+    reg_ip_               = code.code();
+
+    const auto rk_b = [&code, regs](const reg_instr& ins) -> const ValueType&
+    {
+        return (ins.flags & reg_instr::B_CONST) ? code.constant(ins.b)
+                                                : regs[ins.b];
+    };
+    const auto rk_c = [&code, regs](const reg_instr& ins) -> const ValueType&
+    {
+        return (ins.flags & reg_instr::C_CONST) ? code.constant(ins.c)
+                                                : regs[ins.c];
+    };
+
+#define REG_BINARY_OP(fn)                                       \
+    do                                                          \
+    {                                                           \
+        const auto& a = rk_b(ins);                              \
+        const auto& b = rk_c(ins);                              \
+        if (!is_number(a) || !is_number(b))                     \
+        {                                                       \
+            runtime_error("Operands must be numbers.");         \
+            reg_ip_ = nullptr;                                  \
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;    \
+        }                                                       \
+        regs[ins.a] = fn(a, b);                                 \
+    } while (false)
+
+    for (;;)
+    {
+        if (--profile_countdown_ == 0) [[unlikely]]
+        {
+            profile_tick();
+        }
+        const auto& ins = *reg_ip_++;
+        switch (ins.op)
+        {
+            case RegOpCode::LOADK:
+                regs[ins.a] = code.constant(ins.b);
+                break;
+            case RegOpCode::MOVE:
+                regs[ins.a] = regs[ins.b];
+                break;
+            case RegOpCode::ADD:
+            {
+                const auto& a = rk_b(ins);
+                const auto& b = rk_c(ins);
+                if (is_number(a) && is_number(b))
+                {
+                    regs[ins.a] = add_numbers(a, b);
+                }
+                else if (is_string(a) && is_string(b))
+                {
+                    ValueType result =
+                        static_cast<obj_string&>(
+                            *std::get<std::shared_ptr<obj>>(a)) +
+                        static_cast<obj_string&>(
+                            *std::get<std::shared_ptr<obj>>(b));
+                    regs[ins.a] = std::move(result);
+                }
+                else
+                {
+                    runtime_error(
+                        "Operands must be two numbers or two strings.");
+                    reg_ip_ = nullptr;
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case RegOpCode::SUBTRACT:
+                REG_BINARY_OP(subtract_numbers);
+                break;
+            case RegOpCode::MULTIPLY:
+                REG_BINARY_OP(multiply_numbers);
+                break;
+            case RegOpCode::DIVIDE:
+                REG_BINARY_OP(divide_numbers);
+                break;
+            case RegOpCode::GREATER:
+                REG_BINARY_OP(greater_numbers);
+                break;
+            case RegOpCode::LESS:
+                REG_BINARY_OP(less_numbers);
+                break;
+            case RegOpCode::EQUAL:
+                regs[ins.a] = values_equal(rk_b(ins), rk_c(ins));
+                break;
+            case RegOpCode::NOT:
+                regs[ins.a] = is_falsey(rk_b(ins));
+                break;
+            case RegOpCode::NEGATE:
+            {
+                const auto& a = rk_b(ins);
+                if (!is_number(a))
+                {
+                    runtime_error("Operand must be a number.");
+                    reg_ip_ = nullptr;
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                regs[ins.a] = negate_number(a);
+                break;
+            }
+            case RegOpCode::RETURN:
+                if (ins.a != 0)
+                {
+                    print_result(rk_b(ins));
+                }
+                reg_ip_ = nullptr;
+                return InterpretResult::INTERPRET_OK;
+            case RegOpCode::PRINT:
+                print_result(rk_b(ins));
+                break;
+            case RegOpCode::DEFINE_GLOBAL:
+                globals_[ins.a] = rk_b(ins);
+                break;
+            case RegOpCode::GET_GLOBAL:
+            case RegOpCode::SET_GLOBAL:
+            {
+                const auto slot =
+                    ins.op == RegOpCode::GET_GLOBAL ? ins.b : ins.a;
+                auto& global = globals_[slot];
+                if (!global) [[unlikely]]
+                {
+                    runtime_error("Undefined variable '{}'.",
+                                  (*global_names_)[slot]);
+                    reg_ip_ = nullptr;
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if (ins.op == RegOpCode::GET_GLOBAL)
+                {
+                    regs[ins.a] = *global;
+                }
+                else
+                {
+                    *global = rk_b(ins);
+                }
+                break;
+            }
+            case RegOpCode::JUMP:
+                reg_ip_ = code.code() + ins.c;
+                break;
+            case RegOpCode::JUMP_IF_FALSE:
+                if (is_falsey(rk_b(ins)))
+                {
+                    reg_ip_ = code.code() + ins.c;
+                }
+                break;
+            case RegOpCode::JUMP_IF_TRUE:
+                if (!is_falsey(rk_b(ins)))
+                {
+                    reg_ip_ = code.code() + ins.c;
+                }
+                break;
+            case RegOpCode::FOR_LOOP:
+            {
+                auto&       counter = regs[ins.a];
+                const auto& bound   = rk_b(ins);
+                // Same checks, in the same order, as the stack backend.
+                if (!is_number(counter))
+                {
+                    runtime_error(
+                        "Operands must be two numbers or two strings.");
+                    reg_ip_ = nullptr;
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                counter = add_numbers(counter, std::int64_t{1});
+                if (!is_number(bound))
+                {
+                    runtime_error("Operands must be numbers.");
+                    reg_ip_ = nullptr;
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if ((ins.flags & reg_instr::INCLUSIVE)
+                        ? !greater_numbers(counter, bound)
+                        : less_numbers(counter, bound))
+                {
+                    reg_ip_ = code.code() + ins.c;
+                }
+                break;
+            }
+        }
+    }
+#undef REG_BINARY_OP
+}
+
+bool vm::call(std::uint8_t argc, bool tail)
+{
+    const auto  callee_slot = stack_.size() - argc - 1;
+    const auto* callee =
+        std::get_if<std::shared_ptr<obj>>(&stack_[callee_slot]);
+    if (callee == nullptr)
+    {
+        runtime_error("Can only call functions and classes.");
+        return false;
+    }
+    const obj_function* fn      = nullptr;
+    obj_closure*        closure = nullptr;
+    switch ((*callee)->type())
+    {
+        case ObjType::FUNCTION:
+        case ObjType::CLOSURE:
+            std::tie(fn, closure) = callable_parts(stack_[callee_slot]);
+            break;
+        case ObjType::NATIVE:
+            return call_native(static_cast<const obj_native&>(**callee), argc);
+        case ObjType::CLASS:
+        {
+            // The new instance takes the class's slot as the receiver.
+            auto klass = std::static_pointer_cast<obj_class>(*callee);
+            stack_[callee_slot] = allocate<obj_instance>(klass);
+            if (!klass->initializer())
+            {
+                if (argc != 0)
+                {
+                    runtime_error("Expected 0 arguments but got {}.", argc);
+                    return false;
+                }
+                return true;
+            }
+            // The receiver keeps the class and so its methods alive.
+            std::tie(fn, closure) = callable_parts(*klass->initializer());
+            break;
+        }
+        case ObjType::BOUND_METHOD:
+        {
+            const auto& bound =
+                static_cast<const obj_bound_method&>(**callee);
+            std::tie(fn, closure) = callable_parts(bound.method());
+            auto receiver         = bound.receiver();
+            stack_[callee_slot]   = std::move(receiver);
+            break;
+        }
+        default:
+            runtime_error("Can only call functions and classes.");
+            return false;
+    }
+    return call_function(*fn, closure, argc, tail);
+}
+
+bool vm::call_function(const obj_function& fn, obj_closure* closure,
+                       std::uint8_t argc, bool tail)
+{
+    if (argc != fn.arity())
+    {
+        runtime_error("Expected {} arguments but got {}.", fn.arity(), argc);
+        return false;
+    }
+    const auto callee_slot = stack_.size() - argc - 1;
+    auto&      code        = chunks_[fn.chunk()];
+    // The script's frame is never replaced: its OP_RETURN ends the run.
+    if (tail && frame_count_ > 1)
+    {
+        close_upvalues(frame_->slots);
+        // Slide the callee and its arguments over the caller's slots.
+        std::move(stack_.begin() + static_cast<std::ptrdiff_t>(callee_slot),
+                  stack_.end(),
+                  stack_.begin() + static_cast<std::ptrdiff_t>(frame_->slots));
+        stack_.resize(frame_->slots + argc + 1);
+    }
+    else
+    {
+        if (frame_count_ == FRAMES_MAX)
+        {
+            runtime_error("Stack overflow.");
+            return false;
+        }
+        frame_->ip    = ip_;
+        frame_        = &frames_[frame_count_++];
+        frame_->slots = callee_slot;
+    }
+    frame_->code     = &code;
+    frame_->function = &fn;
+    frame_->closure  = closure;
+    current_chunk_   = &code;
+    ip_              = code.get_instruction(0);
+    return true;
+}
+
+// Natives run on the caller's frame, straight on its stack values.
+bool vm::call_native(const obj_native& native, std::uint8_t argc)
+{
+    if (native.arity() != VARIADIC && argc != native.arity())
+    {
+        runtime_error("Expected {} arguments but got {}.", native.arity(),
+                      argc);
+        return false;
+    }
+    const auto callee_slot = stack_.size() - argc - 1;
+    native_error_.clear();
+    auto result =
+        native.fn()({stack_.data() + callee_slot + 1, argc}, native_error_);
+    if (!native_error_.empty()) [[unlikely]]
+    {
+        runtime_error("{}", native_error_);
+        return false;
+    }
+    stack_.resize(callee_slot);
+    stack_.push_back(std::move(result));
+    return true;
+}
+
+bool vm::get_property(property_site& site, obj_instance& instance)
+{
+    const auto slot = instance.layout()->find(*site.name);
+    if (!slot)
+    {
+        return bind_method(instance.klass(), *site.name);
+    }
+    site.remember({instance.layout(), nullptr, *slot});
+    auto value    = instance.fields()[*slot];
+    stack_.back() = std::move(value);
+    return true;
+}
+
+void vm::set_property(property_site& site, obj_instance& instance)
+{
+    const auto from = instance.layout();
+    if (const auto slot = from->find(*site.name))
+    {
+        site.remember({from, nullptr, *slot});
+        instance.fields()[*slot] = stack_.back();
+        return;
+    }
+    const auto& next = from->add(site.name);
+    instance.add_field(next, stack_.back());
+    site.remember({from, next, from->size()});
+}
+
+bool vm::invoke(property_site& site, std::uint8_t argc, bool tail)
+{
+    auto& receiver = stack_[stack_.size() - argc - 1];
+    auto* instance = object_of<obj_instance>(receiver, ObjType::INSTANCE);
+    if (instance == nullptr)
+    {
+        runtime_error("Only instances have methods.");
+        return false;
+    }
+    const auto&    layout = instance->layout();
+    const auto*    entry  = site.find(layout.get());
+    property_cache miss;
+    if (entry == nullptr)
+    {
+        miss.from = layout;
+        if (const auto slot = layout->find(*site.name))
+        {
+            miss.slot = *slot;
+        }
+        else
+        {
+            miss.method = instance->klass().find_method(*site.name);
+            if (miss.method == nullptr)
+            {
+                runtime_error("Undefined property '{}'.", site.name->str());
+                return false;
+            }
+        }
+        site.remember(miss);
+        entry = &miss;
+    }
+    if (entry->method != nullptr)
+    {
+        const auto [fn, closure] = callable_parts(*entry->method);
+        return call_function(*fn, closure, argc, tail);
+    }
+    // A field shadows the method: call whatever it holds.
+    auto field = instance->fields()[entry->slot];
+    receiver   = std::move(field);
+    return call(argc, tail);
+}
+
+bool vm::super_invoke(property_site& site, std::uint8_t argc, bool tail)
+{
+    const auto  superclass = stack_pop();
+    const auto& klass = *object_of<obj_class>(superclass, ObjType::CLASS);
+    // Keyed by the superclass's root shape, which no other class shares.
+    const auto* entry = site.find(klass.root().get());
+    const auto* method =
+        entry != nullptr ? entry->method : klass.find_method(*site.name);
+    if (method == nullptr)
+    {
+        runtime_error("Undefined property '{}'.", site.name->str());
+        return false;
+    }
+    if (entry == nullptr)
+    {
+        site.remember({klass.root(), nullptr, 0, method});
+    }
+    const auto [fn, closure] = callable_parts(*method);
+    return call_function(*fn, closure, argc, tail);
+}
+
+bool vm::bind_method(const obj_class& klass, const obj_string& name)
+{
+    const auto* method = klass.find_method(name);
+    if (method == nullptr)
+    {
+        runtime_error("Undefined property '{}'.", name.str());
+        return false;
+    }
+    stack_.back() = allocate<obj_bound_method>(stack_.back(), *method);
+    return true;
+}
+
+std::shared_ptr<obj_upvalue> vm::capture_upvalue(std::size_t slot)
+{
+    auto it = open_upvalues_.end();
+    while (it != open_upvalues_.begin() && (*std::prev(it))->slot >= slot)
+    {
+        --it;
+        if ((*it)->slot == slot)
+        {
+            return *it;
+        }
+    }
+    return *open_upvalues_.insert(it, allocate<obj_upvalue>(slot));
+}
+
+void vm::close_upvalues(std::size_t first)
+{
+    while (!open_upvalues_.empty() && open_upvalues_.back()->slot >= first)
+    {
+        auto& box   = *open_upvalues_.back();
+        box.closed  = stack_[box.slot];
+        box.is_open = false;
+        open_upvalues_.pop_back();
+    }
+}
+
+void vm::pop_frame()
+{
+    --frame_count_;
+    frame_         = &frames_[frame_count_ - 1];
+    current_chunk_ = frame_->code;
+    ip_            = frame_->ip;
+}
+
+void vm::quicken(OpCode code)
+{
+    current_chunk_->patch(
+        static_cast<std::size_t>(ip_ - current_chunk_->get_instruction(0)) - 1,
+        code);
+}
+
+void vm::print_result(const ValueType& val)
+{
+    out_buffer_.clear();
+    debug::format_value(out_buffer_, val);
+    out_buffer_ += '\n';
+    out_->write(out_buffer_);
+}
+
+void vm::set_profiler(profiler* prof)
+{
+    profiler_          = prof;
+    profile_countdown_ = 1;
+}
+
+void vm::profile_tick()
+{
+    if (profiler_ == nullptr)
+    {
+        profile_countdown_ = std::numeric_limits<std::uint32_t>::max();
+        return;
+    }
+    if (profiler_->poll())
+    {
+        std::array<profile_frame, FRAMES_MAX> stack;
+        for (std::size_t idx = 0; idx < frame_count_; ++idx)
+        {
+            const auto& frame = frames_[idx];
+            // Callers are suspended in their OP_CALL, whose operand is the
+            // byte before the saved ip.
+            const auto* ip     = idx + 1 == frame_count_ ? ip_ : frame.ip - 1;
+            const auto  offset = static_cast<std::size_t>(
+                ip - frame.code->get_instruction(0));
+            const auto  chunk =
+                static_cast<std::uint16_t>(frame.code - chunks_.data());
+            // As in the stack trace of a runtime error.
+            profiler_->name_chunk(chunk, idx == 0 ? "script"
+                                                  : frame.function->name());
+            stack[idx] = {
+                chunk,
+                reg_ip_ != nullptr
+                    ? reg_code_->line(static_cast<std::size_t>(
+                          reg_ip_ - reg_code_->code()))
+                    : frame.code->line(offset)};
+        }
+        profiler_->sample({stack.data(), frame_count_});
+    }
+    profile_countdown_ = profiler_->interval();
+}
+
+int vm::current_line() const
+{
+    if (reg_ip_ != nullptr)
+    {
+        return reg_code_->line(
+            static_cast<std::size_t>(reg_ip_ - reg_code_->code()) - 1);
+    }
+    // The ip is past the instruction's opcode.
+    const auto offset = static_cast<std::size_t>(
+        ip_ - current_chunk_->get_instruction(0));
+    return current_chunk_->line(offset == 0 ? 0 : offset - 1);
+}
+
+void vm::set_heap_profiler(heap_profiler* prof)
+{
+    if (prof == nullptr)
+    {
+        heap_->profile(nullptr, nullptr);
+        return;
+    }
+    heap_->profile(prof, [this] { return current_line(); });
+}
+
 ValueType vm::stack_pop()
 {
     if (stack_.empty())
@@ -179,11 +1476,42 @@ ValueType vm::stack_pop()
 template <class... Args>
 void vm::runtime_error(std::string_view format, Args&&... args)
 {
-    std::cout << format << std::endl;
-    const auto offset =
-        static_cast<std::size_t>(ip_ - current_chunk_->get_instruction(0)) - 1;
-    const int line = current_chunk_->line(offset);
-    std::cerr << std::format("[line {}] in script.", line) << std::endl;
+    // Keep the script's output ahead of the trace and the error.
+    out_->flush();
+#ifdef DEBUG_TRACE_EXECUTION
+    tracer_.decode(chunks_);
+#endif
+    std::cout << std::vformat(format, std::make_format_args(args...))
+              << std::endl;
+    if (reg_ip_ != nullptr)
+    {
+        std::cerr << std::format(
+                         "[line {}] in script.",
+                         reg_code_->line(static_cast<std::size_t>(
+                                             reg_ip_ - reg_code_->code()) -
+                                         1))
+                  << std::endl;
+        return;
+    }
+    // Innermost call first.
+    for (auto idx = frame_count_; idx-- > 0;)
+    {
+        const auto& frame  = frames_[idx];
+        const auto* ip     = idx + 1 == frame_count_ ? ip_ : frame.ip;
+        const auto  offset = static_cast<std::size_t>(
+                                ip - frame.code->get_instruction(0)) -
+                            1;
+        if (idx == 0)
+        {
+            std::cerr << std::format("[line {}] in script.",
+                                     frame.code->line(offset))
+                      << std::endl;
+            continue;
+        }
+        std::cerr << std::format("[line {}] in {}().", frame.code->line(offset),
+                                 frame.function->name())
+                  << std::endl;
+    }
 }
 
 }  // namespace clox